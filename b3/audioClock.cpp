@@ -0,0 +1,64 @@
+#include "audioClock.h"
+
+#include <cmath>
+
+#include "logger.h"
+
+using namespace b3;
+using namespace audioClockDefaults;
+
+void audioClock::reset(int sampleRate)
+{
+    m_sampleRate = sampleRate;
+    m_nominalUsPerFrame = sampleRate > 0 ? 1e6 / sampleRate : 0;
+    m_usPerFrame = m_nominalUsPerFrame;
+    m_valid = false;
+}
+
+uint64_t audioClock::update(uint64_t framePos, uint64_t observedUs)
+{
+    if (m_sampleRate <= 0)
+        return observedUs;
+
+    if (!m_valid) {
+        m_anchorPos = framePos;
+        m_anchorUs = observedUs;
+        m_valid = true;
+        return observedUs;
+    }
+
+    double predicted = m_anchorUs + (double)(framePos - m_anchorPos) * m_usPerFrame;
+    double error = (double)observedUs - predicted;
+
+    if (std::fabs(error) > MAX_ERROR_US) {
+        DEBUG("Audio clock re-anchored, error %.0f uS", error);
+        m_anchorPos = framePos;
+        m_anchorUs = observedUs;
+        return observedUs;
+    }
+
+    // frequency correction is spread over the distance since the last anchor
+    if (framePos > m_anchorPos) {
+        double maxDeviation = m_nominalUsPerFrame * MAX_DRIFT_PPM / 1e6;
+        m_usPerFrame += FREQUENCY_GAIN * error / (double)(framePos - m_anchorPos);
+        m_usPerFrame = std::fmin(std::fmax(m_usPerFrame, m_nominalUsPerFrame - maxDeviation), m_nominalUsPerFrame + maxDeviation);
+    }
+
+    m_anchorPos = framePos;
+    m_anchorUs = predicted + PHASE_GAIN * error;
+    return (uint64_t)m_anchorUs;
+}
+
+uint64_t audioClock::predict(uint64_t framePos) const
+{
+    if (!m_valid)
+        return 0;
+    return (uint64_t)(m_anchorUs + (double)(int64_t)(framePos - m_anchorPos) * m_usPerFrame);
+}
+
+double audioClock::driftPpm() const
+{
+    if (m_nominalUsPerFrame <= 0)
+        return 0;
+    return (m_usPerFrame / m_nominalUsPerFrame - 1) * 1e6;
+}
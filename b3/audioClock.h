@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+
+namespace b3 {
+    namespace audioClockDefaults {
+        // observations further than this from the model re-anchor it (xruns, seeks)
+        constexpr int64_t MAX_ERROR_US = 20000;
+
+        // loop gains for the phase and frequency corrections
+        constexpr double PHASE_GAIN = 0.1;
+        constexpr double FREQUENCY_GAIN = 0.001;
+
+        // largest tolerated deviation of the audio clock from CLOCK_MONOTONIC
+        constexpr double MAX_DRIFT_PPM = 500;
+    };
+
+    /**
+     * @brief
+     * Maps stream positions (frames written to the device) onto CLOCK_MONOTONIC.
+     *
+     * The model is a line anchored at the last observation whose slope is the
+     * audio clock's actual period as seen from CLOCK_MONOTONIC. Each new
+     * observation nudges the anchor and the slope, so the noise of individual
+     * delay readings is filtered out while the drift between the two clocks is
+     * tracked.
+     */
+    class audioClock {
+    public:
+        audioClock() :
+            m_sampleRate(0),
+            m_anchorPos(0),
+            m_anchorUs(0),
+            m_usPerFrame(0),
+            m_nominalUsPerFrame(0),
+            m_valid(false)
+        {}
+
+        /**
+         * @brief Drops the model, the next observation becomes the new anchor.
+         * @param sampleRate The nominal sample rate of the stream.
+         */
+        void reset(int sampleRate);
+
+        /**
+         * @brief Feeds an observation into the model.
+         *
+         * @param framePos The stream position, in frames.
+         * @param observedUs The measured monotonic time (us) at which framePos is played.
+         * @return The filtered presentation time (us) of framePos.
+         */
+        uint64_t update(uint64_t framePos, uint64_t observedUs);
+
+        /**
+         * @return The modelled presentation time (us) of framePos, 0 if no observation was made yet.
+         */
+        uint64_t predict(uint64_t framePos) const;
+
+        /**
+         * @return The estimated drift of the audio clock against CLOCK_MONOTONIC, in ppm.
+         */
+        double driftPpm() const;
+
+    private:
+        int m_sampleRate;
+
+        uint64_t m_anchorPos;
+        double m_anchorUs;
+        double m_usPerFrame;
+        double m_nominalUsPerFrame;
+
+        bool m_valid;
+    }; // class audioClock
+}; // namespace b3
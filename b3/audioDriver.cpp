@@ -2,6 +2,7 @@
 #include "audioDriver.h"
 
 #include <cassert>
+#include <cstring>
 
 #include "logger.h"
 #include "signalProcessingDefaults.h"
@@ -9,6 +10,7 @@
 
 using namespace b3;
 using namespace audioDriverDefaults;
+using namespace audioSinkDefaults;
 
 
 
@@ -19,6 +21,7 @@ void b3::audioDriver::closeDevice()
     if (m_deviceOpen) {
 #ifndef DUMMY_ALSA_DRIVERS
         // snd_pcm_drain(m_audioDevice);
+        DEBUG("Audio clock drift %.1f ppm", m_clock.driftPpm());
         snd_pcm_close(m_audioDevice);
         m_audioDevice = nullptr;
         m_hardwareParams = nullptr;
@@ -33,7 +36,7 @@ void b3::audioDriver::closeDevice()
     DEBUG("Audio Driver %llu", tm.lap());
 }
 
-int b3::audioDriver::updateAudioChannelData(int sampleRate, int channels, int bufferSize)
+int b3::audioDriver::updateAudioChannelData(int sampleRate, int channels, int bufferSize, int periods)
 {
     // note: everything here is already thread safe.
     if (m_deviceOpen)
@@ -41,7 +44,7 @@ int b3::audioDriver::updateAudioChannelData(int sampleRate, int channels, int bu
 #ifndef DUMMY_ALSA_DRIVERS
     assert(!m_audioDevice);
 #endif
-    return openDevice(DEFAULT_DEVICE, sampleRate, channels, bufferSize);
+    return openDevice(m_deviceName, sampleRate, channels, bufferSize, periods);
 }
 
 int b3::audioDriver::writeAudioData(uint8_t *data, int frameCount)
@@ -51,23 +54,230 @@ int b3::audioDriver::writeAudioData(uint8_t *data, int frameCount)
     if (m_deviceOpen) {
 #ifndef DUMMY_ALSA_DRIVERS
         ret = snd_pcm_writei(m_audioDevice, data, frameCount);
-        if (ret == -EPIPE)
+        if (ret == -EPIPE) {
             WARNING("Audio buffer underrun");
-        else if (ret < 0)
+            m_xrunCount++;
+        } else if (ret < 0)
             ERROR("Failed to write audio data %s", snd_strerror(ret));
 
         if (ret < 0) {
             snd_pcm_recover(m_audioDevice, ret, 0);
+            m_clock.reset(m_sampleRate);
             pthread_mutex_unlock(&m_audioMutex);
             return ret;
         }
+        m_framesWritten += ret;
 #endif
     }
     pthread_mutex_unlock(&m_audioMutex);
     return 0;
 }
 
-int b3::audioDriver::openDevice(const char *deviceName, uint32_t sampleRate, uint8_t channels, uint64_t samplesPerChunk)
+int b3::audioDriver::beginWrite(uint8_t **area, int frameCount)
+{
+    int ret = 0;
+    pthread_mutex_lock(&m_audioMutex);
+#ifndef DUMMY_ALSA_DRIVERS
+    if (m_deviceOpen && m_mmapAccess) {
+        const snd_pcm_channel_area_t *areas;
+        snd_pcm_uframes_t offset;
+        snd_pcm_uframes_t frames = frameCount;
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(m_audioDevice);
+
+        // block like snd_pcm_writei would until there is room for the whole request
+        while (avail >= 0 && avail < frameCount && snd_pcm_state(m_audioDevice) == SND_PCM_STATE_RUNNING) {
+            if ((ret = snd_pcm_wait(m_audioDevice, MMAP_WAIT_MS)) < 0)
+                break;
+            avail = snd_pcm_avail_update(m_audioDevice);
+        }
+
+        if (avail < 0 || ret < 0) {
+            ret = avail < 0 ? avail : ret;
+            if (ret == -EPIPE) {
+                WARNING("Audio buffer underrun");
+                m_xrunCount++;
+            } else
+                ERROR("Failed to wait for audio buffer %s", snd_strerror(ret));
+            snd_pcm_recover(m_audioDevice, ret, 0);
+            m_clock.reset(m_sampleRate);
+        }
+
+        if ((ret = snd_pcm_mmap_begin(m_audioDevice, &areas, &offset, &frames)) < 0) {
+            ERROR("Failed to map audio buffer %s", snd_strerror(ret));
+        } else {
+            *area = (uint8_t *)areas[0].addr + (areas[0].first + offset * areas[0].step) / 8;
+            m_mmapOffset = offset;
+            ret = frames;
+        }
+    }
+#endif
+    pthread_mutex_unlock(&m_audioMutex);
+    return ret;
+}
+
+int b3::audioDriver::commitWrite(int frameCount)
+{
+    int ret = 0;
+    pthread_mutex_lock(&m_audioMutex);
+#ifndef DUMMY_ALSA_DRIVERS
+    if (m_deviceOpen && m_mmapAccess) {
+        snd_pcm_sframes_t committed = snd_pcm_mmap_commit(m_audioDevice, m_mmapOffset, frameCount);
+
+        if (committed < 0 || committed != frameCount) {
+            ret = committed < 0 ? committed : -EPIPE;
+            if (ret == -EPIPE) {
+                WARNING("Audio buffer underrun");
+                m_xrunCount++;
+            } else
+                ERROR("Failed to commit audio data %s", snd_strerror(ret));
+            snd_pcm_recover(m_audioDevice, ret, 0);
+            m_clock.reset(m_sampleRate);
+        } else {
+            m_framesWritten += committed;
+
+            // mmap writes do not trigger the start threshold, start playback once data is queued
+            if (committed > 0 && snd_pcm_state(m_audioDevice) == SND_PCM_STATE_PREPARED)
+                snd_pcm_start(m_audioDevice);
+        }
+    }
+#endif
+    pthread_mutex_unlock(&m_audioMutex);
+    return ret;
+}
+
+int b3::audioDriver::setFillTarget(uint64_t frames)
+{
+    int err = 0;
+    pthread_mutex_lock(&m_audioMutex);
+#ifndef DUMMY_ALSA_DRIVERS
+    if (m_deviceOpen) {
+        snd_pcm_sw_params_t *swParams = nullptr;
+
+        if (frames > m_bufferFrames)
+            frames = m_bufferFrames;
+        if (frames < m_periodFrames)
+            frames = m_periodFrames;
+
+        // report readiness once the queue fell a period below the target
+        if ((err = snd_pcm_sw_params_malloc(&swParams)) == 0) {
+            if ((err = snd_pcm_sw_params_current(m_audioDevice, swParams)) < 0
+                || (err = snd_pcm_sw_params_set_avail_min(m_audioDevice, swParams, m_bufferFrames - frames + m_periodFrames)) < 0
+                || (err = snd_pcm_sw_params(m_audioDevice, swParams)) < 0)
+                ERROR("Failed to set audio fill target: %s", snd_strerror(err));
+            snd_pcm_sw_params_free(swParams);
+        }
+    }
+#endif
+    pthread_mutex_unlock(&m_audioMutex);
+    return err;
+}
+
+int b3::audioDriver::setPaused(bool paused)
+{
+    int err = 0;
+    pthread_mutex_lock(&m_audioMutex);
+#ifndef DUMMY_ALSA_DRIVERS
+    if (m_deviceOpen) {
+        snd_pcm_state_t state = snd_pcm_state(m_audioDevice);
+
+        if (m_canPause) {
+            if (paused && state == SND_PCM_STATE_RUNNING)
+                err = snd_pcm_pause(m_audioDevice, 1);
+            else if (!paused && state == SND_PCM_STATE_PAUSED)
+                err = snd_pcm_pause(m_audioDevice, 0);
+        } else if (paused) {
+            if (state == SND_PCM_STATE_RUNNING || state == SND_PCM_STATE_PREPARED)
+                err = snd_pcm_drop(m_audioDevice);
+        } else if (state == SND_PCM_STATE_SETUP) {
+            err = snd_pcm_prepare(m_audioDevice);
+        }
+
+        if (err < 0)
+            ERROR("Failed to %s audio device: %s", paused ? "pause" : "resume", snd_strerror(err));
+
+        // the delay jumps by the time spent paused, the clock model starts over
+        m_clock.reset(m_sampleRate);
+    }
+#endif
+    pthread_mutex_unlock(&m_audioMutex);
+    return err;
+}
+
+int b3::audioDriver::pollDescriptors(struct pollfd *fds, int maxCount)
+{
+    pthread_mutex_lock(&m_audioMutex);
+    m_pollFdCount = 0;
+#ifndef DUMMY_ALSA_DRIVERS
+    if (m_deviceOpen) {
+        int count = snd_pcm_poll_descriptors_count(m_audioDevice);
+        if (count > maxCount || count > MAX_POLL_FDS) {
+            WARNING("Audio device uses %d poll descriptors, polling disabled", count);
+        } else if (count > 0) {
+            m_pollFdCount = snd_pcm_poll_descriptors(m_audioDevice, m_pollFds, count);
+            if (m_pollFdCount < 0)
+                m_pollFdCount = 0;
+            memcpy(fds, m_pollFds, m_pollFdCount * sizeof(struct pollfd));
+        }
+    }
+#endif
+    pthread_mutex_unlock(&m_audioMutex);
+    return m_pollFdCount;
+}
+
+bool b3::audioDriver::pollReady(int fd, unsigned short events)
+{
+    bool ready = false;
+    pthread_mutex_lock(&m_audioMutex);
+#ifndef DUMMY_ALSA_DRIVERS
+    if (m_deviceOpen && m_pollFdCount > 0) {
+        // the device decodes the raw events of all its descriptors at once
+        unsigned short revents = 0;
+        for (int i = 0; i < m_pollFdCount; i++)
+            m_pollFds[i].revents = m_pollFds[i].fd == fd ? events : 0;
+
+        if (snd_pcm_poll_descriptors_revents(m_audioDevice, m_pollFds, m_pollFdCount, &revents) == 0)
+            ready = revents & (POLLOUT | POLLERR);
+    }
+#endif
+    pthread_mutex_unlock(&m_audioMutex);
+    return ready;
+}
+
+uint64_t b3::audioDriver::nextPresentationUs()
+{
+    uint64_t now = timeManager::getUsSinceEpoch();
+    uint64_t pts = now;
+
+    pthread_mutex_lock(&m_audioMutex);
+#ifndef DUMMY_ALSA_DRIVERS
+    if (m_deviceOpen && m_sampleRate > 0) {
+        snd_pcm_uframes_t avail;
+        snd_htimestamp_t tstamp;
+        snd_pcm_sframes_t delay;
+        uint64_t observedUs = 0;
+
+        // htimestamp pairs avail with the time the hardware pointer was read, which
+        // keeps period-granular pointer updates from showing up as jitter
+        if (snd_pcm_state(m_audioDevice) == SND_PCM_STATE_RUNNING
+            && snd_pcm_htimestamp(m_audioDevice, &avail, &tstamp) == 0
+            && (tstamp.tv_sec || tstamp.tv_nsec)
+            && avail <= m_bufferFrames) {
+            delay = m_bufferFrames - avail;
+            observedUs = (uint64_t)tstamp.tv_sec * 1000000 + tstamp.tv_nsec / 1000 + delay * 1000000 / m_sampleRate;
+        } else if (snd_pcm_delay(m_audioDevice, &delay) == 0 && delay >= 0) {
+            observedUs = now + delay * 1000000 / m_sampleRate;
+        }
+
+        pts = observedUs ? m_clock.update(m_framesWritten, observedUs) : m_clock.predict(m_framesWritten);
+        if (!pts)
+            pts = now;
+    }
+#endif
+    pthread_mutex_unlock(&m_audioMutex);
+    return pts;
+}
+
+int b3::audioDriver::openDevice(const char *deviceName, uint32_t sampleRate, uint8_t channels, uint64_t samplesPerChunk, uint32_t periods)
 {
     /**
      * Clearing up some nomenclature here becuase I got very confused and it lead to some bugs
@@ -87,8 +297,14 @@ int b3::audioDriver::openDevice(const char *deviceName, uint32_t sampleRate, uin
     pthread_mutex_lock(&m_audioMutex);
     int err = 0;
     uint32_t chnls, rate, frameRate;
-    uint64_t chunkSize;
-    int chunkSizeBytes;
+    uint64_t chunkSize, bufferSize;
+    int chunkSizeBytes = -1;
+#ifndef DUMMY_ALSA_DRIVERS
+    snd_pcm_sw_params_t *swParams = nullptr;
+#else
+    ERROR("Built without ALSA, can't open audio device %s", deviceName);
+    pthread_mutex_unlock(&m_audioMutex);
+#endif
     
 
 #ifndef DUMMY_ALSA_DRIVERS
@@ -101,32 +317,59 @@ int b3::audioDriver::openDevice(const char *deviceName, uint32_t sampleRate, uin
         goto badInitCleanup;
     if ((err = snd_pcm_hw_params_any(m_audioDevice, m_hardwareParams)) < 0)
         goto badInitCleanup;
-    // set stream parameters
-    if ((err = snd_pcm_hw_params_set_access(m_audioDevice, m_hardwareParams, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0)
+    // set stream parameters, preferring in place writes to the device ring
+    m_mmapAccess = snd_pcm_hw_params_set_access(m_audioDevice, m_hardwareParams, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0;
+    if (!m_mmapAccess && (err = snd_pcm_hw_params_set_access(m_audioDevice, m_hardwareParams, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0)
         goto badInitCleanup;
     if ((err = snd_pcm_hw_params_set_format(m_audioDevice, m_hardwareParams, DEFAULT_OUTPUT_FORAMT)) < 0)
         goto badInitCleanup;
     if ((err = snd_pcm_hw_params_set_channels(m_audioDevice, m_hardwareParams, channels)) < 0)
         goto badInitCleanup;
 
+    // only offer rates the hardware runs at natively, so a mismatch is resampled once, by us
+    if (snd_pcm_hw_params_set_rate_resample(m_audioDevice, m_hardwareParams, 0) < 0)
+        WARNING("Audio device %s always resamples", deviceName);
+
     frameRate = sampleRate;
     if ((err = snd_pcm_hw_params_set_rate_near(m_audioDevice, m_hardwareParams, &frameRate, 0)) < 0)
         goto badInitCleanup;
     if ((err = snd_pcm_hw_params_set_period_size_near(m_audioDevice, m_hardwareParams, &samplesPerChunk, 0)) < 0)
         goto badInitCleanup;
+    // bound the device buffer so playout latency follows the configured chunk count
+    if ((err = snd_pcm_hw_params_set_periods_near(m_audioDevice, m_hardwareParams, &periods, 0)) < 0)
+        goto badInitCleanup;
     // write parameters to driver
     if ((err = snd_pcm_hw_params(m_audioDevice, m_hardwareParams)) < 0) {
         goto badInitCleanup;
     }
 
+    // monotonic hardware timestamps for playout scheduling
+    if (snd_pcm_sw_params_malloc(&swParams) == 0) {
+        if (snd_pcm_sw_params_current(m_audioDevice, swParams) < 0
+            || snd_pcm_sw_params_set_tstamp_mode(m_audioDevice, swParams, SND_PCM_TSTAMP_ENABLE) < 0
+            || snd_pcm_sw_params_set_tstamp_type(m_audioDevice, swParams, SND_PCM_TSTAMP_TYPE_MONOTONIC) < 0
+            || snd_pcm_sw_params(m_audioDevice, swParams) < 0)
+            WARNING("Audio device has no monotonic timestamps, using snd_pcm_delay");
+        snd_pcm_sw_params_free(swParams);
+    }
+
     if ((err = snd_pcm_prepare(m_audioDevice)) < 0) {
         goto badInitCleanup;
     }
 
     m_deviceOpen = true;
     snd_pcm_hw_params_get_period_size(m_hardwareParams, &chunkSize, 0);
+    snd_pcm_hw_params_get_buffer_size(m_hardwareParams, &bufferSize);
     snd_pcm_hw_params_get_channels(m_hardwareParams, &chnls);
     snd_pcm_hw_params_get_rate(m_hardwareParams, &rate, 0);
+
+    m_canPause = snd_pcm_hw_params_can_pause(m_hardwareParams);
+    m_sampleRate = rate;
+    m_periodFrames = chunkSize;
+    m_bufferFrames = bufferSize;
+    m_framesWritten = 0;
+    m_clock.reset(rate);
+
     pthread_mutex_unlock(&m_audioMutex);
     snd_pcm_hw_params_free(m_hardwareParams);
 
@@ -135,7 +378,10 @@ int b3::audioDriver::openDevice(const char *deviceName, uint32_t sampleRate, uin
     DEBUG("Opened audio device %s", snd_pcm_name(m_audioDevice));
     DEBUG("--%d Hz (%d bps)", rate, rate * 8 * chnls * signalProcessingDefaults::BYTES_PER_SAMPLE);
     DEBUG("--%d channels, %d frames/chunk (%d bytes)", chnls, chunkSize, chunkSizeBytes);
-    DEBUG("--%d ms chunks", chunkSize * 1000 / signalProcessingDefaults::DEFAULT_SAMPLE_RATE);
+    DEBUG("--%d frames buffered (%d chunks)", bufferSize, bufferSize / chunkSize);
+    DEBUG("--%d ms chunks", chunkSize * 1000 / rate);
+    DEBUG("--%s access", m_mmapAccess ? "mmap" : "read/write");
+    DEBUG("--%s pause", m_canPause ? "hardware" : "no");
 
 #endif 
     return chunkSizeBytes;
@@ -4,16 +4,22 @@
 extern "C" {
 #include <stdint.h>
 #include <pthread.h>
+#include <poll.h>
 
 #ifndef DUMMY_ALSA_DRIVERS
 #include <alsa/asoundlib.h>
 #endif
 }
 #include "signalProcessingDefaults.h"
+#include "audioClock.h"
+#include "audioSink.h"
 
 namespace b3 {
     namespace audioDriverDefaults {
         constexpr const char *DEFAULT_DEVICE = "default";
+
+        // longest single wait for room in the mmap ring (ms)
+        constexpr int MMAP_WAIT_MS = 100;
 #ifndef DUMMY_ALSA_DRIVERS
         constexpr _snd_pcm_format __get_default_format__()
         {
@@ -34,20 +40,38 @@ namespace b3 {
     };
 
 
-    class audioDriver {
+    /**
+     * @brief
+     * ALSA playback sink.
+     */
+    class audioDriver : public audioSink {
     public:
-        audioDriver() :
+        /**
+         * @param deviceName The ALSA device opened by updateAudioChannelData().
+         */
+        audioDriver(const char *deviceName = audioDriverDefaults::DEFAULT_DEVICE) :
 #ifndef DUMMY_ALSA_DRIVERS
             m_audioDevice(nullptr),
             m_hardwareParams(nullptr),
 #endif
-            m_deviceOpen(false)
+            m_deviceOpen(false),
+            m_pollFdCount(0),
+            m_mmapAccess(false),
+            m_mmapOffset(0),
+            m_canPause(false),
+            m_sampleRate(0),
+            m_periodFrames(0),
+            m_bufferFrames(0),
+            m_xrunCount(0),
+            m_framesWritten(0)
         {
-            m_deviceName[0] = '\0';
+            snprintf(m_deviceName, sizeof(m_deviceName), "%s", deviceName);
             pthread_mutex_init(&m_audioMutex, nullptr);
         }
         ~audioDriver() { closeDevice(); }
 
+        const char *name() const override { return "alsa"; }
+
         /**
          * @brief Opens an audio device with the specified parameters.
          *
@@ -56,9 +80,11 @@ namespace b3 {
          * If the device is already open, it will return an error.
          *
          * @param deviceName The name of the audio device to open.
-         * @param sampleRate The sample rate of the audio in frames per second.
+         * @param sampleRate The preferred sample rate of the audio in frames per second. The nearest
+         *                   rate the hardware supports natively is used, see getSampleRate().
          * @param channels The number of audio channels (e.g., 1 for mono, 2 for stereo).
          * @param buffSize The buffer size in frames.
+         * @param periods The number of periods (chunks) in the device buffer.
          * @return The size of the chunk in frames if successful, or a negative error code if failed.
          *
          * @note This function uses ALSA (Advanced Linux Sound Architecture) for audio device management.
@@ -66,7 +92,7 @@ namespace b3 {
          * @warning Ensure that the device is not already open before calling this function.
          *
          */
-        int openDevice(const char *deviceName, uint32_t sampleRate, uint8_t channels, uint64_t buffsize);
+        int openDevice(const char *deviceName, uint32_t sampleRate, uint8_t channels, uint64_t buffsize, uint32_t periods);
 
         /**
          * @brief Opens the default audio device with the specified parameters.
@@ -78,6 +104,7 @@ namespace b3 {
          * @param sampleRate The sample rate of the audio in frames per second.
          * @param channels The number of audio channels (e.g., 1 for mono, 2 for stereo).
          * @param buffSize The buffer size in frames.
+         * @param periods The number of periods (chunks) in the device buffer.
          * @return The size of the chunk in frames if successful, or a negative error code if failed.
          *
          * @note This function uses ALSA (Advanced Linux Sound Architecture) for audio device management.
@@ -85,13 +112,13 @@ namespace b3 {
          * @warning Ensure that the device is not already open before calling this function.
          *
          */
-        inline int openDevice(uint32_t sampleRate, uint8_t channels, uint64_t buffsize) { return openDevice(audioDriverDefaults::DEFAULT_DEVICE, sampleRate, channels, buffsize); }
+        inline int openDevice(uint32_t sampleRate, uint8_t channels, uint64_t buffsize, uint32_t periods) { return openDevice(audioDriverDefaults::DEFAULT_DEVICE, sampleRate, channels, buffsize, periods); }
 
         /**
          * @brief
          * Closes the audio device. Thread safe.
          */
-        void closeDevice();
+        void closeDevice() override;
 
         /**
          * @brief
@@ -99,9 +126,11 @@ namespace b3 {
          *
          * @param sampleRate new sample rate
          * @param channels new # of audio channels
+         * @param buffersize new period size in frames
+         * @param periods new # of periods in the device buffer
          * @return negotiated frame size in bytes
          */
-        int updateAudioChannelData(int sampleRate, int channels, int buffersize);
+        int updateAudioChannelData(int sampleRate, int channels, int buffersize, int periods) override;
 
         /**
          * @brief Writes audio data to the audio device.
@@ -113,7 +142,109 @@ namespace b3 {
          * @param frameCount Number of frames of audio data to write.
          * @return int Returns 0 on success, or a negative error code on failure.
          */
-        int writeAudioData(uint8_t *data, int size);
+        int writeAudioData(uint8_t *data, int frameCount) override;
+
+        /**
+         * @brief Maps the next writable region of the device ring buffer.
+         *
+         * When the device was opened with mmap access, frames can be produced directly into the
+         * device ring instead of being copied in by writeAudioData(). Waits for room if the ring
+         * is full. Every successful call must be followed by commitWrite().
+         *
+         * @param area Receives the address of the first writable frame (interleaved).
+         * @param frameCount The number of frames wanted.
+         * @return The number of contiguous frames available at area (may be less than frameCount),
+         *         0 if the device is not mmap capable (use writeAudioData()), or a negative error code.
+         */
+        int beginWrite(uint8_t **area, int frameCount) override;
+
+        /**
+         * @brief Hands frames produced at the area returned by beginWrite() to the device.
+         *
+         * @param frameCount The number of frames written, at most the value beginWrite() returned.
+         * @return 0 on success, or a negative error code on failure.
+         */
+        int commitWrite(int frameCount) override;
+
+        /**
+         * @brief Sets how many frames are kept queued in the device when it is driven by poll readiness.
+         *
+         * The device reports readiness (see pollDescriptors()) once the queue fell a period below
+         * the target, so the queue depth can change at runtime within the buffer opened by openDevice().
+         *
+         * @param frames The queue depth, clamped to one period and the device buffer size.
+         * @return 0 on success, or a negative error code on failure.
+         */
+        int setFillTarget(uint64_t frames) override;
+
+        /**
+         * @brief Pauses or resumes the device. Thread safe.
+         *
+         * Uses snd_pcm_pause, which keeps the queued frames, when the hardware supports it.
+         * Otherwise the device is stopped with snd_pcm_drop and prepared again on resume,
+         * and the frames queued at the time of the pause are lost.
+         *
+         * @param paused true to pause, false to resume.
+         * @return 0 on success, or a negative error code on failure.
+         */
+        int setPaused(bool paused) override;
+
+        // without hardware pause the queue is dropped and the device prepared again on resume
+        inline bool pauseKeepsQueue() const override { return m_canPause; }
+
+        /**
+         * @return The device buffer size (frames), 0 if no device is open
+         */
+        inline uint64_t bufferFrames() const override { return m_deviceOpen ? m_bufferFrames : 0; }
+
+        /**
+         * @return The number of underruns since the device was created
+         */
+        inline uint64_t xrunCount() const override { return m_xrunCount; }
+
+        /**
+         * @brief Gets the descriptors to poll for device readiness, for use in an event loop.
+         *
+         * @param fds Receives the descriptors and the events to wait for.
+         * @param maxCount The size of fds.
+         * @return The number of descriptors, 0 if the device cannot be polled.
+         */
+        int pollDescriptors(struct pollfd *fds, int maxCount) override;
+
+        /**
+         * @brief Translates events reported on one of the pollDescriptors() into device readiness.
+         *
+         * @param fd The descriptor the events were reported on.
+         * @param events The reported events.
+         * @return true if a period can be written without blocking, or the device needs recovery.
+         */
+        bool pollReady(int fd, unsigned short events) override;
+
+        /**
+         * @return true if the device ring is written in place (see beginWrite())
+         */
+        inline bool mmapAccess() const override { return m_mmapAccess; }
+
+        /**
+         * @brief Estimates when the next frame passed to writeAudioData() will be played. Thread safe.
+         *
+         * The estimate is derived from the device delay (snd_pcm_htimestamp, or snd_pcm_delay as a
+         * fallback) and filtered through an audioClock, which tracks the drift of the device clock
+         * against CLOCK_MONOTONIC.
+         *
+         * @return Presentation time in us since epoch (CLOCK_MONOTONIC).
+         */
+        uint64_t nextPresentationUs() override;
+
+        /**
+         * @return The sample rate the device was opened at (hz), 0 if no device is open
+         */
+        inline uint32_t getSampleRate() const override { return m_deviceOpen ? m_sampleRate : 0; }
+
+        /**
+         * @return Estimated drift of the device clock against CLOCK_MONOTONIC (ppm)
+         */
+        inline double clockDriftPpm() const override { return m_clock.driftPpm(); }
 
     private:
 #ifndef DUMMY_ALSA_DRIVERS
@@ -123,6 +254,25 @@ namespace b3 {
         pthread_mutex_t m_audioMutex;
         bool m_deviceOpen;
 
+        // descriptors handed out by pollDescriptors()
+        struct pollfd m_pollFds[audioSinkDefaults::MAX_POLL_FDS];
+        int m_pollFdCount;
+
+        // in place writes to the device ring
+        bool m_mmapAccess;
+        uint64_t m_mmapOffset;
+
+        // hardware pause, otherwise a pause drops the queued frames
+        bool m_canPause;
+
+        // playout timing
+        uint32_t m_sampleRate;
+        uint64_t m_periodFrames;
+        uint64_t m_bufferFrames;
+        uint64_t m_xrunCount;
+        uint64_t m_framesWritten;
+        audioClock m_clock;
+
         char m_deviceName[255];     //todo get rid of magic number
     }; // class audioDriver
 }; // namespace b3
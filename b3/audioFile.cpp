@@ -6,6 +6,7 @@ extern "C" {
 #include <cassert>
 
 #include "logger.h"
+#include "perfTrace.h"
 #include "sighandler.h"
 #include "timeManager.h"
 
@@ -64,21 +65,11 @@ int b3::audioFile::openFile(const char *fileName, uint64_t timetag)
     DEBUG("--sample rate: %d", m_decoderContext->sample_rate);
     DEBUG("--input sample format: %d", m_decoderContext->sample_fmt);
 
-    // allocate the converter
-    swr_alloc_set_opts2(
-        &m_swrContext,
-        &m_decoderContext->ch_layout,
-        audioFileDefaults::DEFAULT_DECODER_FORMAT,
-        signalProcessingDefaults::DEFAULT_SAMPLE_RATE,
-        &m_decoderContext->ch_layout,
-        m_decoderContext->sample_fmt,
-        m_decoderContext->sample_rate,
-        0, nullptr
-    );
+    // start at the native rate, the player renegotiates once the device is open
+    if (_configureOutput(m_decoderContext->sample_rate, audioFileDefaults::DEFAULT_RESAMPLER_PROFILE) < 0)
+        goto openFileErrorCleanup;
 
     m_fileOpen = true;
-    DEBUG("Resampler Settings:");
-    DEBUG("--sample rate: %d", getSampleRate());
 
     // seek to timetag
     if (av_seek_frame(m_formatContext, m_streamIndx, timetag, AVSEEK_FLAG_BACKWARD) < 0)
@@ -121,6 +112,9 @@ void b3::audioFile::closeFile()
         }
         m_audioFileName[0] = '\0';
         m_streamIndx = -1;
+        m_outputRate = 0;
+        m_passThrough = false;
+        m_frameSampleNdx = 0;
         m_fileOpen = false;
     }
     
@@ -140,6 +134,7 @@ void b3::audioFile::closeFile()
 
 int b3::audioFile::readChunk(uint8_t *buffer, int readSize)
 {
+    PERF_SPAN("decode");
     pthread_mutex_lock(&m_fileMutex);
 
     if (!m_fileOpen) {
@@ -151,23 +146,67 @@ int b3::audioFile::readChunk(uint8_t *buffer, int readSize)
     // assert frame has been allocated & initialized
     assert(m_frame != nullptr);
 
-    int samplesStored = 0;
-    int frameSize;
-    do {
-        if (m_frameSampleNdx == 0 && _readFrame(m_frame) <= 0)
-            break;
-        frameSize = _getFrameSize(m_frame);
-        int copysize = MIN(frameSize - m_frameSampleNdx, readSize - samplesStored);
+    int frameSize = _getOutputFrameSize();
+    int framesWanted = readSize / frameSize;
+    int framesStored = 0;
+
+    // a non-null input with no samples drains the resampler without flushing it
+    const uint8_t *noInput[AV_NUM_DATA_POINTERS] = { nullptr };
+
+    while (framesStored < framesWanted && !signalHandler::g_shouldExit) {
+        uint8_t *out = buffer + framesStored * frameSize;
+        int ret;
+
+        if (m_passThrough) {
+            // decoded frames are already in the output format, only a single copy is needed
+            int pending = m_frame->nb_samples - m_frameSampleNdx;
+            if (pending > 0) {
+                int count = MIN(pending, framesWanted - framesStored);
+                memcpy(out, m_frame->data[0] + m_frameSampleNdx * frameSize, count * frameSize);
+                m_frameSampleNdx += count;
+                framesStored += count;
+                continue;
+            }
+        } else {
+            PERF_SPAN("resample");
+            ret = swr_convert(m_swrContext, &out, framesWanted - framesStored, noInput, 0);
+            if (ret > 0) {
+                framesStored += ret;
+                continue;
+            }
+        }
 
-        memcpy(buffer + samplesStored, m_frame->data[0] + m_frameSampleNdx, copysize);
+        // nothing buffered, decode the next frame and resample it straight into the buffer
+        m_frameSampleNdx = 0;
+        int decoded = _readFrame(m_frame);
+        if (decoded < 0) {
+            av_frame_unref(m_frame);
+
+            // end of stream, take whatever the resampler still holds
+            if (!m_passThrough) {
+                ret = swr_convert(m_swrContext, &out, framesWanted - framesStored, nullptr, 0);
+                if (ret > 0)
+                    framesStored += ret;
+            }
+            break;
+        }
+        if (decoded == 0 || m_passThrough)
+            continue;
 
-        samplesStored += copysize;
-        m_frameSampleNdx = ((m_frameSampleNdx + copysize) % (frameSize));
-    } while (samplesStored < readSize && !signalHandler::g_shouldExit);
+        {
+            PERF_SPAN("resample");
+            ret = swr_convert(m_swrContext, &out, framesWanted - framesStored, (const uint8_t **)m_frame->extended_data, m_frame->nb_samples);
+        }
+        if (ret < 0) {
+            ERROR("Failed to convert frame");
+            break;
+        }
+        framesStored += ret;
+    }
 
     pthread_mutex_unlock(&m_fileMutex);
 
-    return samplesStored;
+    return framesStored * frameSize;
 }
 
 inline int b3::audioFile::_normalizeAudio(const char *fileName)
@@ -237,7 +276,8 @@ int b3::audioFile::_readFrame(AVFrame *frame)
 
     if (ret == AVERROR(EAGAIN)) {
         m_packetSent = false;
-        // continue;
+        ret = 0;
+        goto errorCleanup;
     } else if (ret == AVERROR_EOF) {
         DEBUG("Decoder reached end of file");
         // reset timestamp
@@ -248,24 +288,15 @@ int b3::audioFile::_readFrame(AVFrame *frame)
         goto errorCleanup;
     }
 
+    // keep the decoded frame, readChunk() resamples it in place of the caller's buffer
     av_frame_unref(frame);
+    av_frame_move_ref(frame, tempFrame);
+    m_currentTimeTagUs = frame->pts;
 
-    // convert frame to the data we like
-    frame->sample_rate = signalProcessingDefaults::DEFAULT_SAMPLE_RATE;
-    frame->ch_layout = tempFrame->ch_layout;
-    frame->format = audioFileDefaults::DEFAULT_DECODER_FORMAT;
-    m_currentTimeTagUs = tempFrame->pts;
-
-    ret = swr_convert_frame(m_swrContext, frame, tempFrame);
-    if (ret < 0) {
-        ERROR("Failed to convert frame");
-        goto errorCleanup;
-    }
     av_frame_free(&tempFrame);
     av_packet_free(&packet);
 
-    // return the buffer size in the frame
-    return _getFrameSize(frame);
+    return frame->nb_samples;
 
 errorCleanup:
     // deallocate function only needed stuff
@@ -297,8 +328,117 @@ int b3::audioFile::getSampleRate() const
 {
     if (!m_fileOpen)
         return 0;
-    assert(m_swrContext != nullptr);
-    int64_t fsOut;
-    av_opt_get_int(m_swrContext, "out_sample_rate", 0, &fsOut);
-    return fsOut;
+    return m_outputRate;
+}
+
+int b3::audioFile::getSourceSampleRate() const
+{
+    if (!m_fileOpen)
+        return 0;
+    assert(m_decoderContext != nullptr);
+    return m_decoderContext->sample_rate;
+}
+
+int b3::audioFile::seekUs(uint64_t positionUs)
+{
+    pthread_mutex_lock(&m_fileMutex);
+
+    if (!m_fileOpen) {
+        WARNING("File not open");
+        pthread_mutex_unlock(&m_fileMutex);
+        return -1;
+    }
+
+    AVRational usTimeBase = { 1, AV_TIME_BASE };
+    AVRational timeBase = m_formatContext->streams[m_streamIndx]->time_base;
+    int64_t timetag = av_rescale_q(positionUs, usTimeBase, timeBase);
+
+    if (av_seek_frame(m_formatContext, m_streamIndx, timetag, AVSEEK_FLAG_BACKWARD) < 0) {
+        ERROR("Failed to seek to %llu us", (unsigned long long)positionUs);
+        pthread_mutex_unlock(&m_fileMutex);
+        return -1;
+    }
+
+    // drop everything decoded before the seek point
+    avcodec_flush_buffers(m_decoderContext);
+    av_frame_unref(m_frame);
+    m_frameSampleNdx = 0;
+    m_packetSent = false;
+    if (m_swrContext)
+        swr_init(m_swrContext);
+
+    m_currentTimeTagUs = timetag;
+
+    pthread_mutex_unlock(&m_fileMutex);
+    return 0;
+}
+
+uint64_t b3::audioFile::positionUs() const
+{
+    if (!m_fileOpen)
+        return 0;
+    AVRational usTimeBase = { 1, AV_TIME_BASE };
+    return av_rescale_q(m_currentTimeTagUs, m_formatContext->streams[m_streamIndx]->time_base, usTimeBase);
+}
+
+int b3::audioFile::setOutputFormat(int sampleRate, int profile)
+{
+    pthread_mutex_lock(&m_fileMutex);
+    int ret = -1;
+    if (m_fileOpen)
+        ret = _configureOutput(sampleRate, profile);
+    else
+        WARNING("File not open");
+    pthread_mutex_unlock(&m_fileMutex);
+    return ret;
+}
+
+int b3::audioFile::_configureOutput(int sampleRate, int profile)
+{
+    assert(m_decoderContext != nullptr);
+
+    if (m_swrContext)
+        swr_free(&m_swrContext);
+
+    m_outputRate = sampleRate;
+    m_passThrough = sampleRate == m_decoderContext->sample_rate
+        && m_decoderContext->sample_fmt == audioFileDefaults::DEFAULT_DECODER_FORMAT;
+
+    if (m_passThrough) {
+        DEBUG("Output matches the decoder (%d Hz), bypassing swresample", sampleRate);
+        return 0;
+    }
+
+    if (profile < 0 || profile >= audioFileDefaults::_resamplerProfileCount)
+        profile = audioFileDefaults::DEFAULT_RESAMPLER_PROFILE;
+    const audioFileDefaults::resamplerSettings &settings = audioFileDefaults::RESAMPLER_SETTINGS[profile];
+
+    if (swr_alloc_set_opts2(
+            &m_swrContext,
+            &m_decoderContext->ch_layout,
+            audioFileDefaults::DEFAULT_DECODER_FORMAT,
+            sampleRate,
+            &m_decoderContext->ch_layout,
+            m_decoderContext->sample_fmt,
+            m_decoderContext->sample_rate,
+            0, nullptr) < 0) {
+        ERROR("Failed to allocate resampler");
+        return -1;
+    }
+
+    // only matters when the rates differ, format conversion alone never runs the filter
+    av_opt_set_int(m_swrContext, "filter_size", settings.filterSize, 0);
+    av_opt_set_int(m_swrContext, "phase_shift", settings.phaseShift, 0);
+    av_opt_set_double(m_swrContext, "cutoff", settings.cutoff, 0);
+
+    if (swr_init(m_swrContext) < 0) {
+        ERROR("Failed to initialize resampler");
+        swr_free(&m_swrContext);
+        return -1;
+    }
+
+    DEBUG("Resampler Settings:");
+    DEBUG("--%d Hz -> %d Hz", m_decoderContext->sample_rate, sampleRate);
+    DEBUG("--profile %d (filter size %d)", profile, settings.filterSize);
+    return 0;
 }
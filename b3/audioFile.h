@@ -32,6 +32,28 @@ namespace b3 {
             }
         }
         constexpr AVSampleFormat DEFAULT_DECODER_FORMAT = __get_default_codec();
+
+        // resampler quality/speed trade-off, used when the device can't run at the file's rate
+        enum resamplerProfile {
+            RESAMPLER_FAST,         // short filter, for the slowest boards
+            RESAMPLER_BALANCED,     // swresample defaults
+            RESAMPLER_BEST,         // long filter, fine phase steps
+
+            _resamplerProfileCount
+        };
+
+        struct resamplerSettings {
+            int filterSize;
+            int phaseShift;
+            double cutoff;
+        };
+
+        constexpr resamplerSettings RESAMPLER_SETTINGS[_resamplerProfileCount] = {
+            { 8, 6, 0.90 },
+            { 32, 10, 0.97 },
+            { 64, 12, 0.98 },
+        };
+        constexpr int DEFAULT_RESAMPLER_PROFILE = RESAMPLER_BALANCED;
     };
 
 
@@ -44,6 +66,8 @@ namespace b3 {
             m_decoder(nullptr),
             m_frame(nullptr),
             m_streamIndx(-1),
+            m_outputRate(0),
+            m_passThrough(false),
             m_frameSampleNdx(0),
             m_fileOpen(false),
             m_packetSent(false),
@@ -67,7 +91,8 @@ namespace b3 {
          * @brief Reads a chunk of audio data into the provided buffer.
          *
          * This function reads up to `readSize` bytes of audio data from the audio file
-         * into the provided buffer. Function is thread safe.
+         * into the provided buffer. Decoded frames are resampled straight into the buffer,
+         * so it may point into the audio device's ring. Function is thread safe.
          *
          * @param buffer Pointer to the buffer where the audio data will be stored.
          * @param readSize The maximum number of bytes to read into the buffer.
@@ -110,54 +135,91 @@ namespace b3 {
 
 
         /**
-         * @brief Returns the sample rate of the loaded audio file.
+         * @brief Returns the sample rate readChunk() produces.
          * @return sample rate (hz), 0 if no file is loaded
 
          */
         int getSampleRate() const;
 
+        /**
+         * @return the native sample rate of the loaded audio file (hz), 0 if no file is loaded
+         */
+        int getSourceSampleRate() const;
+
+        /**
+         * @brief Selects the sample rate readChunk() produces. Function is thread safe.
+         *
+         * The file is opened at its native rate. When the output rate and format match the
+         * decoder's, decoded frames are passed through without swresample; otherwise the
+         * resampler is configured with the given profile.
+         *
+         * @param sampleRate The output sample rate (hz).
+         * @param profile The resampler profile (audioFileDefaults::resamplerProfile).
+         * @return 0 on success, -1 on failure.
+         */
+        int setOutputFormat(int sampleRate, int profile);
+
+        /**
+         * @return true if decoded frames are passed through without swresample
+         */
+        inline bool passThrough() const { return m_passThrough; }
+
         inline int getCurrentTimestampUs() const { return m_currentTimeTagUs; }
 
-    private:
         /**
-         * @brief gets the size of the current frame (frame must be init'd and loaded). Function is NOT thread safe.
+         * @brief Moves decoding to a position in the file. Samples already decoded or
+         * buffered in the resampler are dropped. Function is thread safe.
          *
-         * @return int The size of the frame in bytes
+         * @param positionUs The position (us from the start of the file).
+         * @return 0 on success, -1 on failure.
          */
-        inline int _getFrameSize() const
-        {
-            assert(m_frame != nullptr);
-            assert(m_decoderContext != nullptr);
-            return _getFrameSize(m_frame);
-        }
+        int seekUs(uint64_t positionUs);
 
-        inline int _getFrameSize(AVFrame *frame) const
+        /**
+         * @return The position of the most recently decoded frame (us from the start of the file), 0 if no file is loaded
+         */
+        uint64_t positionUs() const;
+
+        /**
+         * @return The path of the open file, empty if no file is loaded
+         */
+        inline const char *fileName() const { return m_audioFileName; }
+
+    private:
+        /**
+         * @return The size of one output frame (all channels) in bytes. Function is NOT thread safe.
+         */
+        inline int _getOutputFrameSize() const
         {
-            if (frame == nullptr)
-                return 0;
             assert(m_decoderContext != nullptr);
-            return frame->ch_layout.nb_channels * frame->nb_samples * av_get_bytes_per_sample(audioFileDefaults::DEFAULT_DECODER_FORMAT);
+            return m_decoderContext->ch_layout.nb_channels * av_get_bytes_per_sample(audioFileDefaults::DEFAULT_DECODER_FORMAT);
         }
 
         inline int _normalizeAudio(const char *fileName);
 
+        /**
+         * @brief Sets up the output path for a given rate. Function is NOT thread safe.
+         * @return 0 on success, -1 on failure.
+         */
+        int _configureOutput(int sampleRate, int profile);
+
         /**
          * @brief Reads a frame from the audio file.
          *
          * This function reads a frame from the audio file and decodes it. It handles
-         * packet reading, decoding, and frame conversion. If the file is not open,
-         * it returns an error. The frame is decoded into the format specified by `audioFileDefaults::DEFAULT_DECODER_FORMAT`.
+         * packet reading and decoding. If the file is not open, it returns an error.
+         * The frame is left in the decoder's native format; readChunk() resamples it
+         * into the format specified by `audioFileDefaults::DEFAULT_DECODER_FORMAT`.
          *
          * @param frame Pointer to an AVFrame structure where the decoded frame will be stored.
-         * @return int Returns the size of the frame buffer on success, or a negative error code on failure.
+         * @return int Returns the number of decoded samples per channel on success (0 if the decoder
+         * needs more packets), or a negative error code on failure.
          *
          * Error Codes:
          * - -1: File not open or could not find a valid packet.
          *
          * - AVERROR_EOF: End of file reached.
          *
-         * - AVERROR(EAGAIN): Decoder needs more packets to produce a frame.
-         *
          * Other negative values:
          *
          * - Errors during packet reading, sending, receiving, or frame conversion.
@@ -169,12 +231,16 @@ namespace b3 {
         AVCodecContext *m_decoderContext;
         SwrContext *m_swrContext;
         AVCodec *m_decoder;
-        AVFrame *m_frame;   // used for reading frames, most recent frame read is stored here
+        AVFrame *m_frame;   // used for reading frames, most recent decoded (not yet resampled) frame is stored here
         int8_t m_streamIndx;
 
+        // output path
+        int m_outputRate;
+        bool m_passThrough;
+        int m_frameSampleNdx;   // samples of m_frame already passed through
+
         char m_audioFileName[audioFileDefaults::FILE_NAME_BUFFER_SIZE];
 
-        int m_frameSampleNdx;
         bool m_fileOpen;
         bool m_packetSent;
         uint64_t m_currentTimeTagUs;
@@ -0,0 +1,352 @@
+#include "audioSink.h"
+
+extern "C" {
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+}
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#ifndef DUMMY_ALSA_DRIVERS
+#include "audioDriver.h"
+#endif
+#include "logger.h"
+#include "timeManager.h"
+
+using namespace b3;
+using namespace audioSinkDefaults;
+
+audioSink *audioSink::create(const char *spec)
+{
+    std::string kind(spec ? spec : DEFAULT_SINK);
+    std::string arg;
+
+    size_t colon = kind.find(':');
+    if (colon != std::string::npos) {
+        arg = kind.substr(colon + 1);
+        kind = kind.substr(0, colon);
+    }
+
+    if (kind == "alsa") {
+#ifdef DUMMY_ALSA_DRIVERS
+        WARNING("Built without ALSA, using the null sink");
+        return new nullSink(true);
+#else
+        return new audioDriver(arg.empty() ? audioDriverDefaults::DEFAULT_DEVICE : arg.c_str());
+#endif
+    }
+
+    if (kind == "null" && (arg.empty() || arg == "virtual"))
+        return new nullSink(arg.empty());
+
+    if (kind == "wav" && !arg.empty())
+        return new wavSink(arg.c_str());
+
+    if (kind == "pipe")
+        return new pipeSink(arg.empty() ? nullptr : arg.c_str());
+
+    ERROR("Unknown audio sink %s", spec);
+    return nullptr;
+}
+
+clockedSink::clockedSink(bool paced) :
+    m_paced(paced),
+    m_open(false),
+    m_sampleRate(0),
+    m_channels(0),
+    m_bufferFrames(0),
+    m_fillFrames(0),
+    m_framesWritten(0),
+    m_xrunCount(0),
+    m_startUs(0),
+    m_startFrame(0),
+    m_pausedUs(0),
+    m_openUs(0),
+    m_emitUs(0)
+{}
+
+int clockedSink::updateAudioChannelData(int sampleRate, int channels, int buffersize, int periods)
+{
+    if (m_open)
+        closeDevice();
+
+    if (sampleRate <= 0 || channels <= 0 || buffersize <= 0) {
+        ERROR("Invalid %s sink format: %d Hz, %d channels, %d frames/chunk", name(), sampleRate, channels, buffersize);
+        return -1;
+    }
+
+    m_sampleRate = sampleRate;
+    m_channels = channels;
+    m_bufferFrames = (uint64_t)buffersize * (periods > 0 ? periods : 1);
+    m_fillFrames = 0;
+    m_framesWritten = 0;
+    m_startUs = 0;
+    m_startFrame = 0;
+    m_pausedUs = 0;
+    m_emitUs = 0;
+
+    if (_openOutput() != 0)
+        return -1;
+
+    m_open = true;
+    m_openUs = timeManager::getUsSinceEpoch();
+
+    DEBUG("Opened %s sink", name());
+    DEBUG("--%d Hz, %d channels, %d frames/chunk", sampleRate, channels, buffersize);
+    DEBUG("--%llu frames buffered, %s clock", m_bufferFrames, m_paced ? "real" : "virtual");
+    return buffersize * channels * signalProcessingDefaults::BYTES_PER_SAMPLE;
+}
+
+void clockedSink::closeDevice()
+{
+    if (!m_open)
+        return;
+
+    _closeOutput();
+    m_open = false;
+
+    // how fast the pipeline runs against this sink
+    uint64_t elapsedUs = timeManager::getUsSinceEpoch() - m_openUs;
+    DEBUG("%s sink: %.2f s of audio in %.2f s, %.2f s spent writing",
+          name(),
+          (double)m_framesWritten / m_sampleRate,
+          elapsedUs / 1e6,
+          m_emitUs / 1e6);
+}
+
+int clockedSink::setPaused(bool paused)
+{
+    if (!m_open || paused == (m_pausedUs != 0))
+        return 0;
+
+    uint64_t now = timeManager::getUsSinceEpoch();
+
+    // the played position stands still while paused, playout continues from it
+    if (paused)
+        m_pausedUs = now;
+    else {
+        if (m_startUs)
+            m_startUs += now - m_pausedUs;
+        m_pausedUs = 0;
+    }
+    return 0;
+}
+
+uint64_t clockedSink::_playedFrames(uint64_t now)
+{
+    if (!m_startUs)
+        return m_framesWritten;
+    if (m_pausedUs)
+        now = m_pausedUs;
+
+    uint64_t played = m_startFrame + (now - m_startUs) * m_sampleRate / 1000000;
+    return played < m_framesWritten ? played : m_framesWritten;
+}
+
+int clockedSink::writeAudioData(uint8_t *data, int frameCount)
+{
+    if (!m_open || frameCount <= 0)
+        return 0;
+
+    if (m_paced) {
+        uint64_t now = timeManager::getUsSinceEpoch();
+
+        // the buffer ran dry, playout restarts with this write like a device would
+        if (m_startUs && m_startFrame + (now - m_startUs) * m_sampleRate / 1000000 > m_framesWritten) {
+            WARNING("Audio buffer underrun");
+            m_xrunCount++;
+            m_startUs = 0;
+        }
+        if (!m_startUs) {
+            m_startUs = now;
+            m_startFrame = m_framesWritten;
+        }
+
+        // block until the buffer has room, a write larger than the buffer only waits for it to drain
+        uint64_t limit = (m_fillFrames && m_fillFrames < m_bufferFrames) ? m_fillFrames : m_bufferFrames;
+        if (limit < (uint64_t)frameCount)
+            limit = frameCount;
+        uint64_t queued;
+        while ((queued = m_framesWritten - _playedFrames(now)) + frameCount > limit) {
+            uint64_t waitUs = (queued + frameCount - limit) * 1000000 / m_sampleRate + 1;
+            systemClock::sleepUs(waitUs < MAX_PACE_SLEEP_US ? waitUs : MAX_PACE_SLEEP_US);
+            now = timeManager::getUsSinceEpoch();
+        }
+    }
+
+    uint64_t emitStartUs = timeManager::getUsSinceEpoch();
+    int err = _emit(data, frameCount);
+    m_emitUs += timeManager::getUsSinceEpoch() - emitStartUs;
+
+    if (err != 0)
+        return -EIO;
+
+    m_framesWritten += frameCount;
+    return 0;
+}
+
+uint64_t clockedSink::nextPresentationUs()
+{
+    uint64_t now = timeManager::getUsSinceEpoch();
+
+    // a virtual clock has no playout delay, frames count as heard once written
+    if (!m_open || !m_paced || !m_startUs)
+        return now;
+
+    return now + (m_framesWritten - _playedFrames(now)) * 1000000 / m_sampleRate;
+}
+
+// little endian fields of the WAV header
+static uint8_t *putLE(uint8_t *out, uint32_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+        *out++ = (value >> (8 * i)) & 0xff;
+    return out;
+}
+
+wavSink::wavSink(const char *path) :
+    clockedSink(false),
+    m_file(nullptr)
+{
+    snprintf(m_path, sizeof(m_path), "%s", path);
+}
+
+wavSink::~wavSink()
+{
+    closeDevice();
+}
+
+int wavSink::_openOutput()
+{
+    m_file = fopen(m_path, "wb");
+    if (!m_file) {
+        ERROR("Failed to open %s: %s", m_path, strerror(errno));
+        return -1;
+    }
+
+    // sizes are filled in by _closeOutput()
+    uint8_t header[44];
+    uint8_t *p = header;
+    int blockAlign = m_channels * signalProcessingDefaults::BYTES_PER_SAMPLE;
+
+    memcpy(p, "RIFF", 4);       p += 4;
+    p = putLE(p, 0, 4);
+    memcpy(p, "WAVEfmt ", 8);   p += 8;
+    p = putLE(p, 16, 4);                        // fmt chunk size
+    p = putLE(p, 1, 2);                         // PCM
+    p = putLE(p, m_channels, 2);
+    p = putLE(p, m_sampleRate, 4);
+    p = putLE(p, m_sampleRate * blockAlign, 4); // byte rate
+    p = putLE(p, blockAlign, 2);
+    p = putLE(p, signalProcessingDefaults::BYTES_PER_SAMPLE * 8, 2);
+    memcpy(p, "data", 4);       p += 4;
+    p = putLE(p, 0, 4);
+
+    if (fwrite(header, sizeof(header), 1, m_file) != 1) {
+        ERROR("Failed to write %s: %s", m_path, strerror(errno));
+        fclose(m_file);
+        m_file = nullptr;
+        return -1;
+    }
+    return 0;
+}
+
+int wavSink::_emit(const uint8_t *data, int frameCount)
+{
+    size_t frameBytes = m_channels * signalProcessingDefaults::BYTES_PER_SAMPLE;
+    if (fwrite(data, frameBytes, frameCount, m_file) != (size_t)frameCount) {
+        ERROR("Failed to write %s: %s", m_path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+void wavSink::_closeOutput()
+{
+    if (!m_file)
+        return;
+
+    uint32_t dataBytes = m_framesWritten * m_channels * signalProcessingDefaults::BYTES_PER_SAMPLE;
+    uint8_t size[4];
+
+    putLE(size, 36 + dataBytes, 4);
+    if (fseek(m_file, 4, SEEK_SET) == 0)
+        fwrite(size, sizeof(size), 1, m_file);
+
+    putLE(size, dataBytes, 4);
+    if (fseek(m_file, 40, SEEK_SET) == 0)
+        fwrite(size, sizeof(size), 1, m_file);
+
+    fclose(m_file);
+    m_file = nullptr;
+    INFO("Wrote %s (%.2f s)", m_path, (double)m_framesWritten / m_sampleRate);
+}
+
+pipeSink::pipeSink(const char *path) :
+    clockedSink(false),
+    m_fd(-1)
+{
+    snprintf(m_path, sizeof(m_path), "%s", path ? path : "-");
+}
+
+pipeSink::~pipeSink()
+{
+    closeDevice();
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+int pipeSink::_openOutput()
+{
+    // a reader going away should fail the write, not kill the player
+    signal(SIGPIPE, SIG_IGN);
+
+    if (strcmp(m_path, "-") == 0) {
+        // stdout is kept for the audio across reopens, the logs move to stderr
+        if (m_fd < 0) {
+            fflush(stdout);
+            m_fd = dup(STDOUT_FILENO);
+            if (m_fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+                ERROR("Failed to take over stdout: %s", strerror(errno));
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    m_fd = open(m_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (m_fd < 0) {
+        ERROR("Failed to open %s: %s", m_path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int pipeSink::_emit(const uint8_t *data, int frameCount)
+{
+    size_t remaining = (size_t)frameCount * m_channels * signalProcessingDefaults::BYTES_PER_SAMPLE;
+
+    while (remaining > 0) {
+        ssize_t written = write(m_fd, data, remaining);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            ERROR("Failed to write to %s: %s", m_path, strerror(errno));
+            return -1;
+        }
+        data += written;
+        remaining -= written;
+    }
+    return 0;
+}
+
+void pipeSink::_closeOutput()
+{
+    if (m_fd >= 0 && strcmp(m_path, "-") != 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
@@ -0,0 +1,302 @@
+#pragma once
+
+extern "C" {
+#include <stdint.h>
+#include <poll.h>
+}
+
+#include <cstdio>
+
+#include "signalProcessingDefaults.h"
+
+namespace b3 {
+    namespace audioSinkDefaults {
+        // sink used when none is selected
+#ifdef DUMMY_ALSA_DRIVERS
+        constexpr const char *DEFAULT_SINK = "null";
+#else
+        constexpr const char *DEFAULT_SINK = "alsa";
+#endif
+
+        // most poll descriptors expected from a sink (ALSA plugins may use more than one)
+        constexpr int MAX_POLL_FDS = 4;
+
+        // longest single sleep of a paced sink while its buffer is full (us)
+        constexpr uint64_t MAX_PACE_SLEEP_US = 10000;
+    };
+
+    /**
+     * @brief
+     * Destination of the decoded audio. The signal processor writes PCM16
+     * interleaved frames to a sink and asks it when they will be heard.
+     *
+     * Sinks are selected at runtime with a spec string, see create().
+     */
+    class audioSink {
+    public:
+        virtual ~audioSink() {}
+
+        /**
+         * @brief
+         * (Re)opens the sink for a new stream.
+         *
+         * @param sampleRate preferred sample rate, see getSampleRate() for the one used
+         * @param channels # of audio channels
+         * @param buffersize period size in frames
+         * @param periods # of periods in the sink buffer
+         * @return negotiated period size in bytes, or a negative error code
+         */
+        virtual int updateAudioChannelData(int sampleRate, int channels, int buffersize, int periods) = 0;
+
+        /**
+         * @brief
+         * Closes the sink.
+         */
+        virtual void closeDevice() = 0;
+
+        /**
+         * @brief Writes frames to the sink, blocking while its buffer is full.
+         *
+         * @param data Pointer to the interleaved frames.
+         * @param frameCount Number of frames to write.
+         * @return 0 on success, or a negative error code on failure.
+         */
+        virtual int writeAudioData(uint8_t *data, int frameCount) = 0;
+
+        /**
+         * @brief Maps the next writable region of the sink buffer, for sinks which are written in place.
+         *
+         * @param area Receives the address of the first writable frame (interleaved).
+         * @param frameCount The number of frames wanted.
+         * @return The number of contiguous frames available at area, 0 if the sink is not written
+         *         in place (use writeAudioData()), or a negative error code.
+         */
+        virtual int beginWrite(uint8_t **area, int frameCount) { (void)area; (void)frameCount; return 0; }
+
+        /**
+         * @brief Hands frames produced at the area returned by beginWrite() to the sink.
+         *
+         * @param frameCount The number of frames written.
+         * @return 0 on success, or a negative error code on failure.
+         */
+        virtual int commitWrite(int frameCount) { (void)frameCount; return 0; }
+
+        /**
+         * @brief Freezes or resumes playout. Frames already queued are kept and played
+         * once playout resumes, so nothing has to be rewritten or re-decoded.
+         *
+         * @param paused true to pause, false to resume.
+         * @return 0 on success, or a negative error code on failure.
+         */
+        virtual int setPaused(bool paused) { (void)paused; return 0; }
+
+        /**
+         * @return false if pausing discards the frames already queued instead of keeping them.
+         */
+        virtual bool pauseKeepsQueue() const { return true; }
+
+        /**
+         * @brief Sets how many frames are kept queued when the sink is driven by poll readiness.
+         *
+         * @param frames The queue depth.
+         * @return 0 on success, or a negative error code on failure.
+         */
+        virtual int setFillTarget(uint64_t frames) { (void)frames; return 0; }
+
+        /**
+         * @brief Gets the descriptors to poll for sink readiness, for use in an event loop.
+         *
+         * @param fds Receives the descriptors and the events to wait for.
+         * @param maxCount The size of fds.
+         * @return The number of descriptors, 0 if the sink cannot be polled (pace it with a timer).
+         */
+        virtual int pollDescriptors(struct pollfd *fds, int maxCount) { (void)fds; (void)maxCount; return 0; }
+
+        /**
+         * @brief Translates events reported on one of the pollDescriptors() into sink readiness.
+         *
+         * @return true if a period can be written without blocking.
+         */
+        virtual bool pollReady(int fd, unsigned short events) { (void)fd; (void)events; return false; }
+
+        /**
+         * @brief Estimates when the next frame passed to the sink will be heard.
+         *
+         * @return Presentation time in us since epoch (CLOCK_MONOTONIC).
+         */
+        virtual uint64_t nextPresentationUs() = 0;
+
+        /**
+         * @return true if the sink buffer is written in place (see beginWrite())
+         */
+        virtual bool mmapAccess() const { return false; }
+
+        /**
+         * @return The sample rate the sink was opened at (hz), 0 if it is not open
+         */
+        virtual uint32_t getSampleRate() const = 0;
+
+        /**
+         * @return The sink buffer size (frames), 0 if it is not open
+         */
+        virtual uint64_t bufferFrames() const = 0;
+
+        /**
+         * @return The number of underruns since the sink was created
+         */
+        virtual uint64_t xrunCount() const { return 0; }
+
+        /**
+         * @return Estimated drift of the sink clock against CLOCK_MONOTONIC (ppm)
+         */
+        virtual double clockDriftPpm() const { return 0; }
+
+        /**
+         * @return true if the sink consumes audio at playback speed, false if it takes
+         *         frames as fast as they are produced
+         */
+        virtual bool realTime() const { return true; }
+
+        /**
+         * @return a short human readable sink name.
+         */
+        virtual const char *name() const = 0;
+
+        /**
+         * Creates the sink selected at runtime.
+         *
+         * @param spec One of
+         *             "alsa[:device]"  ALSA playback, on the default device unless given,
+         *             "null[:virtual]" discards audio, paced by the real clock or, with
+         *                              :virtual, as fast as it is produced,
+         *             "wav:path"       writes a WAV file, as fast as audio is produced,
+         *             "pipe[:path]"    writes raw PCM16 frames to path (a FIFO, a file) or to
+         *                              stdout, paced by the reader. Logs move to stderr.
+         *             nullptr selects audioSinkDefaults::DEFAULT_SINK.
+         * @return a new sink owned by the caller, or nullptr if the spec is not valid.
+         */
+        static audioSink *create(const char *spec);
+    }; // class audioSink
+
+    /**
+     * @brief
+     * Base of the sinks which are not backed by a device. Emulates a device
+     * buffer of the requested size which is played out by a real or a virtual
+     * clock; derived sinks decide where the frames go.
+     */
+    class clockedSink : public audioSink {
+    public:
+        /**
+         * @param paced true to play out the buffer with the real clock, false to accept
+         *              frames as fast as they are written (the stream time is virtual)
+         */
+        clockedSink(bool paced);
+
+        int updateAudioChannelData(int sampleRate, int channels, int buffersize, int periods) override;
+        void closeDevice() override;
+        int writeAudioData(uint8_t *data, int frameCount) override;
+        uint64_t nextPresentationUs() override;
+        int setFillTarget(uint64_t frames) override { m_fillFrames = frames; return 0; }
+        int setPaused(bool paused) override;
+        uint32_t getSampleRate() const override { return m_open ? m_sampleRate : 0; }
+        uint64_t bufferFrames() const override { return m_open ? m_bufferFrames : 0; }
+        uint64_t xrunCount() const override { return m_xrunCount; }
+        bool realTime() const override { return m_paced; }
+
+    protected:
+        /**
+         * @brief Opens the destination of the frames.
+         * @return 0 on success, nonzero otherwise.
+         */
+        virtual int _openOutput() { return 0; }
+
+        /**
+         * @brief Writes frames to the destination.
+         * @return 0 on success, nonzero otherwise.
+         */
+        virtual int _emit(const uint8_t *data, int frameCount) { (void)data; (void)frameCount; return 0; }
+
+        /**
+         * @brief Closes the destination.
+         */
+        virtual void _closeOutput() {}
+
+        /**
+         * @return the frames played out by the real clock, at most the frames written
+         */
+        uint64_t _playedFrames(uint64_t now);
+
+        bool m_paced;
+        bool m_open;
+        uint32_t m_sampleRate;
+        int m_channels;
+        uint64_t m_bufferFrames;
+        uint64_t m_fillFrames;      // queue depth kept by a paced sink, 0 for the whole buffer
+        uint64_t m_framesWritten;
+        uint64_t m_xrunCount;
+
+        // real clock playout, restarted after an underrun
+        uint64_t m_startUs;
+        uint64_t m_startFrame;
+        uint64_t m_pausedUs;        // time playout was paused, 0 while it runs
+
+        // throughput report
+        uint64_t m_openUs;
+        uint64_t m_emitUs;
+    }; // class clockedSink
+
+    /**
+     * @brief
+     * Discards the audio.
+     */
+    class nullSink : public clockedSink {
+    public:
+        nullSink(bool paced) : clockedSink(paced) {}
+        const char *name() const override { return m_paced ? "null" : "null:virtual"; }
+    }; // class nullSink
+
+    /**
+     * @brief
+     * Writes the audio to a PCM16 WAV file. The sizes in the header are
+     * filled in when the sink is closed.
+     */
+    class wavSink : public clockedSink {
+    public:
+        wavSink(const char *path);
+        ~wavSink();
+        const char *name() const override { return "wav"; }
+
+    protected:
+        int _openOutput() override;
+        int _emit(const uint8_t *data, int frameCount) override;
+        void _closeOutput() override;
+
+    private:
+        char m_path[signalProcessingDefaults::FILE_NAME_BUFFER_SIZE];
+        FILE *m_file;
+    }; // class wavSink
+
+    /**
+     * @brief
+     * Writes raw PCM16 interleaved frames to a file descriptor, stdout by
+     * default. Writes block while the reader is behind, which paces playback.
+     */
+    class pipeSink : public clockedSink {
+    public:
+        /**
+         * @param path The file or FIFO to write to, nullptr or "-" for stdout
+         */
+        pipeSink(const char *path);
+        ~pipeSink();
+        const char *name() const override { return "pipe"; }
+
+    protected:
+        int _openOutput() override;
+        int _emit(const uint8_t *data, int frameCount) override;
+        void _closeOutput() override;
+
+    private:
+        char m_path[signalProcessingDefaults::FILE_NAME_BUFFER_SIZE];
+        int m_fd;
+    }; // class pipeSink
+}; // namespace b3
@@ -1,19 +1,31 @@
+#include <memory>
 #include <string>
+#include <thread>
 
 
 extern "C" {
 #include <unistd.h>
-#include <sys/socket.h>
-#include <sys/un.h>
+#include <signal.h>
 }
 
 #include "gpio.h"
 #include "logger.h"
 #include "signalProcessing.h"
-#include "audioDriver.h"
+#include "audioSink.h"
 #include "audioFile.h"
 #include "b3Config.h"
 #include "sighandler.h"
+#include "eventLoop.h"
+#include "configStore.h"
+#include "configWatcher.h"
+#include "controlServer.h"
+#include "eventStream.h"
+#include "player.h"
+#include "rtPolicy.h"
+#include "startupTrace.h"
+#include "perfTrace.h"
+#include "metrics.h"
+#include "statusSegment.h"
 
 using namespace b3;
 using namespace std;
@@ -22,9 +34,17 @@ using namespace std;
 
 int main(int argc, char **argv)
 {
+    startupTrace::start();
+    int configPhase = startupTrace::begin("config");
+
     uint64_t seekTime = 0;
+    const char *gpioTracePath = nullptr;
+    const char *sinkSpec = nullptr;
+    const char *perfTracePath = nullptr;
+    bool daemonMode = false;
+    bool fileGiven = false;
     char fileName[255];
-    snprintf(fileName, sizeof(fileName), "%s/%s", audioFileDefaults::AUDIO_FILES_PATH, audioFileDefaults::DEFAULT_FILE_NAME);
+    snprintf(fileName, sizeof(fileName), "%s", audioFileDefaults::DEFAULT_FILE_NAME);
 
     b3Config globalConfig;
 
@@ -34,10 +54,15 @@ int main(int argc, char **argv)
             INFO("Verbose logging enabled");
         }
         if (string(argv[i]) == "-f" && i + 1 < argc) {
-            snprintf(fileName, sizeof(fileName), "%s/%s", audioFileDefaults::AUDIO_FILES_PATH, argv[i + 1]);
+            snprintf(fileName, sizeof(fileName), "%s", argv[i + 1]);
             INFO("loading sound file: %s", argv[i + 1]);
+            fileGiven = true;
             i++;
         }
+        if (string(argv[i]) == "-daemon") {
+            daemonMode = true;
+            INFO("Daemon mode, commands are read from %s", controlServerDefaults::SOCKET_PATH);
+        }
         if (string(argv[i]) == "-lpf" && i + 1 < argc) {
             globalConfig.LPF_CUTOFF = stod(argv[i + 1]);
             INFO("LPF setting: %s", argv[i + 1]);
@@ -63,35 +88,183 @@ int main(int argc, char **argv)
             INFO("Mouth RMS threshold %d", globalConfig.MOUTH_THRESHOLD);
             i++;
         }
+        if (string(argv[i]) == "-gpio-trace" && i + 1 < argc) {
+            gpioTracePath = argv[i + 1];
+            INFO("GPIO trace file: %s", gpioTracePath);
+            i++;
+        }
+        if (string(argv[i]) == "-perf-trace" && i + 1 < argc) {
+            perfTracePath = argv[i + 1];
+            i++;
+        }
+#ifdef VIRTUAL_CLOCK
+        if (string(argv[i]) == "-clock-rate" && i + 1 < argc) {
+            virtualClock::setRate(stod(argv[i + 1]));
+            INFO("Virtual clock running at %sx", argv[i + 1]);
+            i++;
+        }
+#endif
+        if (string(argv[i]) == "-sink" && i + 1 < argc) {
+            sinkSpec = argv[i + 1];
+            INFO("Audio sink: %s", sinkSpec);
+            i++;
+        }
     }
 
-    globalConfig.printSettings();
+    startupTrace::end(configPhase);
+
+    // spans are recorded from the start, before any thread is created
+    if (perfTracePath)
+        perfTrace::enable(perfTracePath);
+
+    // lock memory before the threads start, they inherit the locked arena
+    if (globalConfig.LOCK_MEMORY)
+        rtPolicy::lockMemory();
+
+    // termination signals are only delivered through the event loop, block
+    // them before any thread is started so every thread inherits the mask
+    signalHandler::blockSignals();
+
+    // from here on the log is written by its own thread, the audio and GPIO
+    // threads only queue their records
+    _logger::start();
+
+    eventLoop loop;
+    if (loop.init() != 0)
+        return -1;
+
+    loop.addSignals({ SIGINT, SIGTERM }, [&](int sig) {
+        signalHandler::sigintHandler(sig);
+        loop.stop();
+    });
+
+    // the spans recorded so far are written on request, playback goes on
+    loop.addSignals({ SIGUSR1 }, [&](int) {
+        if (perfTrace::enabled())
+            perfTrace::dumpAsync();
+        else
+            INFO("Span recording is off, start b3 with -perf-trace <file>");
+    });
+
+    // the settings are written back off the critical path, from a copy
+    std::thread settingsWriter([settings = globalConfig]() mutable {
+        int phase = startupTrace::begin("settings write");
+        settings.printSettings();
+        startupTrace::end(phase);
+    });
+
+    // config changes are parsed on the watcher thread and published as snapshots,
+    // it starts watching once the settings were written back
+    configStore configs(globalConfig);
+    configWatcher watcher(configs, configDefaults::DEFAULT_CONFIG_PATH);
 
-    GPIO gpio = GPIO(&globalConfig);
-    gpio.start(signalHandler::sigintHandler);
+    // live status for b3stat and the web server, playback goes on without it
+    statusSegment status;
+    status.create();
 
-    audioDriver driver = audioDriver();
-    audioFile file = audioFile();
-    signalProcessor processor = signalProcessor(globalConfig);
+    // events for control socket subscribers, only recorded while somebody listens
+    eventStream events;
 
-    if (file.openFile(fileName, seekTime) != 0){
-        INFO("Failed to open %s, exiting...",fileName);
+    std::unique_ptr<audioSink> sink(audioSink::create(sinkSpec));
+    if (!sink) {
+        settingsWriter.join();
         return -1;
     }
-    processor.setAudioDriver(&driver);
-    processor.setFile(&file);
 
-    do {
-        globalConfig.poll();
-        processor.update(State::PLAYING);
-    } while (!signalHandler::g_shouldExit && processor.getState() != State::STOPPED);
+    signalProcessor processor(configs);
+    processor.setStatusSegment(&status);
+    processor.setEventStream(&events);
+    processor.setEventDriven(true);
+
+    // one chunk per device readiness event, the sink is only polled while playing
+    player playback(loop, processor, sink.get());
+
+    // probing the file and opening the device are the slowest steps of the start up, they
+    // overlap each other and the GPIO set up. The device is opened at the most common
+    // format and reopened by load() if the file turns out to differ
+    bool playAtStart = !daemonMode || fileGiven;
+    std::thread sinkOpener;
+    if (playAtStart) {
+        playback.prefetch(fileName, seekTime);
+        sinkOpener = std::thread([&processor]() {
+            int phase = startupTrace::begin("device open");
+            processor.openSink(signalProcessingDefaults::DEFAULT_SAMPLE_RATE, signalProcessingDefaults::DEFAULT_CHANNELS);
+            startupTrace::end(phase);
+        });
+    }
+
+    // pins are set up on the GPIO thread
+    GPIO gpio(&configs, gpioBackend::create(gpioTracePath));
+    gpio.setStatusSegment(&status);
+    gpio.setEventStream(&events);
+    gpio.start();
+
+    // every song learns its own thresholds, from where it left off last time
+    playback.setLoadHandler([&gpio](const char *path) { gpio.changeSong(thresholdIndex::songKey(path)); });
+
+    // the main thread decodes, filters and feeds the audio sink; sinks running on a
+    // virtual clock never block, under SCHED_FIFO they would starve the system
+    if (sink->realTime())
+        rtPolicy::applyThread("b3-audio", globalConfig.RT[RT_AUDIO]);
+    else
+        INFO("%s sink is not real-time, audio thread keeps its scheduling", sink->name());
+    metrics::registerThread();
+
+    // a daemon keeps the sink, decoder and GPIO set up between files and takes
+    // its commands from the control socket; otherwise b3 exits after the file
+    controlServer control(loop, playback, watcher, configs, events);
+    int failed = 0;
+    if (daemonMode) {
+        failed = control.open();
+        control.setQuitHandler([&]() { loop.stop(); });
+    } else {
+        playback.setIdleHandler([&]() { loop.stop(); });
+    }
+
+    if (sinkOpener.joinable())
+        sinkOpener.join();
+
+    if (!failed && playAtStart) {
+        int loadPhase = startupTrace::begin("load");
+        if (playback.load(fileName, seekTime) != 0 && !daemonMode) {
+            INFO("Failed to open %s, exiting...", fileName);
+            failed = -1;
+        }
+        startupTrace::end(loadPhase);
+
+        if (!failed)
+            playback.play();
+    } else if (!failed) {
+        startupTrace::finish("ready for commands", timeManager::getUsSinceEpoch());
+    }
+
+    settingsWriter.join();
+    if (failed) {
+        gpio.stop();
+        return -1;
+    }
+    watcher.start();
+
+    if (!signalHandler::g_shouldExit && (daemonMode || playback.state() != State::STOPPED))
+        loop.run();
 
     INFO("Shutting down...");
 
-    globalConfig.SEEK_TIME = file.getCurrentTimestampUs();
-    globalConfig.printSettings();
+    // with the watcher stopped this thread is the only writer
+    watcher.stop();
+    b3Config finalConfig(*configs.current());
+    finalConfig.SEEK_TIME = playback.timetag();
+    finalConfig.printSettings();
+
+    control.close();
+    playback.stop();
 
     gpio.stop();
+    gpio.storeThresholds();
+
+    if (perfTrace::enabled())
+        perfTrace::dump();
+    metrics::report();
 
     DEBUG("Have a nice day :)");
     return 0;
@@ -2,9 +2,12 @@
 
 #include <unordered_map>
 #include <functional>
+#include <stdexcept>
 #include <string>
 
 #include "signalProcessingDefaults.h"
+#include "eventStream.h"
+#include "frameRing.h"
 #include "logger.h"
 
 using namespace b3;
@@ -19,8 +22,32 @@ namespace configVars {
     constexpr const char *RMS_WINDOW_MS = "rms_window_ms";
     constexpr const char *CHUNK_SIZE_MS = "chunk_size_ms";
     constexpr const char *FLIP_INTERVAL_MS = "flip_interval_ms";
+    constexpr const char *HYSTERESIS_PCT = "hysteresis_pct";
+    constexpr const char *ATTACK_MS = "attack_ms";
+    constexpr const char *RELEASE_MS = "release_ms";
+    constexpr const char *DUTY_DEADBAND = "duty_deadband";
+    constexpr const char *AUTO_THRESHOLD = "auto_threshold";
+    constexpr const char *AUTO_THRESHOLD_PCT = "auto_threshold_pct";
+    constexpr const char *AUTO_THRESHOLD_RATE_PCT = "auto_threshold_rate_pct";
+    constexpr const char *RESAMPLER_PROFILE = "resampler_profile";
+    constexpr const char *ADAPTIVE_LATENCY = "adaptive_latency";
+    constexpr const char *LATENCY_MIN_MS = "latency_min_ms";
+    constexpr const char *LATENCY_MAX_MS = "latency_max_ms";
+    constexpr const char *EVENT_RATE_HZ = "event_rate_hz";
     constexpr const char *BUFFER_COUNT = "buffer_count";
     constexpr const char *SEEK_TIME = "seek_time";
+    constexpr const char *FISH_COUNT = "fish_count";
+    constexpr const char *AUDIO_RT_PRIORITY = "audio_rt_priority";
+    constexpr const char *AUDIO_CPUS = "audio_cpus";
+    constexpr const char *GPIO_RT_PRIORITY = "gpio_rt_priority";
+    constexpr const char *GPIO_CPUS = "gpio_cpus";
+    constexpr const char *LOCK_MEMORY = "lock_memory";
+
+    // per-fish keys, formatted with the fish index
+    constexpr const char *FISH_ROUTE = "fish%d_route";
+    constexpr const char *FISH_PINS = "fish%d_pins";
+    constexpr const char *FISH_BODY_THRESHOLD = "fish%d_body_threshold";
+    constexpr const char *FISH_MOUTH_THRESHOLD = "fish%d_mouth_threshold";
 
 
 
@@ -28,6 +55,32 @@ namespace configVars {
     std::function<void(float &, std::string)> assignFloat = [](float &f, std::string value) {f = std::stof(value);};
     std::function<void(uint64_t &, std::string)> assignU64 = [](uint64_t &i, std::string value) {i = std::stoull(value);};
 
+    // parses a comma separated list, returns the number of values parsed
+    template <typename T>
+    int assignList(T *out, int maxCount, std::string value)
+    {
+        int count = 0;
+        const char *cursor = value.c_str();
+        while (count < maxCount) {
+            char *end;
+            float v = strtof(cursor, &end);
+            if (end == cursor)
+                break;
+            out[count++] = (T)v;
+            cursor = end;
+            while (*cursor == ',' || isspace(*cursor))
+                cursor++;
+        }
+        return count;
+    }
+
+    std::string fishKey(const char *fmt, int fish)
+    {
+        char key[64];
+        snprintf(key, sizeof(key), fmt, fish);
+        return key;
+    }
+
     std::unordered_map<std::string, std::function<void(b3Config &, std::string)>> g_configMap = {
         {LPF,               [](b3Config &cfg, std::string value) {assignFloat(cfg.LPF_CUTOFF, value);}},
         {HPF,               [](b3Config &cfg, std::string value) {assignFloat(cfg.HPF_CUTOFF, value);}},
@@ -36,9 +89,45 @@ namespace configVars {
         {MOUTH_THRESHOLD,   [](b3Config &cfg, std::string value) {assignInt(cfg.MOUTH_THRESHOLD, value);}},
         {RMS_WINDOW_MS,     [](b3Config &cfg, std::string value) {assignInt(cfg.RMS_WINDOW_MS, value);}},
         {FLIP_INTERVAL_MS,  [](b3Config &cfg, std::string value) {assignInt(cfg.FLIP_INTERVAL_MS, value);}},
+        {HYSTERESIS_PCT,    [](b3Config &cfg, std::string value) {assignInt(cfg.HYSTERESIS_PCT, value);}},
+        {ATTACK_MS,         [](b3Config &cfg, std::string value) {assignInt(cfg.ATTACK_MS, value);}},
+        {RELEASE_MS,        [](b3Config &cfg, std::string value) {assignInt(cfg.RELEASE_MS, value);}},
+        {DUTY_DEADBAND,     [](b3Config &cfg, std::string value) {assignInt(cfg.DUTY_DEADBAND, value);}},
+        {AUTO_THRESHOLD,    [](b3Config &cfg, std::string value) {assignInt(cfg.AUTO_THRESHOLD, value);}},
+        {AUTO_THRESHOLD_PCT, [](b3Config &cfg, std::string value) {assignInt(cfg.AUTO_THRESHOLD_PCT, value);}},
+        {AUTO_THRESHOLD_RATE_PCT, [](b3Config &cfg, std::string value) {assignInt(cfg.AUTO_THRESHOLD_RATE_PCT, value);}},
+        {RESAMPLER_PROFILE, [](b3Config &cfg, std::string value) {assignInt(cfg.RESAMPLER_PROFILE, value);}},
+        {ADAPTIVE_LATENCY,  [](b3Config &cfg, std::string value) {assignInt(cfg.ADAPTIVE_LATENCY, value);}},
+        {LATENCY_MIN_MS,    [](b3Config &cfg, std::string value) {assignInt(cfg.LATENCY_MIN_MS, value);}},
+        {LATENCY_MAX_MS,    [](b3Config &cfg, std::string value) {assignInt(cfg.LATENCY_MAX_MS, value);}},
+        {EVENT_RATE_HZ,     [](b3Config &cfg, std::string value) {assignInt(cfg.EVENT_RATE_HZ, value);}},
         {BUFFER_COUNT,      [](b3Config &cfg, std::string value) {assignInt(cfg.CHUNK_COUNT, value);}},
-        {SEEK_TIME,         [](b3Config &cfg, std::string value) {assignU64(cfg.SEEK_TIME, value);}}
+        {SEEK_TIME,         [](b3Config &cfg, std::string value) {assignU64(cfg.SEEK_TIME, value);}},
+        {FISH_COUNT,        [](b3Config &cfg, std::string value) {assignInt(cfg.FISH_COUNT, value);}},
+        {AUDIO_RT_PRIORITY, [](b3Config &cfg, std::string value) {assignInt(cfg.RT[RT_AUDIO].priority, value);}},
+        {AUDIO_CPUS,        [](b3Config &cfg, std::string value) {cfg.RT[RT_AUDIO].cpuCount = assignList(cfg.RT[RT_AUDIO].cpus, configDefaults::MAX_RT_CPUS, value);}},
+        {GPIO_RT_PRIORITY,  [](b3Config &cfg, std::string value) {assignInt(cfg.RT[RT_GPIO].priority, value);}},
+        {GPIO_CPUS,         [](b3Config &cfg, std::string value) {cfg.RT[RT_GPIO].cpuCount = assignList(cfg.RT[RT_GPIO].cpus, configDefaults::MAX_RT_CPUS, value);}},
+        {LOCK_MEMORY,       [](b3Config &cfg, std::string value) {assignInt(cfg.LOCK_MEMORY, value);}}
     };
+
+    bool g_fishVarsRegistered = [] {
+        for (int fish = 0; fish < configDefaults::MAX_FISH; fish++) {
+            g_configMap[fishKey(FISH_ROUTE, fish)] = [fish](b3Config &cfg, std::string value) {
+                cfg.FISH[fish].routeCount = assignList(cfg.FISH[fish].route, configDefaults::MAX_ROUTE_CHANNELS, value);
+            };
+            g_configMap[fishKey(FISH_PINS, fish)] = [fish](b3Config &cfg, std::string value) {
+                int pins[_fishPinCount];
+                if (assignList(pins, _fishPinCount, value) == _fishPinCount)
+                    memcpy(cfg.FISH[fish].pins, pins, sizeof(pins));
+                else
+                    WARNING("fish%d_pins needs %d pins, ignored", fish, _fishPinCount);
+            };
+            g_configMap[fishKey(FISH_BODY_THRESHOLD, fish)] = [fish](b3Config &cfg, std::string value) {assignInt(cfg.FISH[fish].bodyThreshold, value);};
+            g_configMap[fishKey(FISH_MOUTH_THRESHOLD, fish)] = [fish](b3Config &cfg, std::string value) {assignInt(cfg.FISH[fish].mouthThreshold, value);};
+        }
+        return true;
+    }();
 };
 
 
@@ -83,16 +172,76 @@ void b3::b3Config::poll()
         trimWhiteSpace(key);
         trimWhiteSpace(line);
 
-        if (configVars::g_configMap.count(key) > 0)
+        if (configVars::g_configMap.count(key) == 0)
+            continue;
+
+        // runs on the watcher thread, a malformed value keeps the previous one
+        try {
             configVars::g_configMap[key](*this, value);
+        } catch (const std::exception &e) {
+            trimWhiteSpace(value);
+            WARNING("Invalid value for %s: %s", key, value);
+        }
     }
 
-    BUFFER_LENGTH_MS = CHUNK_COUNT * CHUNK_SIZE_MS;
+    _validate();
 
     fclose(m_configFile);
     m_configFileOpen = false;
 }
 
+int b3::b3Config::set(const char *key, const char *value)
+{
+    if (configVars::g_configMap.count(key) == 0)
+        return -1;
+
+    try {
+        configVars::g_configMap[key](*this, value);
+    } catch (const std::exception &e) {
+        WARNING("Invalid value for %s: %s", key, value);
+        return -1;
+    }
+
+    _validate();
+    return 0;
+}
+
+bool b3::b3Config::hasKey(const char *key)
+{
+    return configVars::g_configMap.count(key) > 0;
+}
+
+void b3::b3Config::_validate()
+{
+    // every queued chunk holds a motor frame until it is heard
+    if (CHUNK_COUNT < 1 || CHUNK_COUNT > frameRingDefaults::MAX_QUEUED_FRAMES) {
+        WARNING("buffer_count %d out of range, using 1-%d", CHUNK_COUNT, frameRingDefaults::MAX_QUEUED_FRAMES);
+        CHUNK_COUNT = CHUNK_COUNT < 1 ? 1 : frameRingDefaults::MAX_QUEUED_FRAMES;
+    }
+
+    BUFFER_LENGTH_MS = CHUNK_COUNT * CHUNK_SIZE_MS;
+
+    if (AUTO_THRESHOLD_PCT < 1 || AUTO_THRESHOLD_PCT > 99) {
+        WARNING("auto_threshold_pct %d out of range, using 1-99", AUTO_THRESHOLD_PCT);
+        AUTO_THRESHOLD_PCT = AUTO_THRESHOLD_PCT < 1 ? 1 : 99;
+    }
+
+    if (LATENCY_MAX_MS < LATENCY_MIN_MS) {
+        WARNING("latency_max_ms %d below latency_min_ms, using %d", LATENCY_MAX_MS, LATENCY_MIN_MS);
+        LATENCY_MAX_MS = LATENCY_MIN_MS;
+    }
+
+    if (EVENT_RATE_HZ < 1 || EVENT_RATE_HZ > eventStreamDefaults::MAX_RATE_HZ) {
+        WARNING("event_rate_hz %d out of range, using 1-%d", EVENT_RATE_HZ, eventStreamDefaults::MAX_RATE_HZ);
+        EVENT_RATE_HZ = EVENT_RATE_HZ < 1 ? 1 : eventStreamDefaults::MAX_RATE_HZ;
+    }
+
+    if (FISH_COUNT < 1 || FISH_COUNT > configDefaults::MAX_FISH) {
+        WARNING("fish_count %d out of range, using 1-%d", FISH_COUNT, configDefaults::MAX_FISH);
+        FISH_COUNT = FISH_COUNT < 1 ? 1 : configDefaults::MAX_FISH;
+    }
+}
+
 void b3::b3Config::printSettings()
 {
     // make sure config file is opened w/ write access
@@ -115,9 +264,43 @@ void b3::b3Config::printSettings()
     printVar(configVars::BUFFER_COUNT, CHUNK_COUNT);
     printVar(configVars::RMS_WINDOW_MS, RMS_WINDOW_MS);
     printVar(configVars::FLIP_INTERVAL_MS, FLIP_INTERVAL_MS);
+    printVar(configVars::HYSTERESIS_PCT, HYSTERESIS_PCT);
+    printVar(configVars::ATTACK_MS, ATTACK_MS);
+    printVar(configVars::RELEASE_MS, RELEASE_MS);
+    printVar(configVars::DUTY_DEADBAND, DUTY_DEADBAND);
+    setComment("Auto threshold: learned thresholds replace body/mouth thresholds and follow a percentile of the envelope");
+    printVar(configVars::AUTO_THRESHOLD, AUTO_THRESHOLD);
+    printVar(configVars::AUTO_THRESHOLD_PCT, AUTO_THRESHOLD_PCT);
+    printVar(configVars::AUTO_THRESHOLD_RATE_PCT, AUTO_THRESHOLD_RATE_PCT);
+    setComment("Batches per second pushed to control socket subscribers");
+    printVar(configVars::EVENT_RATE_HZ, EVENT_RATE_HZ);
+    setComment("Per fish channel weights (empty averages all channels) and thresholds (-1 uses the global thresholds)");
+    for (int fish = 0; fish < FISH_COUNT; fish++) {
+        printList(configVars::fishKey(configVars::FISH_ROUTE, fish).c_str(), FISH[fish].route, FISH[fish].routeCount);
+        printVar(configVars::fishKey(configVars::FISH_BODY_THRESHOLD, fish).c_str(), FISH[fish].bodyThreshold);
+        printVar(configVars::fishKey(configVars::FISH_MOUTH_THRESHOLD, fish).c_str(), FISH[fish].mouthThreshold);
+    }
     setComment("The following parameters are loaded at the beginning of the program and do not update");
     printVar(configVars::CHUNK_SIZE_MS, CHUNK_SIZE_MS);
     printVar(configVars::SEEK_TIME, SEEK_TIME);
+    printVar(configVars::FISH_COUNT, FISH_COUNT);
+    setComment("Resampler profile when the device can't run at the file's rate: 0 fast, 1 balanced, 2 best");
+    printVar(configVars::RESAMPLER_PROFILE, RESAMPLER_PROFILE);
+    setComment("Adaptive device queue depth: grows on underruns, shrinks while processing is fast; buffer_count is the starting depth");
+    printVar(configVars::ADAPTIVE_LATENCY, ADAPTIVE_LATENCY);
+    printVar(configVars::LATENCY_MIN_MS, LATENCY_MIN_MS);
+    printVar(configVars::LATENCY_MAX_MS, LATENCY_MAX_MS);
+    setComment("Real-time policy: SCHED_FIFO priority (0 for SCHED_OTHER) and CPU list (empty for any) per thread");
+    printVar(configVars::AUDIO_RT_PRIORITY, RT[RT_AUDIO].priority);
+    printList(configVars::AUDIO_CPUS, RT[RT_AUDIO].cpus, RT[RT_AUDIO].cpuCount);
+    printVar(configVars::GPIO_RT_PRIORITY, RT[RT_GPIO].priority);
+    printList(configVars::GPIO_CPUS, RT[RT_GPIO].cpus, RT[RT_GPIO].cpuCount);
+    printVar(configVars::LOCK_MEMORY, LOCK_MEMORY);
+    setComment("Fish pins: body A, body B, body PWM, mouth A, mouth B, mouth PWM");
+    for (int fish = 0; fish < FISH_COUNT; fish++) {
+        if (FISH[fish].pins[0] >= 0)
+            printList(configVars::fishKey(configVars::FISH_PINS, fish).c_str(), FISH[fish].pins, _fishPinCount);
+    }
     m_configFileOpen = tmpConfigOpen;
 
     // open file back up in read only
@@ -129,6 +312,26 @@ void b3::b3Config::printSettings()
 }
 
 
+void b3::b3Config::printList(const char *var, const int *values, int count)
+{
+    if (!m_configFileOpen)
+        return;
+    fprintf(m_configFile, "%s=", var);
+    for (int i = 0; i < count; i++)
+        fprintf(m_configFile, i ? ",%d" : "%d", values[i]);
+    fprintf(m_configFile, "\n");
+}
+
+void b3::b3Config::printList(const char *var, const float *values, int count)
+{
+    if (!m_configFileOpen)
+        return;
+    fprintf(m_configFile, "%s=", var);
+    for (int i = 0; i < count; i++)
+        fprintf(m_configFile, i ? ",%f" : "%f", values[i]);
+    fprintf(m_configFile, "\n");
+}
+
 int b3::b3Config::init()
 {
     m_configFile = fopen(configDefaults::DEFAULT_CONFIG_PATH, "r");
@@ -137,8 +340,7 @@ int b3::b3Config::init()
     else
         poll();
 
-    printSettings();
-
+    // the settings are written back by the caller, off the start up path
     return 0;
 }
 
@@ -17,11 +17,75 @@ namespace b3 {
         constexpr float DEFAULT_MOUTH_THRESHOLD = 10000;
         constexpr float DEFAULT_RMS_WINDOW_MS = 250;
         constexpr float DEFAULT_FLIP_INTERVAL_MS = 2000;
+        constexpr int DEFAULT_HYSTERESIS_PCT = 10;
+        constexpr int DEFAULT_ATTACK_MS = 5;
+        constexpr int DEFAULT_RELEASE_MS = 80;
+        constexpr int DEFAULT_DUTY_DEADBAND = 8;
+        constexpr int DEFAULT_AUTO_THRESHOLD = 0;
+        constexpr int DEFAULT_AUTO_THRESHOLD_PCT = 75;
+        constexpr int DEFAULT_AUTO_THRESHOLD_RATE_PCT = 20;
+        constexpr int DEFAULT_RESAMPLER_PROFILE = 1;
+        constexpr int DEFAULT_ADAPTIVE_LATENCY = 1;
+        constexpr int DEFAULT_LATENCY_MIN_MS = 100;
+        constexpr int DEFAULT_LATENCY_MAX_MS = 1000;
+        constexpr int DEFAULT_EVENT_RATE_HZ = 30;
+
+        // multi-fish routing
+        constexpr int MAX_FISH = 4;
+        constexpr int MAX_ROUTE_CHANNELS = 8;
+        constexpr int DEFAULT_FISH_COUNT = 1;
+
+        // real-time policy, priority 0 runs under SCHED_OTHER
+        constexpr int DEFAULT_AUDIO_RT_PRIORITY = 70;
+        constexpr int DEFAULT_GPIO_RT_PRIORITY = 60;
+        constexpr int DEFAULT_LOCK_MEMORY = 1;
+        constexpr int MAX_RT_CPUS = 8;
 
         constexpr int DEFAULT_CONFIG_FILE_NAME_SIZE = 255;
     };
 
 
+    // motor driver pins of one fish, in the order used by fishN_pins
+    enum fishPin {
+        FISH_BODY_A,
+        FISH_BODY_B,
+        FISH_BODY_SPEED,
+        FISH_MOUTH_A,
+        FISH_MOUTH_B,
+        FISH_MOUTH_SPEED,
+
+        _fishPinCount
+    };
+
+    /**
+     * @brief Routing, pin map and thresholds of one fish (motor controller).
+     */
+    struct fishConfig {
+        int pins[_fishPinCount];    // -1 if unassigned (fish 0 then uses the default pins)
+        float route[configDefaults::MAX_ROUTE_CHANNELS];   // weight of each decoded channel
+        int routeCount;             // number of weights in route, 0 averages all channels
+        int bodyThreshold;          // -1 to use BODY_THRESHOLD
+        int mouthThreshold;         // -1 to use MOUTH_THRESHOLD
+    };
+
+    // threads with their own real-time policy
+    enum rtThread {
+        RT_AUDIO,       // decoding, filtering and audio output (main thread)
+        RT_GPIO,        // motor control
+
+        _rtThreadCount
+    };
+
+    /**
+     * @brief Scheduling of one thread, see rtPolicy.
+     */
+    struct rtThreadConfig {
+        int priority;               // SCHED_FIFO priority, 0 for SCHED_OTHER
+        int cpus[configDefaults::MAX_RT_CPUS];  // CPUs the thread may run on
+        int cpuCount;               // number of CPUs in cpus, 0 for any
+    };
+
+
     class b3Config {
     public:
         b3Config() :
@@ -34,9 +98,34 @@ namespace b3 {
             CHUNK_COUNT(signalProcessingDefaults::CHUNK_COUNT),
             RMS_WINDOW_MS(configDefaults::DEFAULT_RMS_WINDOW_MS),
             FLIP_INTERVAL_MS(configDefaults::DEFAULT_FLIP_INTERVAL_MS),
+            HYSTERESIS_PCT(configDefaults::DEFAULT_HYSTERESIS_PCT),
+            ATTACK_MS(configDefaults::DEFAULT_ATTACK_MS),
+            RELEASE_MS(configDefaults::DEFAULT_RELEASE_MS),
+            DUTY_DEADBAND(configDefaults::DEFAULT_DUTY_DEADBAND),
+            AUTO_THRESHOLD(configDefaults::DEFAULT_AUTO_THRESHOLD),
+            AUTO_THRESHOLD_PCT(configDefaults::DEFAULT_AUTO_THRESHOLD_PCT),
+            AUTO_THRESHOLD_RATE_PCT(configDefaults::DEFAULT_AUTO_THRESHOLD_RATE_PCT),
+            RESAMPLER_PROFILE(configDefaults::DEFAULT_RESAMPLER_PROFILE),
+            ADAPTIVE_LATENCY(configDefaults::DEFAULT_ADAPTIVE_LATENCY),
+            LATENCY_MIN_MS(configDefaults::DEFAULT_LATENCY_MIN_MS),
+            LATENCY_MAX_MS(configDefaults::DEFAULT_LATENCY_MAX_MS),
+            EVENT_RATE_HZ(configDefaults::DEFAULT_EVENT_RATE_HZ),
+            FISH_COUNT(configDefaults::DEFAULT_FISH_COUNT),
+            LOCK_MEMORY(configDefaults::DEFAULT_LOCK_MEMORY),
             SEEK_TIME(0),
             m_configFileOpen(false)
         {
+            RT[RT_AUDIO].priority = configDefaults::DEFAULT_AUDIO_RT_PRIORITY;
+            RT[RT_GPIO].priority = configDefaults::DEFAULT_GPIO_RT_PRIORITY;
+            for (int thread = 0; thread < _rtThreadCount; thread++)
+                RT[thread].cpuCount = 0;
+            for (int fish = 0; fish < configDefaults::MAX_FISH; fish++) {
+                for (int pin = 0; pin < _fishPinCount; pin++)
+                    FISH[fish].pins[pin] = -1;
+                FISH[fish].routeCount = 0;
+                FISH[fish].bodyThreshold = -1;
+                FISH[fish].mouthThreshold = -1;
+            }
             init();
         }
         ~b3Config();
@@ -44,6 +133,23 @@ namespace b3 {
         void poll();
         void printSettings();
 
+        /**
+         * @brief Sets one value by its config file key, as if the line was read from the file.
+         * @return 0 on success, -1 if the key is unknown or the value could not be parsed.
+         */
+        int set(const char *key, const char *value);
+
+        /**
+         * @return true if key is a known config file key
+         */
+        static bool hasKey(const char *key);
+
+        /**
+         * @return the body/mouth threshold of a fish, falling back to the global thresholds
+         */
+        inline int bodyThreshold(int fish) const { return FISH[fish].bodyThreshold < 0 ? BODY_THRESHOLD : FISH[fish].bodyThreshold; }
+        inline int mouthThreshold(int fish) const { return FISH[fish].mouthThreshold < 0 ? MOUTH_THRESHOLD : FISH[fish].mouthThreshold; }
+
         float LPF_CUTOFF;
         float HPF_CUTOFF;
         float CHUNK_SIZE_MS;
@@ -53,12 +159,33 @@ namespace b3 {
         int CHUNK_COUNT;
         int RMS_WINDOW_MS;
         int FLIP_INTERVAL_MS;
+        int HYSTERESIS_PCT;     // motors release below threshold * (100 - HYSTERESIS_PCT) / 100
+        int ATTACK_MS;          // envelope time constant while the level rises
+        int RELEASE_MS;         // envelope time constant while the level falls
+        int DUTY_DEADBAND;      // smallest PWM duty change written to a running motor
+        int AUTO_THRESHOLD;     // nonzero: thresholds follow a percentile of each envelope
+        int AUTO_THRESHOLD_PCT; // percentile the learned thresholds follow
+        int AUTO_THRESHOLD_RATE_PCT;    // largest learned threshold change per second, in percent
+        int RESAMPLER_PROFILE;  // 0 fast, 1 balanced, 2 best; only used if the device can't run at the file's rate
+        int ADAPTIVE_LATENCY;   // nonzero: the device queue depth follows the processing time, within the bounds below
+        int LATENCY_MIN_MS;     // smallest device queue depth
+        int LATENCY_MAX_MS;     // largest device queue depth, the device buffer is opened at this size
+        int EVENT_RATE_HZ;      // batches per second sent to control socket subscribers, and envelope event rate
+        int FISH_COUNT;
+        fishConfig FISH[configDefaults::MAX_FISH];
+        rtThreadConfig RT[_rtThreadCount];
+        int LOCK_MEMORY;        // nonzero: lock and pre-fault memory so it never faults during playback
         uint64_t SEEK_TIME;
 
     private:
 
         int init();
 
+        /**
+         * @brief Clamps the values to their valid ranges and updates the derived ones.
+         */
+        void _validate();
+
 #define __printer(method, type, typeStr)                                                    \
         inline void method(const char *var, type value){                                    \
             if (m_configFileOpen)   fprintf(m_configFile, "%s=" typeStr "\n", var, value);  \
@@ -68,6 +195,9 @@ namespace b3 {
         __printer(printVar, float, "%f")
         __printer(printVar, uint64_t, "%lu");
 
+        void printList(const char *var, const int *values, int count);
+        void printList(const char *var, const float *values, int count);
+
         inline void setComment(const char *comment)
         {
             if (m_configFileOpen)   fprintf(m_configFile, "# %s\n", comment);
@@ -0,0 +1,125 @@
+/**
+ * b3stat - prints the live status published by a running b3.
+ *
+ * usage: b3stat [-i <interval ms>] [-n <count>]
+ *
+ *  -i  time between two lines (default 500 ms)
+ *  -n  lines to print before exiting (default: until interrupted)
+ *
+ * The status segment is only read, polling it has no effect on playback.
+ */
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+extern "C" {
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+}
+
+#include "statusLayout.h"
+
+using namespace b3;
+using namespace std;
+
+static const char* stateName(uint32_t state)
+{
+    // b3::State
+    switch (state) {
+    case 0:
+        return "STOPPED";
+    case 1:
+        return "PLAYING";
+    case 2:
+        return "PAUSED";
+    default:
+        return "UNKNOWN";
+    }
+}
+
+static const statusLayout* openStatus()
+{
+    int fd = shm_open(statusDefaults::SHM_NAME, O_RDONLY, 0);
+    if (fd < 0) {
+        fprintf(stderr, "b3 is not running (%s: %s)\n", statusDefaults::SHM_NAME, strerror(errno));
+        return nullptr;
+    }
+
+    void* mem = mmap(nullptr, sizeof(statusLayout), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        fprintf(stderr, "failed to map %s: %s\n", statusDefaults::SHM_NAME, strerror(errno));
+        return nullptr;
+    }
+
+    const statusLayout* layout = (const statusLayout*)mem;
+    if (layout->magic != statusDefaults::MAGIC || layout->version != statusDefaults::VERSION || layout->size != sizeof(statusLayout)) {
+        fprintf(stderr, "%s has an unknown layout (version %u)\n", statusDefaults::SHM_NAME, layout->version);
+        munmap(mem, sizeof(statusLayout));
+        return nullptr;
+    }
+    return layout;
+}
+
+static void printStatus(const statusLayout* layout)
+{
+    statusAudio audio;
+    statusMotors motors;
+
+    if (!seqlockRead(layout->audioSeq, layout->audio, audio) || !seqlockRead(layout->motorSeq, layout->motors, motors)) {
+        printf("status busy\n");
+        return;
+    }
+
+    printf("%-7s %8.2fs %5uHz  queue %u  gpio %u  xruns %llu  dropped %llu  |  chunk %u us (decode %u, mix %u, filter %u, write %u) max %u  |  wake late %u us",
+           stateName(audio.state), audio.positionUs / 1e6, audio.sampleRate,
+           audio.queueChunks, audio.frameQueueDepth,
+           (unsigned long long)audio.xruns, (unsigned long long)audio.framesDropped,
+           audio.chunkUs, audio.decodeUs, audio.mixUs, audio.filterUs, audio.writeUs, audio.maxChunkUs,
+           motors.wakeLateMaxUs);
+
+    for (uint32_t i = 0; i < motors.fishCount && i < (uint32_t)statusDefaults::MAX_FISH; i++) {
+        const statusFish& fish = motors.fish[i];
+        printf("  |  fish%u body %d/%d %3u%s mouth %d/%d %3u%s", i,
+               fish.bodyEnvelope, fish.bodyThreshold, fish.bodyDuty, fish.flags & STATUS_BODY_ACTIVE ? "*" : " ",
+               fish.mouthEnvelope, fish.mouthThreshold, fish.mouthDuty, fish.flags & STATUS_MOUTH_ACTIVE ? "*" : " ");
+    }
+    printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+    int intervalMs = 500;
+    long count = -1;
+
+    for (int i = 1; i < argc; i++) {
+        string arg(argv[i]);
+
+        if (arg == "-i" && i + 1 < argc) {
+            intervalMs = atoi(argv[++i]);
+        } else if (arg == "-n" && i + 1 < argc) {
+            count = atol(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [-i <interval ms>] [-n <count>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    const statusLayout* layout = openStatus();
+    if (!layout) {
+        return 1;
+    }
+
+    for (long n = 0; count < 0 || n < count; n++) {
+        if (n) {
+            usleep(intervalMs * 1000);
+        }
+        printStatus(layout);
+        fflush(stdout);
+    }
+
+    return 0;
+}
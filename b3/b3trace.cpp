@@ -0,0 +1,183 @@
+/**
+ * b3trace - converts GPIO traces recorded with `b3 -gpio-trace <file>`.
+ *
+ * usage: b3trace [-csv | -vcd | -stats] <trace file>
+ *
+ *  -csv    one line per transition: time_us,event,pin,value (default)
+ *  -vcd    value change dump, viewable in GTKWave or similar
+ *  -stats  per-pin transition counts, rates and interval jitter
+ */
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "gpioTrace.h"
+
+using namespace b3;
+using namespace std;
+
+static const char* eventName(uint8_t event)
+{
+    switch (event) {
+    case TRACE_LEVEL:
+        return "level";
+    case TRACE_PWM:
+        return "pwm";
+    case TRACE_MODE:
+        return "mode";
+    default:
+        return "unknown";
+    }
+}
+
+static int readTrace(const char* path, gpioTraceHeader& header, vector<gpioTraceRecord>& records)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "b3trace: cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    if (fread(&header, sizeof(header), 1, f) != 1
+        || memcmp(header.magic, gpioTraceDefaults::MAGIC, sizeof(header.magic)) != 0
+        || header.version != gpioTraceDefaults::VERSION
+        || header.recordSize != sizeof(gpioTraceRecord)) {
+        fprintf(stderr, "b3trace: %s is not a GPIO trace (version %d)\n", path, gpioTraceDefaults::VERSION);
+        fclose(f);
+        return -1;
+    }
+
+    gpioTraceRecord record;
+    while (fread(&record, sizeof(record), 1, f) == 1)
+        records.push_back(record);
+
+    fclose(f);
+    return 0;
+}
+
+static void writeCsv(const gpioTraceHeader& header, const vector<gpioTraceRecord>& records)
+{
+    printf("time_us,event,pin,value\n");
+    for (const gpioTraceRecord& r : records)
+        printf("%llu,%s,%u,%u\n", (unsigned long long)(r.timeUs - header.startUs), eventName(r.event), r.pin, r.value);
+}
+
+static void writeVcd(const gpioTraceHeader& header, const vector<gpioTraceRecord>& records)
+{
+    // one VCD identifier per (pin, kind); PWM pins are 16 bit vectors
+    map<pair<int, int>, string> ids;
+    for (const gpioTraceRecord& r : records) {
+        if (r.event == TRACE_MODE)
+            continue;
+        pair<int, int> key(r.pin, r.event);
+        if (!ids.count(key))
+            ids[key] = string(1, (char)('!' + ids.size()));
+    }
+
+    printf("$timescale 1us $end\n$scope module b3 $end\n");
+    for (auto& id : ids) {
+        if (id.first.second == TRACE_PWM)
+            printf("$var reg 16 %s gpio%d_pwm $end\n", id.second.c_str(), id.first.first);
+        else
+            printf("$var wire 1 %s gpio%d $end\n", id.second.c_str(), id.first.first);
+    }
+    printf("$upscope $end\n$enddefinitions $end\n");
+
+    uint64_t lastTime = UINT64_MAX;
+    for (const gpioTraceRecord& r : records) {
+        if (r.event == TRACE_MODE)
+            continue;
+
+        uint64_t t = r.timeUs - header.startUs;
+        if (t != lastTime) {
+            printf("#%llu\n", (unsigned long long)t);
+            lastTime = t;
+        }
+
+        const string& id = ids[pair<int, int>(r.pin, r.event)];
+        if (r.event == TRACE_PWM) {
+            printf("b");
+            for (int bit = 15; bit >= 0; --bit)
+                putchar((r.value >> bit) & 1 ? '1' : '0');
+            printf(" %s\n", id.c_str());
+        } else {
+            printf("%u%s\n", r.value ? 1 : 0, id.c_str());
+        }
+    }
+}
+
+static void writeStats(const gpioTraceHeader& header, const vector<gpioTraceRecord>& records)
+{
+    struct pinStats {
+        uint64_t count = 0, lastUs = 0;
+        double sum = 0, sumSq = 0, minUs = INFINITY, maxUs = 0;
+    };
+    map<pair<int, int>, pinStats> stats;
+
+    uint64_t durationUs = records.empty() ? 0 : records.back().timeUs - header.startUs;
+    for (const gpioTraceRecord& r : records) {
+        if (r.event == TRACE_MODE)
+            continue;
+
+        pinStats& s = stats[pair<int, int>(r.pin, r.event)];
+        if (s.count > 0) {
+            double dt = r.timeUs - s.lastUs;
+            s.sum += dt;
+            s.sumSq += dt * dt;
+            s.minUs = fmin(s.minUs, dt);
+            s.maxUs = fmax(s.maxUs, dt);
+        }
+        s.lastUs = r.timeUs;
+        s.count++;
+    }
+
+    printf("%zu records over %.3f s\n", records.size(), durationUs / 1e6);
+    printf("%-6s %-6s %10s %10s %12s %12s %12s %12s\n", "pin", "event", "count", "per sec", "min us", "mean us", "max us", "stddev us");
+    for (auto& entry : stats) {
+        const pinStats& s = entry.second;
+        uint64_t intervals = s.count - 1;
+        double mean = intervals ? s.sum / intervals : 0;
+        double stddev = intervals ? sqrt(fmax(s.sumSq / intervals - mean * mean, 0)) : 0;
+
+        printf("%-6d %-6s %10llu %10.1f %12.0f %12.0f %12.0f %12.0f\n",
+               entry.first.first, eventName(entry.first.second), (unsigned long long)s.count,
+               durationUs ? s.count * 1e6 / durationUs : 0,
+               intervals ? s.minUs : 0, mean, s.maxUs, stddev);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char* mode = "-csv";
+    const char* path = nullptr;
+
+    for (int i = 1; i < argc; ++i) {
+        if (argv[i][0] == '-')
+            mode = argv[i];
+        else
+            path = argv[i];
+    }
+
+    if (!path || (strcmp(mode, "-csv") && strcmp(mode, "-vcd") && strcmp(mode, "-stats"))) {
+        fprintf(stderr, "usage: %s [-csv | -vcd | -stats] <trace file>\n", argv[0]);
+        return 1;
+    }
+
+    gpioTraceHeader header;
+    vector<gpioTraceRecord> records;
+    if (readTrace(path, header, records) != 0)
+        return 1;
+
+    if (!strcmp(mode, "-vcd"))
+        writeVcd(header, records);
+    else if (!strcmp(mode, "-stats"))
+        writeStats(header, records);
+    else
+        writeCsv(header, records);
+
+    return 0;
+}
@@ -7,23 +7,42 @@ using namespace b3;
 
 float biQuadFilter::update(float sample)
 {
-    m_x.push_front(sample);
-    while (m_x.size() > FF)
-        m_x.pop_back();
+    m_x[2] = m_x[1];
+    m_x[1] = m_x[0];
+    m_x[0] = sample;
 
+    float y = b[0] * m_x[0] + b[1] * m_x[1] + b[2] * m_x[2]
+            - a[0] * m_y[0] - a[1] * m_y[1];
 
-    float y = 0;
-    for (size_t i = 0; i < m_x.size(); i++)
-        y += m_x[i] * b[i];
-    for (size_t i = 0;i < m_y.size(); i++)
-        y -= m_y[i] * a[i];
-
-    m_y.push_front(y);
-    while (m_y.size() > FB)
-        m_y.pop_back();
+    m_y[1] = m_y[0];
+    m_y[0] = y;
     return y;
 }
 
+void biQuadFilter::process(const float *in, int16_t *out, int count)
+{
+    // keep the state in registers for the whole block
+    float x1 = m_x[0], x2 = m_x[1];
+    float y1 = m_y[0], y2 = m_y[1];
+
+    for (int i = 0; i < count; i++) {
+        float x0 = in[i];
+        float y0 = b[0] * x0 + b[1] * x1 + b[2] * x2 - a[0] * y1 - a[1] * y2;
+
+        x2 = x1;
+        x1 = x0;
+        y2 = y1;
+        y1 = y0;
+
+        out[i] = (int16_t)std::fmin(std::fmax(y0, (float)INT16_MIN), (float)INT16_MAX);
+    }
+
+    m_x[0] = x1;
+    m_x[1] = x2;
+    m_y[0] = y1;
+    m_y[1] = y2;
+}
+
 void biQuadFilter::updateCoeffs()
 {
     /** ref: https://webaudio.github.io/Audio-EQ-Cookbook/audio-eq-cookbook.html
@@ -1,7 +1,6 @@
 #pragma once
 
 #include <cstdint>
-#include <deque>
 #include <cstring>
 
 #include "logger.h"
@@ -23,14 +22,14 @@ namespace b3 {
 
 
         biQuadFilter(float sampleRate, float cutoff, float q, float gain, filterType type) :
-            m_x(biQuadFilter::FF),
-            m_y(biQuadFilter::FB),
             m_sampleRate(sampleRate),
             m_cutoff(cutoff),
             m_q(q),
             m_gain(gain),
             m_filterType(type)
         {
+            memset(m_x, 0, sizeof(m_x));
+            memset(m_y, 0, sizeof(m_y));
             updateCoeffs();
         }
 
@@ -54,6 +53,15 @@ namespace b3 {
         // updates buffers with new sample. Returns filtered sample
         float update(float sample);
 
+        /**
+         * @brief Filters a block of samples.
+         *
+         * @param in input samples
+         * @param out filtered samples, saturated to 16 bits
+         * @param count number of samples
+         */
+        void process(const float *in, int16_t *out, int count);
+
 
 
     private:
@@ -64,8 +72,8 @@ namespace b3 {
         static constexpr uint8_t FB = 2;
 
 
-        std::deque<float> m_x;   // input buffer
-        std::deque<float> m_y;   // output buffer
+        float m_x[FF];   // input history, newest first
+        float m_y[FB];   // output history, newest first
 
 
         float m_sampleRate; // sample rate in Hz
@@ -0,0 +1,85 @@
+#include "configStore.h"
+
+#include <cassert>
+
+#include "logger.h"
+
+using namespace b3;
+using namespace configStoreDefaults;
+
+configStore::configStore(const b3Config &initial) :
+    m_current(new b3Config(initial)),
+    m_epoch(0),
+    m_readerCount(0)
+{
+    for (int i = 0; i < MAX_READERS; i++)
+        m_readerEpochs[i].store(OFFLINE);
+}
+
+configStore::~configStore()
+{
+    for (retiredSnapshot &r : m_retired)
+        delete r.config;
+    delete m_current.load();
+}
+
+int configStore::addReader()
+{
+    if (m_readerCount >= MAX_READERS) {
+        ERROR("No config reader slot left (%d)", MAX_READERS);
+        return -1;
+    }
+    return m_readerCount++;
+}
+
+void configStore::leave(int reader)
+{
+    assert(reader >= 0 && reader < MAX_READERS);
+    m_readerEpochs[reader].store(OFFLINE);
+}
+
+const b3Config *configStore::refresh(int reader)
+{
+    uint64_t epoch;
+
+    assert(reader >= 0 && reader < MAX_READERS);
+
+    // the recorded epoch must be the current one when the snapshot is loaded,
+    // otherwise the writer may have scanned the slot before it was recorded
+    do {
+        epoch = m_epoch.load();
+        m_readerEpochs[reader].store(epoch);
+    } while (m_epoch.load() != epoch);
+
+    return m_current.load();
+}
+
+void configStore::publish(const b3Config &next)
+{
+    const b3Config *previous = m_current.exchange(new b3Config(next));
+
+    // readers which recorded a later epoch can only see the new snapshot
+    m_retired.push_back({ previous, m_epoch.fetch_add(1) });
+    reclaim();
+}
+
+void configStore::reclaim()
+{
+    uint64_t oldest = OFFLINE;
+    // unused slots are OFFLINE, scanning all of them keeps addReader() off the writer's path
+    for (int i = 0; i < MAX_READERS; i++) {
+        uint64_t epoch = m_readerEpochs[i].load();
+        if (epoch < oldest)
+            oldest = epoch;
+    }
+
+    for (size_t i = 0; i < m_retired.size();) {
+        if (m_retired[i].epoch < oldest) {
+            delete m_retired[i].config;
+            m_retired[i] = m_retired.back();
+            m_retired.pop_back();
+        } else {
+            i++;
+        }
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "b3Config.h"
+
+namespace b3 {
+    namespace configStoreDefaults {
+        // threads which may read snapshots at the same time
+        constexpr int MAX_READERS = 4;
+
+        // reader slot value of a reader which holds no snapshot
+        constexpr uint64_t OFFLINE = UINT64_MAX;
+    };
+
+    /**
+     * @brief
+     * Publishes immutable configuration snapshots to reader threads.
+     *
+     * A single writer publishes a new snapshot with an atomic pointer swap.
+     * Readers call refresh() at points where they hold no reference into an
+     * earlier snapshot (e.g. once per chunk or frame) and may use the returned
+     * snapshot until their next refresh(). Each refresh() records the epoch the
+     * reader has seen; a replaced snapshot is freed once every reader moved
+     * past the epoch it was replaced in. Readers never block or allocate.
+     */
+    class configStore {
+    public:
+        /**
+         * @param initial The first snapshot, copied.
+         */
+        configStore(const b3Config &initial);
+        ~configStore();
+
+        /**
+         * @brief Registers a reader. Not thread safe against other addReader() calls.
+         * @return The reader id, or -1 if all reader slots are taken.
+         */
+        int addReader();
+
+        /**
+         * @brief Marks a reader as holding no snapshot until its next refresh(),
+         * so it does not hold back reclamation while it is idle.
+         */
+        void leave(int reader);
+
+        /**
+         * @brief Releases the reader's previous snapshot and returns the current one.
+         *
+         * @param reader The id returned by addReader().
+         * @return The current snapshot, valid until the reader's next refresh() or leave().
+         */
+        const b3Config *refresh(int reader);
+
+        /**
+         * @brief Replaces the current snapshot. Only called from the writer thread.
+         *
+         * @param next The new snapshot, copied.
+         */
+        void publish(const b3Config &next);
+
+        /**
+         * @brief Frees the replaced snapshots no reader can still hold. Only called from the writer thread.
+         */
+        void reclaim();
+
+        /**
+         * @return The current snapshot. Only for the writer thread, readers use refresh().
+         */
+        inline const b3Config *current() const { return m_current.load(); }
+
+        /**
+         * @return The number of snapshots published so far
+         */
+        inline uint64_t epoch() const { return m_epoch.load(); }
+
+    private:
+        struct retiredSnapshot {
+            const b3Config *config;
+            uint64_t epoch;         // epoch the snapshot was replaced in
+        };
+
+        std::atomic<const b3Config *> m_current;
+        std::atomic<uint64_t> m_epoch;
+
+        // epoch each reader has seen, OFFLINE if it holds nothing
+        std::atomic<uint64_t> m_readerEpochs[configStoreDefaults::MAX_READERS];
+        int m_readerCount;
+
+        // writer only
+        std::vector<retiredSnapshot> m_retired;
+    }; // class configStore
+}; // namespace b3
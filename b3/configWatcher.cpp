@@ -0,0 +1,190 @@
+#include "configWatcher.h"
+
+extern "C" {
+#include <limits.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+
+#include "logger.h"
+#include "perfTrace.h"
+#include "metrics.h"
+
+using namespace b3;
+using namespace configWatcherDefaults;
+
+configWatcher::configWatcher(configStore &store, const char *path) :
+    m_store(store),
+    m_path(path),
+    m_thread(nullptr),
+    m_running(false),
+    m_reloadCount(0),
+    m_mtimeNs(0)
+{
+    _mtimeChanged();
+
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakeFd < 0)
+        WARNING("Failed to create eventfd (%s), runtime config changes wait for the next check", strerror(errno));
+}
+
+configWatcher::~configWatcher()
+{
+    if (m_thread)
+        stop();
+    if (m_wakeFd >= 0)
+        close(m_wakeFd);
+}
+
+int configWatcher::set(const char *key, const char *value)
+{
+    if (!b3Config::hasKey(key))
+        return -1;
+
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        m_pending.emplace_back(key, value);
+    }
+
+    uint64_t one = 1;
+    if (m_wakeFd >= 0 && write(m_wakeFd, &one, sizeof(one)) < 0)
+        WARNING("Failed to wake the config watcher: %s", strerror(errno));
+    return 0;
+}
+
+void configWatcher::start()
+{
+    assert(!m_thread);
+
+    m_running = true;
+    m_thread = new std::thread([this]() { _threadMain(); });
+}
+
+void configWatcher::stop()
+{
+    m_running = false;
+
+    uint64_t one = 1;
+    if (m_wakeFd >= 0 && write(m_wakeFd, &one, sizeof(one)) < 0)
+        WARNING("Failed to wake the config watcher: %s", strerror(errno));
+
+    assert(m_thread);
+    m_thread->join();
+    delete m_thread;
+    m_thread = nullptr;
+}
+
+bool configWatcher::_mtimeChanged()
+{
+    struct stat st;
+    int64_t mtimeNs = 0;
+
+    if (stat(m_path.c_str(), &st) == 0)
+        mtimeNs = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+
+    bool changed = mtimeNs != m_mtimeNs;
+    m_mtimeNs = mtimeNs;
+    return changed;
+}
+
+void configWatcher::_reload()
+{
+    b3Config next(*m_store.current());
+    next.poll();
+    m_store.publish(next);
+    m_reloadCount++;
+    DEBUG("Config reloaded (snapshot %llu)", (unsigned long long)m_store.epoch());
+}
+
+void configWatcher::_applyPending()
+{
+    std::vector<std::pair<std::string, std::string>> pending;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        pending.swap(m_pending);
+    }
+    if (pending.empty())
+        return;
+
+    b3Config next(*m_store.current());
+    for (auto &change : pending) {
+        if (next.set(change.first.c_str(), change.second.c_str()) == 0)
+            INFO("Config %s set to %s", change.first.c_str(), change.second.c_str());
+    }
+    m_store.publish(next);
+}
+
+void configWatcher::_threadMain()
+{
+    std::string dir(m_path), name(m_path);
+    size_t slash = dir.rfind('/');
+
+    if (slash == std::string::npos) {
+        dir = ".";
+    } else {
+        name = dir.substr(slash + 1);
+        dir = slash ? dir.substr(0, slash) : "/";
+    }
+
+    pthread_setname_np(pthread_self(), "b3-config");
+    metrics::registerThread();
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd >= 0 && inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+        WARNING("Failed to watch %s (%s), checking its mtime instead", dir.c_str(), strerror(errno));
+        close(fd);
+        fd = -1;
+    }
+
+    while (m_running.load()) {
+        bool changed = false;
+
+        // the file descriptor slot is skipped by poll() while it is negative
+        struct pollfd pfds[2] = { { fd, POLLIN, 0 }, { m_wakeFd, POLLIN, 0 } };
+
+        if (::poll(pfds, 2, WAIT_MS) > 0 && (pfds[1].revents & POLLIN)) {
+            uint64_t count;
+            if (read(m_wakeFd, &count, sizeof(count)) != sizeof(count))
+                WARNING("Failed to read the config watcher eventfd");
+        }
+
+        PERF_SPAN("config poll");
+        _applyPending();
+
+        if (fd >= 0) {
+            if (pfds[0].revents & POLLIN) {
+                alignas(struct inotify_event) char buffer[sizeof(struct inotify_event) + NAME_MAX + 1];
+                ssize_t len;
+
+                // coalesce all pending notifications into one reload
+                while ((len = read(fd, buffer, sizeof(buffer))) > 0) {
+                    for (char *p = buffer; p < buffer + len;) {
+                        struct inotify_event *ev = (struct inotify_event *)p;
+                        if (ev->len && name == ev->name)
+                            changed = true;
+                        p += sizeof(struct inotify_event) + ev->len;
+                    }
+                }
+            }
+        } else {
+            changed = _mtimeChanged();
+        }
+
+        if (changed)
+            _reload();
+
+        // readers move on every chunk, snapshots replaced a while ago are free by now
+        m_store.reclaim();
+    }
+
+    if (fd >= 0)
+        close(fd);
+    metrics::threadDone();
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "configStore.h"
+
+namespace b3 {
+    namespace configWatcherDefaults {
+        // longest wait for a change; also the stat period when the directory can't be watched
+        constexpr int WAIT_MS = 1000;
+    };
+
+    /**
+     * @brief
+     * Reloads the config file on its own thread. Changes are detected through
+     * inotify on the containing directory (so files replaced by editors are
+     * picked up), or by the file's mtime if inotify is not available. Every
+     * reload is parsed into a copy of the current snapshot and published to
+     * the configStore, so the audio and GPIO threads never touch the file.
+     *
+     * Single values set at runtime (see set()) are published by the same
+     * thread, which stays the configStore's only writer. They last until the
+     * file sets the key again and are written to the file at shutdown.
+     */
+    class configWatcher {
+    public:
+        configWatcher(configStore &store, const char *path);
+        ~configWatcher();
+
+        /**
+         * Starts the watcher thread. Termination signals should already be blocked.
+         */
+        void start();
+
+        /**
+         * Stops the watcher thread. Afterwards the caller is the configStore's writer.
+         */
+        void stop();
+
+        /**
+         * @brief Queues a change of one value for the watcher thread, which publishes it
+         * in a new snapshot. Thread safe.
+         *
+         * @param key The config file key.
+         * @param value The value, as written in the config file.
+         * @return 0 if the change was queued, -1 if the key is unknown.
+         */
+        int set(const char *key, const char *value);
+
+        /**
+         * @return The number of reloads published
+         */
+        inline uint64_t reloadCount() const { return m_reloadCount.load(); }
+
+    private:
+        void _threadMain();
+
+        /**
+         * @brief Parses the file into a copy of the current snapshot and publishes it.
+         */
+        void _reload();
+
+        /**
+         * @brief Publishes the changes queued by set() in one snapshot.
+         */
+        void _applyPending();
+
+        /**
+         * @return true if the file's mtime changed since the last call
+         */
+        bool _mtimeChanged();
+
+        configStore &m_store;
+        std::string m_path;
+
+        std::thread *m_thread;
+        std::atomic<bool> m_running;
+        std::atomic<uint64_t> m_reloadCount;
+
+        int64_t m_mtimeNs;
+
+        // changes queued by set(), the eventfd wakes the watcher thread
+        std::mutex m_pendingMutex;
+        std::vector<std::pair<std::string, std::string>> m_pending;
+        int m_wakeFd;
+    }; // class configWatcher
+}; // namespace b3
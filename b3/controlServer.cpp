@@ -0,0 +1,319 @@
+#include "controlServer.h"
+
+extern "C" {
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+}
+
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "logger.h"
+#include "metrics.h"
+
+using namespace b3;
+using namespace controlServerDefaults;
+
+namespace {
+    const char *STATE_NAMES[] = { "stopped", "playing", "paused" };
+
+    /**
+     * @brief Splits the first word off a line, in place.
+     * @return The word; line points at the rest of it afterwards, without surrounding blanks.
+     */
+    char *nextWord(char *&line)
+    {
+        while (isspace((unsigned char)*line))
+            line++;
+        char *word = line;
+        while (*line && !isspace((unsigned char)*line))
+            line++;
+        if (*line)
+            *line++ = '\0';
+        while (isspace((unsigned char)*line))
+            line++;
+
+        // trailing blanks (and the \r of telnet style clients)
+        char *end = line + strlen(line);
+        while (end > line && isspace((unsigned char)end[-1]))
+            *--end = '\0';
+        return word;
+    }
+};
+
+controlServer::controlServer(eventLoop &loop, player &playback, configWatcher &watcher, configStore &configs, eventStream &events) :
+    m_loop(loop),
+    m_player(playback),
+    m_watcher(watcher),
+    m_listenFd(-1),
+    m_events(events),
+    m_configs(configs),
+    m_configReader(configs.addReader()),
+    m_timerFd(-1),
+    m_rateHz(0),
+    m_batch(sizeof(eventBatchHeader) + MAX_BATCH_EVENTS * sizeof(streamEvent))
+{}
+
+controlServer::~controlServer()
+{
+    close();
+}
+
+int controlServer::open(const char *path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        ERROR("Control socket path too long: %s", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    m_listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_listenFd < 0) {
+        ERROR("Failed to create control socket: %s", strerror(errno));
+        return -1;
+    }
+
+    // a socket file nobody accepts on was left by an instance which did not shut down
+    if (connect(m_listenFd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        ERROR("Another instance is listening on %s", path);
+        ::close(m_listenFd);
+        m_listenFd = -1;
+        return -1;
+    }
+    ::close(m_listenFd);
+    unlink(path);
+
+    m_listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_listenFd < 0 ||
+        bind(m_listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(m_listenFd, MAX_CLIENTS) < 0) {
+        ERROR("Failed to open control socket %s: %s", path, strerror(errno));
+        if (m_listenFd >= 0)
+            ::close(m_listenFd);
+        m_listenFd = -1;
+        return -1;
+    }
+
+    // the web server runs as the same user or in its group
+    chmod(path, 0660);
+    m_path = path;
+
+    if (m_loop.addFd(m_listenFd, EPOLLIN, [this](uint32_t) { _accept(); }) != 0) {
+        close();
+        return -1;
+    }
+
+    INFO("Listening for commands on %s", path);
+    return 0;
+}
+
+void controlServer::close()
+{
+    while (!m_clients.empty())
+        _dropClient(m_clients.begin()->first);
+
+    if (m_listenFd >= 0) {
+        m_loop.closeFd(m_listenFd);
+        m_listenFd = -1;
+        unlink(m_path.c_str());
+    }
+}
+
+void controlServer::_accept()
+{
+    int fd;
+    while ((fd = accept4(m_listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        if (m_clients.size() >= MAX_CLIENTS) {
+            WARNING("Too many control clients, refusing one");
+            ::close(fd);
+            continue;
+        }
+        if (m_loop.addFd(fd, EPOLLIN | EPOLLRDHUP, [this, fd](uint32_t) { _read(fd); }) != 0) {
+            ::close(fd);
+            continue;
+        }
+        m_clients[fd] = std::string();
+        DEBUG("Control client %d connected", fd);
+    }
+}
+
+void controlServer::_read(int fd)
+{
+    char buffer[MAX_LINE];
+    ssize_t len;
+
+    while ((len = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        std::string &pending = m_clients[fd];
+        pending.append(buffer, len);
+
+        size_t end;
+        while ((end = pending.find('\n')) != std::string::npos) {
+            // subscribers only receive, anything they send is dropped
+            if (m_subscribers.count(fd)) {
+                pending.clear();
+                break;
+            }
+
+            std::string line = pending.substr(0, end);
+            pending.erase(0, end + 1);
+
+            std::string reply = _execute(fd, &line[0]) + "\n";
+            if (send(fd, reply.data(), reply.size(), MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t)reply.size()) {
+                _dropClient(fd);
+                return;
+            }
+            // quit may have closed the server
+            if (m_clients.count(fd) == 0)
+                return;
+        }
+
+        if (pending.size() > MAX_LINE) {
+            WARNING("Control client %d sent an overlong line", fd);
+            _dropClient(fd);
+            return;
+        }
+    }
+
+    if (len == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+        _dropClient(fd);
+}
+
+void controlServer::_dropClient(int fd)
+{
+    m_loop.closeFd(fd);
+    m_clients.erase(fd);
+    DEBUG("Control client %d disconnected", fd);
+
+    // the last subscriber stops the stream, producers skip their pushes again
+    if (m_subscribers.erase(fd) && m_subscribers.empty()) {
+        m_events.setActive(false);
+        m_loop.closeFd(m_timerFd);
+        m_timerFd = -1;
+        if (m_configReader >= 0)
+            m_configs.leave(m_configReader);
+    }
+}
+
+void controlServer::_subscribe(int fd)
+{
+    m_subscribers.insert(fd);
+    if (m_timerFd >= 0)
+        return;
+
+    m_rateHz = configDefaults::DEFAULT_EVENT_RATE_HZ;
+    if (m_configReader >= 0)
+        m_rateHz = m_configs.refresh(m_configReader)->EVENT_RATE_HZ;
+
+    m_timerFd = m_loop.addTimer(1000000 / m_rateHz, [this](uint64_t) { _sendEvents(); });
+    m_events.setActive(true);
+    DEBUG("Event stream started at %d Hz", m_rateHz);
+}
+
+void controlServer::_sendEvents()
+{
+    // the rate follows the config while the stream runs
+    if (m_configReader >= 0) {
+        int rateHz = m_configs.refresh(m_configReader)->EVENT_RATE_HZ;
+        if (rateHz != m_rateHz && m_loop.setTimer(m_timerFd, 1000000 / rateHz) == 0)
+            m_rateHz = rateHz;
+    }
+
+    eventBatchHeader *header = (eventBatchHeader *)m_batch.data();
+    streamEvent *events = (streamEvent *)(m_batch.data() + sizeof(eventBatchHeader));
+
+    int count = m_events.drain(events, MAX_BATCH_EVENTS);
+    if (count == 0)
+        return;
+
+    header->magic = eventStreamDefaults::MAGIC;
+    header->version = eventStreamDefaults::VERSION;
+    header->count = count;
+    ssize_t size = sizeof(eventBatchHeader) + count * sizeof(streamEvent);
+
+    // a partial batch would break the framing, a subscriber which can't take it all is dropped
+    std::vector<int> slow;
+    for (int fd : m_subscribers) {
+        if (send(fd, m_batch.data(), size, MSG_NOSIGNAL | MSG_DONTWAIT) != size)
+            slow.push_back(fd);
+    }
+    for (int fd : slow) {
+        WARNING("Dropping slow event subscriber %d", fd);
+        _dropClient(fd);
+    }
+}
+
+std::string controlServer::_execute(int fd, char *line)
+{
+    char *arg = line;
+    const char *cmd = nextWord(arg);
+    char reply[MAX_LINE];
+
+    if (!strcmp(cmd, "play")) {
+        if (*arg && m_player.load(arg) != 0)
+            return "err cannot open file";
+        return m_player.play() == 0 ? "ok" : "err nothing to play";
+    }
+    if (!strcmp(cmd, "pause")) {
+        m_player.pause();
+        return "ok";
+    }
+    if (!strcmp(cmd, "stop")) {
+        m_player.stop();
+        return "ok";
+    }
+    if (!strcmp(cmd, "load"))
+        return m_player.load(arg) == 0 ? "ok" : "err cannot open file";
+    if (!strcmp(cmd, "queue"))
+        return m_player.enqueue(arg) == 0 ? "ok" : "err queue full";
+    if (!strcmp(cmd, "next"))
+        return m_player.next() == 0 ? "ok" : "err nothing queued";
+    if (!strcmp(cmd, "clear")) {
+        m_player.clearQueue();
+        return "ok";
+    }
+    if (!strcmp(cmd, "seek")) {
+        char *end;
+        double seconds = strtod(arg, &end);
+        if (end == arg || seconds < 0)
+            return "err bad position";
+        return m_player.seek(seconds * 1e6) == 0 ? "ok" : "err seek failed";
+    }
+    if (!strcmp(cmd, "set")) {
+        const char *key = nextWord(arg);
+        if (!*key || !*arg)
+            return "err usage: set <key> <value>";
+        return m_watcher.set(key, arg) == 0 ? "ok" : "err unknown key";
+    }
+    if (!strcmp(cmd, "status")) {
+        snprintf(reply, sizeof(reply), "ok state=%s position=%.3f queue=%zu file=%s",
+            STATE_NAMES[m_player.state()],
+            m_player.positionUs() / 1e6,
+            m_player.queueLength(),
+            m_player.fileName());
+        return reply;
+    }
+    if (!strcmp(cmd, "stats"))
+        return "ok " + metrics::format();
+    if (!strcmp(cmd, "subscribe")) {
+        _subscribe(fd);
+        snprintf(reply, sizeof(reply), "ok size=%zu rate=%d", sizeof(streamEvent), m_rateHz);
+        return reply;
+    }
+    if (!strcmp(cmd, "quit")) {
+        if (m_onQuit)
+            m_onQuit();
+        return "ok";
+    }
+
+    snprintf(reply, sizeof(reply), "err unknown command %.64s", cmd);
+    return reply;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "configStore.h"
+#include "configWatcher.h"
+#include "eventLoop.h"
+#include "eventStream.h"
+#include "player.h"
+
+namespace b3 {
+    namespace controlServerDefaults {
+        constexpr const char *SOCKET_PATH = "/tmp/b3.sock";
+
+        // longest command line, a client sending a longer one is disconnected
+        constexpr size_t MAX_LINE = 1024;
+
+        // clients connected at the same time
+        constexpr size_t MAX_CLIENTS = 8;
+
+        // most events sent in one batch, enough to empty every ring
+        constexpr int MAX_BATCH_EVENTS = _eventSourceCount * eventStreamDefaults::RING_SIZE + 1;
+    };
+
+    /**
+     * @brief
+     * Controls a running player over a Unix stream socket, so b3 can stay up as
+     * a daemon instead of being restarted for every file.
+     *
+     * The protocol is line based: every command is one line and is answered by
+     * one line, "ok" optionally followed by a result, or "err <reason>".
+     *
+     *     play [file]          resume, or play the file now
+     *     pause
+     *     stop                 stop and close the file, the queue is kept
+     *     load <file>          open the file paused at its start
+     *     queue <file>         play the file after the current one
+     *     next                 skip to the next queued file
+     *     clear                empty the queue
+     *     seek <seconds>       move within the current file
+     *     set <key> <value>    change a config value, as in the config file
+     *     status               "ok state=<s> position=<seconds> queue=<n> file=<path>"
+     *     stats                "ok <metric>=<count>/<p50>/<p99>/<p99.9>/<max> ... cpu_<thread>=<seconds> ...",
+     *                          latencies in us since start up, see metrics.h
+     *     subscribe            "ok size=<event size> rate=<hz>", then binary event batches
+     *     quit                 stop the daemon
+     *
+     * A subscribed connection only carries event batches from then on (see
+     * eventStream.h), event_rate_hz times per second while there are events.
+     * Batches are written without blocking; a subscriber whose socket buffer
+     * cannot take a whole batch is disconnected.
+     *
+     * File names take the rest of the line and are relative to
+     * audioFileDefaults::AUDIO_FILES_PATH unless absolute. Clients are served
+     * from the event loop thread, between audio chunks.
+     */
+    class controlServer {
+    public:
+        /**
+         * @param configs The config snapshots, read for the event rate while there are subscribers.
+         * @param events The stream pushed to subscribers.
+         */
+        controlServer(eventLoop &loop, player &playback, configWatcher &watcher, configStore &configs, eventStream &events);
+        ~controlServer();
+
+        /**
+         * @brief Creates the socket and starts accepting clients. A stale socket file
+         * left by a crashed instance is replaced; a live one is an error.
+         *
+         * @param path The socket path.
+         * @return 0 on success, -1 on failure.
+         */
+        int open(const char *path = controlServerDefaults::SOCKET_PATH);
+
+        /**
+         * @brief Disconnects every client and removes the socket.
+         */
+        void close();
+
+        /**
+         * @brief Sets the handler of the quit command.
+         */
+        inline void setQuitHandler(std::function<void()> h) { m_onQuit = h; }
+
+    private:
+        void _accept();
+
+        /**
+         * @brief Reads what a client sent and executes every complete line.
+         */
+        void _read(int fd);
+
+        void _dropClient(int fd);
+
+        /**
+         * @brief Executes one command line.
+         * @param fd The client which sent it.
+         * @return The reply, without the line end.
+         */
+        std::string _execute(int fd, char *line);
+
+        /**
+         * @brief Turns a client into a subscriber, starting the event stream for the first one.
+         */
+        void _subscribe(int fd);
+
+        /**
+         * @brief Sends the events queued since the last call to every subscriber.
+         */
+        void _sendEvents();
+
+        eventLoop &m_loop;
+        player &m_player;
+        configWatcher &m_watcher;
+
+        int m_listenFd;
+        std::string m_path;
+
+        // partial command line received from each client
+        std::unordered_map<int, std::string> m_clients;
+
+        // event stream, the timer only runs while there are subscribers
+        eventStream &m_events;
+        configStore &m_configs;
+        int m_configReader;
+        std::unordered_set<int> m_subscribers;
+        int m_timerFd;
+        int m_rateHz;
+        std::vector<uint8_t> m_batch;
+
+        std::function<void()> m_onQuit;
+    }; // class controlServer
+}; // namespace b3
@@ -0,0 +1,154 @@
+#include "eventLoop.h"
+
+extern "C" {
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+}
+
+#include <cerrno>
+#include <cstring>
+
+#include "logger.h"
+
+using namespace b3;
+
+eventLoop::~eventLoop()
+{
+    if (m_epollFd >= 0)
+        close(m_epollFd);
+}
+
+int eventLoop::init()
+{
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epollFd < 0) {
+        ERROR("Failed to create epoll instance: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int eventLoop::addFd(int fd, uint32_t events, handler h)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        ERROR("Failed to add fd %d to event loop: %s", fd, strerror(errno));
+        return -1;
+    }
+
+    m_handlers[fd] = h;
+    return 0;
+}
+
+void eventLoop::removeFd(int fd)
+{
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    m_handlers.erase(fd);
+}
+
+void eventLoop::closeFd(int fd)
+{
+    removeFd(fd);
+    close(fd);
+}
+
+int eventLoop::addSignals(std::initializer_list<int> signals, std::function<void(int sig)> h)
+{
+    sigset_t mask;
+    sigemptyset(&mask);
+    for (int sig : signals)
+        sigaddset(&mask, sig);
+
+    int fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0) {
+        ERROR("Failed to create signalfd: %s", strerror(errno));
+        return -1;
+    }
+
+    int ret = addFd(fd, EPOLLIN, [fd, h](uint32_t) {
+        struct signalfd_siginfo info;
+        while (read(fd, &info, sizeof(info)) == sizeof(info))
+            h(info.ssi_signo);
+    });
+
+    if (ret < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int eventLoop::addTimer(uint64_t periodUs, std::function<void(uint64_t expirations)> h)
+{
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        ERROR("Failed to create timerfd: %s", strerror(errno));
+        return -1;
+    }
+
+    if (setTimer(fd, periodUs) < 0 || addFd(fd, EPOLLIN, [fd, h](uint32_t) {
+            uint64_t expirations;
+            if (read(fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+                h(expirations);
+        }) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int eventLoop::setTimer(int timerFd, uint64_t periodUs)
+{
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = periodUs / 1000000;
+    spec.it_interval.tv_nsec = (periodUs % 1000000) * 1000;
+    spec.it_value = spec.it_interval;
+
+    if (timerfd_settime(timerFd, 0, &spec, nullptr) < 0) {
+        ERROR("Failed to arm timer: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int eventLoop::run()
+{
+    struct epoll_event events[eventLoopDefaults::MAX_EVENTS];
+
+    m_running = true;
+    while (m_running) {
+        // with an idle handler the loop only checks for events, it never sleeps
+        int n = epoll_wait(m_epollFd, events, eventLoopDefaults::MAX_EVENTS, m_idle ? 0 : -1);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            ERROR("epoll_wait failed: %s", strerror(errno));
+            return -1;
+        }
+
+        for (int i = 0; i < n && m_running; i++) {
+            // look the handler up again, an earlier handler may have removed it
+            auto it = m_handlers.find(events[i].data.fd);
+            if (it == m_handlers.end())
+                continue;
+
+            // copy, the handler may remove itself
+            handler h = it->second;
+            h(events[i].events);
+        }
+
+        if (m_idle && m_running) {
+            std::function<void()> idle = m_idle;
+            idle();
+        }
+    }
+    return 0;
+}
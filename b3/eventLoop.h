@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <unordered_map>
+
+namespace b3 {
+    namespace eventLoopDefaults {
+        // events handled per epoll_wait call
+        constexpr int MAX_EVENTS = 16;
+    };
+
+    /**
+     * @brief
+     * Single-threaded event loop built on epoll. Every event source is a file
+     * descriptor with a handler: device poll descriptors, sockets, and the
+     * signalfd and timerfd sources created by the helpers below. The
+     * loop sleeps in epoll_wait until one of them is ready.
+     *
+     * Handlers run on the thread calling run() and may add or remove sources.
+     */
+    class eventLoop {
+    public:
+        typedef std::function<void(uint32_t events)> handler;
+
+        eventLoop() : m_epollFd(-1), m_running(false) {}
+        ~eventLoop();
+
+        /**
+         * @brief Creates the epoll instance.
+         * @return 0 on success, -1 on failure.
+         */
+        int init();
+
+        /**
+         * @brief Adds a file descriptor to the loop. The loop does not take ownership.
+         *
+         * @param fd The descriptor to watch.
+         * @param events The epoll events to wait for (EPOLLIN, EPOLLOUT, ...).
+         * @param h Called with the ready events.
+         * @return 0 on success, -1 on failure.
+         */
+        int addFd(int fd, uint32_t events, handler h);
+
+        /**
+         * @brief Removes a file descriptor from the loop.
+         */
+        void removeFd(int fd);
+
+        /**
+         * @brief Delivers signals through a signalfd.
+         *
+         * The signals must already be blocked in every thread (see signalHandler::blockSignals()),
+         * otherwise they are still delivered asynchronously.
+         *
+         * @param signals The signals to handle.
+         * @param h Called with the signal number.
+         * @return The signalfd (owned by the loop), or -1 on failure.
+         */
+        int addSignals(std::initializer_list<int> signals, std::function<void(int sig)> h);
+
+        /**
+         * @brief Creates a periodic timer on CLOCK_MONOTONIC.
+         *
+         * @param periodUs The timer period (us).
+         * @param h Called with the number of expirations since the last call.
+         * @return The timerfd (owned by the loop), or -1 on failure.
+         */
+        int addTimer(uint64_t periodUs, std::function<void(uint64_t expirations)> h);
+
+        /**
+         * @brief Changes the period of a timer created by addTimer().
+         * @return 0 on success, -1 on failure.
+         */
+        int setTimer(int timerFd, uint64_t periodUs);
+
+        /**
+         * @brief Removes and closes a source created by one of the helpers above.
+         */
+        void closeFd(int fd);
+
+        /**
+         * @brief Sets a handler called after every dispatch round, for work which
+         * paces itself by blocking (e.g. a sink without poll descriptors).
+         *
+         * @param h The handler, an empty function to sleep between events again.
+         */
+        inline void setIdle(std::function<void()> h) { m_idle = h; }
+
+        /**
+         * @brief Dispatches events until stop() is called.
+         * @return 0 on success, -1 if epoll_wait failed.
+         */
+        int run();
+
+        /**
+         * @brief Makes run() return after the current dispatch round.
+         */
+        inline void stop() { m_running = false; }
+
+    private:
+        int m_epollFd;
+        bool m_running;
+
+        std::unordered_map<int, handler> m_handlers;
+        std::function<void()> m_idle;
+    }; // class eventLoop
+}; // namespace b3
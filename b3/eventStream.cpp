@@ -0,0 +1,74 @@
+#include "eventStream.h"
+
+using namespace b3;
+using namespace std;
+using namespace eventStreamDefaults;
+
+eventStream::eventStream() :
+    m_rings(new ring[_eventSourceCount]),
+    m_active(false)
+{
+    for (int i = 0; i < _eventSourceCount; i++) {
+        m_rings[i].head.store(0, memory_order_relaxed);
+        m_rings[i].tail.store(0, memory_order_relaxed);
+        m_rings[i].dropped.store(0, memory_order_relaxed);
+    }
+}
+
+bool eventStream::push(eventSource source, const streamEvent &ev)
+{
+    if (!active())
+        return true;
+
+    ring &r = m_rings[source];
+    uint32_t head = r.head.load(memory_order_relaxed);
+
+    if (head - r.tail.load(memory_order_acquire) >= RING_SIZE) {
+        r.dropped.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+
+    r.slots[head & (RING_SIZE - 1)] = ev;
+    r.head.store(head + 1, memory_order_release);
+    return true;
+}
+
+void eventStream::setActive(bool active)
+{
+    // events left over from the last activation are stale, the producers are
+    // idle until the flag is set so the rings can be emptied from here
+    if (active && !m_active.load(memory_order_relaxed)) {
+        for (int i = 0; i < _eventSourceCount; i++) {
+            m_rings[i].tail.store(m_rings[i].head.load(memory_order_acquire), memory_order_release);
+            m_rings[i].dropped.store(0, memory_order_relaxed);
+        }
+    }
+    m_active.store(active, memory_order_release);
+}
+
+int eventStream::drain(streamEvent *out, int maxCount)
+{
+    int count = 0;
+    uint64_t dropped = 0;
+
+    for (int i = 0; i < _eventSourceCount; i++) {
+        ring &r = m_rings[i];
+        uint32_t tail = r.tail.load(memory_order_relaxed);
+        uint32_t head = r.head.load(memory_order_acquire);
+
+        // leave room for the drop report
+        for (; tail != head && count < maxCount - 1; tail++)
+            out[count++] = r.slots[tail & (RING_SIZE - 1)];
+        r.tail.store(tail, memory_order_release);
+
+        dropped += r.dropped.exchange(0, memory_order_relaxed);
+    }
+
+    if (dropped && count < maxCount) {
+        streamEvent &ev = out[count++];
+        ev = streamEvent();
+        ev.type = EVENT_DROPPED;
+        ev.value[0] = (int32_t)dropped;
+    }
+    return count;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+/**
+ * Events pushed to the subscribers of the control socket (see controlServer).
+ *
+ * The audio and GPIO threads each write fixed-size events into their own
+ * single-producer ring; the event loop drains both rings at the configured
+ * rate and sends every subscriber one batch: an eventBatchHeader followed by
+ * header.count events. A producer never blocks or allocates, a full ring
+ * drops the event and the drop is reported in the next batch.
+ *
+ * All fields are naturally aligned and little endian.
+ */
+namespace b3 {
+    namespace eventStreamDefaults {
+        constexpr uint32_t MAGIC = 0x56453342;    // "B3EV"
+        constexpr uint16_t VERSION = 1;
+
+        // events per producer ring (must be a power of two)
+        constexpr uint32_t RING_SIZE = 1024;
+
+        // most batches sent per second, whatever event_rate_hz says
+        constexpr int MAX_RATE_HZ = 1000;
+    };
+
+    enum streamEventType : uint16_t {
+        EVENT_POSITION = 1,     // flags: b3::State, value: position (ms), sample rate (hz), queued chunks
+        EVENT_STATE,            // flags: b3::State, value: position (ms)
+        EVENT_XRUN,             // value: underruns since start, underruns since the last event
+        EVENT_ENVELOPE,         // index: fish, flags: statusFishFlags, value: body envelope, mouth envelope, body duty, mouth duty
+        EVENT_DROPPED,          // value: events lost because a ring was full since the last batch
+    };
+
+    // threads producing events, each one owns a ring
+    enum eventSource {
+        EVENT_SOURCE_AUDIO,
+        EVENT_SOURCE_GPIO,
+
+        _eventSourceCount
+    };
+
+    struct streamEvent {
+        uint64_t timeUs;        // us since epoch (CLOCK_MONOTONIC)
+        uint16_t type;          // streamEventType
+        uint16_t index;
+        uint32_t flags;
+        int32_t value[4];
+    };
+
+    struct eventBatchHeader {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t count;         // events following the header
+    };
+
+    static_assert(sizeof(streamEvent) == 32, "stream event layout changed");
+    static_assert(sizeof(eventBatchHeader) == 8, "event batch header layout changed");
+
+    /**
+     * @brief
+     * The producer rings behind the subscription stream. Events are only
+     * recorded while the stream is active, i.e. while somebody subscribed.
+     */
+    class eventStream {
+    public:
+        eventStream();
+
+        /**
+         * @brief Queues an event. Never blocks; does nothing while the stream is inactive.
+         *
+         * @param source The calling thread's source, one thread per source.
+         * @param ev The event.
+         * @return false if the event was dropped because the ring is full
+         */
+        bool push(eventSource source, const streamEvent &ev);
+
+        /**
+         * @return true while events are recorded
+         */
+        inline bool active() const { return m_active.load(std::memory_order_relaxed); }
+
+        /**
+         * @brief Starts or stops recording events. Events left over from an earlier
+         * activation are discarded. Consumer only.
+         */
+        void setActive(bool active);
+
+        /**
+         * @brief Takes the queued events of every source. Consumer only.
+         *
+         * @param out Receives the events, followed by an EVENT_DROPPED event if any were lost.
+         * @param maxCount The size of out, at least _eventSourceCount * RING_SIZE + 1 to
+         *                 empty the rings in one call.
+         * @return The number of events written to out
+         */
+        int drain(streamEvent *out, int maxCount);
+
+    private:
+        struct ring {
+            alignas(64) std::atomic<uint32_t> head;
+            alignas(64) std::atomic<uint32_t> tail;
+            std::atomic<uint64_t> dropped;
+            streamEvent slots[eventStreamDefaults::RING_SIZE];
+        };
+
+        std::unique_ptr<ring[]> m_rings;
+        std::atomic<bool> m_active;
+    }; // class eventStream
+}; // namespace b3
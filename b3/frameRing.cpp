@@ -0,0 +1,83 @@
+#include "frameRing.h"
+#include "timeManager.h"
+
+#include <cassert>
+
+using namespace b3;
+using namespace std;
+
+frameRing::frameRing(int laneCount, uint32_t maxSamples) :
+    m_laneCount(laneCount),
+    m_maxSamples(maxSamples),
+    m_laneStride(frameRingDefaults::SLOT_COUNT * maxSamples),
+    m_samples(new Sample[laneCount * frameRingDefaults::SLOT_COUNT * maxSamples]()),
+    m_head(0),
+    m_tail(0),
+    m_peak(0),
+    m_dropped(0)
+{
+    assert(laneCount > 0);
+    for (uint32_t i = 0; i < frameRingDefaults::SLOT_COUNT; i++) {
+        m_sampleCounts[i] = 0;
+        m_sampleRates[i] = 0;
+        m_ptsUs[i] = 0;
+    }
+}
+
+bool frameRing::acquire(frame& out)
+{
+    uint32_t head = m_head.load(memory_order_relaxed);
+    uint32_t tail = m_tail.load(memory_order_acquire);
+
+    if (head - tail >= frameRingDefaults::SLOT_COUNT)
+        return false;
+
+    _view(head, out);
+    out.nSamples = m_maxSamples;
+    return true;
+}
+
+void frameRing::publish(int nSamples, uint32_t sampleRate, uint64_t ptsUs)
+{
+    assert(nSamples >= 0 && (uint32_t)nSamples <= m_maxSamples);
+    assert(sampleRate > 0);
+
+    uint32_t head = m_head.load(memory_order_relaxed);
+    m_sampleCounts[head & (frameRingDefaults::SLOT_COUNT - 1)] = nSamples;
+    m_sampleRates[head & (frameRingDefaults::SLOT_COUNT - 1)] = sampleRate;
+    m_ptsUs[head & (frameRingDefaults::SLOT_COUNT - 1)] = ptsUs;
+    m_publishedUs[head & (frameRingDefaults::SLOT_COUNT - 1)] = timeManager::getUsSinceEpoch();
+    m_head.store(head + 1, memory_order_release);
+
+    uint32_t depth = head + 1 - m_tail.load(memory_order_relaxed);
+    if (depth > m_peak.load(memory_order_relaxed))
+        m_peak.store(depth, memory_order_relaxed);
+}
+
+bool frameRing::peek(uint32_t offset, frame& out) const
+{
+    uint32_t tail = m_tail.load(memory_order_relaxed);
+    uint32_t head = m_head.load(memory_order_acquire);
+
+    if (head - tail <= offset)
+        return false;
+
+    _view(tail + offset, out);
+    return true;
+}
+
+void frameRing::release()
+{
+    uint32_t tail = m_tail.load(memory_order_relaxed);
+    assert(m_head.load(memory_order_relaxed) != tail);
+    m_tail.store(tail + 1, memory_order_release);
+}
+
+void frameRing::releaseUntil(uint32_t index)
+{
+    uint32_t tail = m_tail.load(memory_order_relaxed);
+
+    // already released frames are skipped, indices wrap
+    if ((int32_t)(index - tail) > 0)
+        m_tail.store(index, memory_order_release);
+}
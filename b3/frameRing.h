@@ -0,0 +1,167 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace b3 {
+
+namespace frameRingDefaults {
+    // Number of preallocated frame slots (must be a power of two)
+    constexpr uint32_t SLOT_COUNT = 16;
+
+    // Frames which can be queued ahead of the consumer: one slot keeps the
+    // frame played before the current one and one is being filled
+    constexpr int MAX_QUEUED_FRAMES = SLOT_COUNT - 2;
+
+    // Maximum samples per lane in a single frame. The lanes carry envelope
+    // bins at about 1 kHz, which covers chunks of up to about 240 ms
+    constexpr uint32_t MAX_FRAME_SAMPLES = 256;
+
+    // Destructive interference size, used to keep the indices on separate lines
+    constexpr int CACHE_LINE_SIZE = 64;
+} // namespace frameRingDefaults
+
+/**
+ * Fixed-capacity single-producer/single-consumer ring of preallocated frames.
+ *
+ * Sample storage is laid out as struct-of-arrays: every lane (e.g. LPF, HPF)
+ * owns one contiguous block holding that lane for all slots. The producer
+ * fills a slot in place and publishes it with a release store; the consumer
+ * reads published slots in place and hands them back with release(). Neither
+ * side allocates or locks.
+ */
+class frameRing {
+   public:
+    typedef int16_t Sample;
+
+    /**
+     * A view of one slot in the ring. Lanes are addressed by index.
+     */
+    struct frame {
+        frame() : base(nullptr), laneStride(0), nSamples(0), sampleRate(0), ptsUs(0), publishedUs(0) {}
+
+        inline Sample* lane(int ndx) const { return base + ndx * laneStride; }
+        inline bool valid() const { return base != nullptr; }
+
+        Sample* base;
+        uint32_t laneStride;
+        int nSamples;
+        uint32_t sampleRate;    // rate the samples were produced at (Hz)
+        uint64_t ptsUs;     // presentation time of the first sample, 0 if unknown
+        uint64_t publishedUs;   // time the frame was published (us since epoch)
+    };
+
+    /**
+     * @param laneCount The number of sample lanes stored per frame.
+     * @param maxSamples The maximum number of samples per lane.
+     */
+    frameRing(int laneCount, uint32_t maxSamples = frameRingDefaults::MAX_FRAME_SAMPLES);
+
+    // producer side
+
+    /**
+     * @brief Gets the next free slot for writing. Producer only.
+     *
+     * @param out Receives a view of the free slot.
+     * @return true if a slot is available, false if the ring is full.
+     */
+    bool acquire(frame& out);
+
+    /**
+     * @brief Publishes the slot returned by the last acquire(). Producer only.
+     *
+     * @param nSamples The number of samples written to each lane.
+     * @param sampleRate The sample rate of the lanes (Hz).
+     * @param ptsUs The presentation time of the first sample (us since epoch), 0 if unknown.
+     */
+    void publish(int nSamples, uint32_t sampleRate, uint64_t ptsUs);
+
+    /**
+     * @brief Records a frame which could not be queued. Producer only.
+     */
+    inline void drop() { m_dropped.store(m_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+
+    /**
+     * @return the index the next published frame gets. Producer only.
+     */
+    inline uint32_t published() const { return m_head.load(std::memory_order_relaxed); }
+
+    // consumer side
+
+    /**
+     * @brief Gets a published frame without removing it. Consumer only.
+     *
+     * @param offset The distance from the oldest unreleased frame.
+     * @param out Receives a view of the frame.
+     * @return true if the frame exists, false otherwise.
+     */
+    bool peek(uint32_t offset, frame& out) const;
+
+    /**
+     * @brief Returns the oldest unreleased frame to the producer. Consumer only.
+     */
+    void release();
+
+    /**
+     * @brief Returns every frame published before an index to the producer. Consumer only.
+     *
+     * @param index A value of published(), frames from there on are kept.
+     */
+    void releaseUntil(uint32_t index);
+
+    // metrics
+
+    /**
+     * @return number of published frames not yet released. Safe from any thread.
+     */
+    inline uint32_t occupancy() const
+    {
+        return m_head.load(std::memory_order_relaxed) - m_tail.load(std::memory_order_relaxed);
+    }
+
+    inline int laneCount() const { return m_laneCount; }
+    inline uint32_t capacity() const { return frameRingDefaults::SLOT_COUNT; }
+    inline uint32_t maxSamples() const { return m_maxSamples; }
+    inline uint32_t peakOccupancy() const { return m_peak.load(std::memory_order_relaxed); }
+    inline uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Resets the peak occupancy metric.
+     */
+    inline void resetPeak() { m_peak.store(occupancy(), std::memory_order_relaxed); }
+
+   private:
+    static_assert((frameRingDefaults::SLOT_COUNT & (frameRingDefaults::SLOT_COUNT - 1)) == 0,
+                  "frame ring slot count must be a power of two");
+
+    inline void _view(uint32_t index, frame& out) const
+    {
+        uint32_t slot = index & (frameRingDefaults::SLOT_COUNT - 1);
+        out.base = m_samples.get() + slot * m_maxSamples;
+        out.laneStride = m_laneStride;
+        out.nSamples = m_sampleCounts[slot];
+        out.sampleRate = m_sampleRates[slot];
+        out.ptsUs = m_ptsUs[slot];
+        out.publishedUs = m_publishedUs[slot];
+    }
+
+    const int m_laneCount;
+    const uint32_t m_maxSamples;
+    const uint32_t m_laneStride;
+
+    // [lane][slot][sample]
+    std::unique_ptr<Sample[]> m_samples;
+    int m_sampleCounts[frameRingDefaults::SLOT_COUNT];
+    uint32_t m_sampleRates[frameRingDefaults::SLOT_COUNT];
+    uint64_t m_ptsUs[frameRingDefaults::SLOT_COUNT];
+    uint64_t m_publishedUs[frameRingDefaults::SLOT_COUNT];
+
+    alignas(frameRingDefaults::CACHE_LINE_SIZE) std::atomic<uint32_t> m_head;
+    alignas(frameRingDefaults::CACHE_LINE_SIZE) std::atomic<uint32_t> m_tail;
+
+    alignas(frameRingDefaults::CACHE_LINE_SIZE) std::atomic<uint32_t> m_peak;
+    std::atomic<uint64_t> m_dropped;
+}; // class frameRing
+
+} // namespace b3
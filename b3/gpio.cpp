@@ -3,11 +3,12 @@
 #include "logger.h"
 #include "timeManager.h"
 #include "sighandler.h"
+#include "rtPolicy.h"
+#include "startupTrace.h"
+#include "perfTrace.h"
+#include "metrics.h"
 
-#ifdef ENABLE_GPIO
-#include <pigpio.h>
-#endif
-
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
 #include <cmath>
@@ -16,7 +17,7 @@
 #include <functional>
 
 extern "C" {
-#include <signal.h>
+#include <unistd.h>
 }
 
 using namespace b3;
@@ -26,10 +27,53 @@ using namespace std;
 // Service instance
 static GPIO* g_gpioService;
 
-GPIO::GPIO(b3Config* config) : m_config(config),
+GPIO::GPIO(configStore* configs, gpioBackend* backend) : m_configs(configs),
+                               m_configReader(configs->addReader()),
+                               m_config(configs->refresh(m_configReader)),
+                               m_backend(backend),
+                               m_frameRing(m_config->FISH_COUNT * gpio::_laneCount),
+                               m_paused(false),
+                               m_pausedUs(0),
+                               m_pauseStartUs(0),
+                               m_appliedPauseUs(0),
+                               m_flushPending(false),
+                               m_flushIndex(0),
                                m_thread(nullptr),
                                m_running(false),
-                               m_pinWriteCount(0) {
+                               m_pinWriteCount(0),
+                               m_controllerCount(0),
+                               m_indexLoaded(false),
+                               m_songPending(false),
+                               m_status(nullptr),
+                               m_events(nullptr),
+                               m_lastEventUs(0),
+                               m_pinLevels(0),
+                               m_directionPinMask(0) {
+    for (int f = 0; f < m_config->FISH_COUNT; ++f) {
+        const int* pins = m_config->FISH[f].pins;
+
+        // the first fish keeps the original wiring unless told otherwise
+        if (f == 0 && pins[0] < 0) {
+            pins = motorDefaults::DEFAULT_PINS;
+        }
+
+        motorController& controller = m_controllers[m_controllerCount];
+        if (controller.setup(f, pins)) {
+            WARNING("Fish %d will not be driven", f);
+            continue;
+        }
+
+        if (m_directionPinMask & controller.directionMask()) {
+            ERROR("Fish %d shares direction pins with another fish, not driving it", f);
+            continue;
+        }
+
+        m_directionPinMask |= controller.directionMask();
+        ++m_controllerCount;
+    }
+
+    INFO("GPIO driving %d of %d fish", m_controllerCount, m_config->FISH_COUNT);
+
     assert(!g_gpioService);
     g_gpioService = this;
     m_lastDebugUs = timeManager::getUsSinceEpoch();
@@ -38,14 +82,17 @@ GPIO::GPIO(b3Config* config) : m_config(config),
 GPIO::~GPIO() {
     assert(g_gpioService);
     g_gpioService = nullptr;
+
+    delete m_backend;
 }
 
-void GPIO::start(void (*sigintHandler)(int)) {
+void GPIO::start() {
     assert(!m_thread);
 
     m_running = true;
     m_thread = new thread([=]() {
-        int ret = _threadMain(sigintHandler);
+        int ret = _threadMain();
+        metrics::threadDone();
 
         const char* fmt = "GPIO thread terminated with status %d";
         if (ret) {
@@ -65,165 +112,349 @@ void GPIO::stop() {
     DEBUG("Joined GPIO thread");
 
     delete m_thread;
+    m_thread = nullptr;
 }
 
-void GPIO::submitFrame(defaults::Sample* lpf, defaults::Sample* hpf, int n_samples) {
+bool GPIO::acquireFrame(frameRing::frame& out) {
     assert(g_gpioService);
+    return g_gpioService->m_frameRing.acquire(out);
+}
 
-    lock_guard<mutex> lock(g_gpioService->m_frameQueueMutex);
-    g_gpioService->m_frameQueue.emplace(lpf, hpf, n_samples);
+void GPIO::publishFrame(int n_samples, uint32_t sampleRate, uint64_t ptsUs) {
+    assert(g_gpioService);
+    if (ptsUs) {
+        ptsUs -= g_gpioService->m_pausedUs.load(memory_order_relaxed);
+    }
+    g_gpioService->m_frameRing.publish(n_samples, sampleRate, ptsUs);
 
-    //DEBUG("Submitted at %.2f, queue=%d", (float) timeManager::getUsSinceEpoch() / 1000000.0f, g_gpioService->m_frameQueue.size());
+    //DEBUG("Submitted at %.2f, queue=%u", (float) timeManager::getUsSinceEpoch() / 1000000.0f, g_gpioService->m_frameRing.occupancy());
 }
 
-int GPIO::_threadMain(void (*sigintHandler)(int)) {
-    bool timingReset = false;
+void GPIO::flush() {
+    assert(g_gpioService);
+    g_gpioService->m_flushIndex.store(g_gpioService->m_frameRing.published(), memory_order_relaxed);
+    g_gpioService->m_flushPending.store(true, memory_order_release);
+}
 
-    m_gpioInitialized = false;
+void GPIO::setPaused(bool paused) {
+    assert(g_gpioService);
+    GPIO* service = g_gpioService;
 
-#ifdef ENABLE_GPIO
-    m_gpioInitialized = true;
+    if (paused == service->m_paused.load(memory_order_relaxed)) {
+        return;
+    }
 
-    // Set up pins
-    if (gpioInitialise() < 0) {
-        ERROR("Failed to initialize GPIO: %s", strerror(errno));
-        m_gpioInitialized = false;
+    // the pause total is only written here, and is visible once the flag drops
+    uint64_t now = timeManager::getUsSinceEpoch();
+    if (paused) {
+        service->m_pauseStartUs = now;
+    } else {
+        service->m_pausedUs.store(service->m_pausedUs.load(memory_order_relaxed) + now - service->m_pauseStartUs,
+                                  memory_order_relaxed);
     }
+    service->m_paused.store(paused, memory_order_release);
+}
 
-    if (m_gpioInitialized) {
-        uint8_t fail = _enumPins([](int pin) -> uint8_t {
-            if (gpioSetMode(pin, PI_OUTPUT) < 0) {
-                ERROR("Failed to set pin %d mode: %s", pin, strerror(errno));
-                return 1;
+void GPIO::dropFrame() {
+    assert(g_gpioService);
+    g_gpioService->m_frameRing.drop();
+}
+
+uint32_t GPIO::frameQueueDepth() {
+    return g_gpioService ? g_gpioService->m_frameRing.occupancy() : 0;
+}
+
+uint64_t GPIO::droppedFrames() {
+    return g_gpioService ? g_gpioService->m_frameRing.dropped() : 0;
+}
+
+void GPIO::changeSong(const string& song) {
+    if (!m_indexLoaded) {
+        m_thresholdIndex.load();
+        m_indexLoaded = true;
+    }
+
+    songThresholds finished;
+    {
+        lock_guard<mutex> lock(m_songMutex);
+        finished = m_finishedSong;
+        m_finishedSong.song.clear();
+
+        m_nextSong.song = song;
+        for (int i = 0; i < m_controllerCount; ++i) {
+            m_nextSong.body[i] = m_nextSong.mouth[i] = 0;
+            if (m_thresholdIndex.lookup(song, m_controllers[i].fish(), m_nextSong.body[i], m_nextSong.mouth[i])) {
+                INFO("Fish %d thresholds seeded from index [%d %d]", m_controllers[i].fish(), m_nextSong.body[i], m_nextSong.mouth[i]);
             }
+        }
+    }
+    m_songPending.store(true, memory_order_release);
+
+    // the index is written outside the lock, the GPIO thread may wait on it
+    if (!finished.song.empty() && m_configs->current()->AUTO_THRESHOLD) {
+        _indexThresholds(finished);
+        m_thresholdIndex.save();
+    }
+}
 
-            return 0;
-        });
+void GPIO::storeThresholds() {
+    assert(!m_thread);
+
+    // without a song played the index was never read, there is nothing to add to it
+    if (!m_config->AUTO_THRESHOLD || !m_indexLoaded) {
+        return;
+    }
+
+    // the song handed back last and the one playing at the end
+    if (!m_finishedSong.song.empty()) {
+        _indexThresholds(m_finishedSong);
+    }
 
-        if (fail) {
-            m_gpioInitialized = false;
+    songThresholds current;
+    current.song = m_currentSong;
+    _learnedThresholds(current);
+    if (!current.song.empty()) {
+        _indexThresholds(current);
+    }
+
+    m_thresholdIndex.save();
+}
+
+void GPIO::_applySongChange() {
+    if (!m_songPending.exchange(false, memory_order_acquire)) {
+        return;
+    }
+
+    lock_guard<mutex> lock(m_songMutex);
+    if (!m_currentSong.empty()) {
+        m_finishedSong.song = m_currentSong;
+        _learnedThresholds(m_finishedSong);
+    }
+
+    m_currentSong = m_nextSong.song;
+    for (int i = 0; i < m_controllerCount; ++i) {
+        if (m_nextSong.body[i] > 0) {
+            m_controllers[i].seedThresholds(m_nextSong.body[i], m_nextSong.mouth[i]);
         }
     }
+}
 
-    _flushPins();
-#else
-    WARNING("GPIO disabled, using mock mode");
-#endif
+void GPIO::_learnedThresholds(songThresholds& out) const {
+    for (int i = 0; i < m_controllerCount; ++i) {
+        out.body[i] = m_controllers[i].learnedBodyThreshold();
+        out.mouth[i] = m_controllers[i].learnedMouthThreshold();
+    }
+}
 
-    // Install signal handler
-    struct sigaction sa;
-    memset(&sa, 0, sizeof(sa));
-    sa.sa_handler = sigintHandler;
+void GPIO::_indexThresholds(const songThresholds& learned) {
+    for (int i = 0; i < m_controllerCount; ++i) {
+        if (learned.body[i] > 0) {
+            m_thresholdIndex.store(learned.song, m_controllers[i].fish(), learned.body[i], learned.mouth[i]);
+        }
+    }
+}
+
+int GPIO::_threadMain() {
+    bool timingReset = false;
+
+    rtPolicy::applyThread("b3-gpio", m_config->RT[RT_GPIO]);
+    metrics::registerThread();
+
+    m_gpioInitialized = false;
+
+    int tracePhase = startupTrace::begin("gpio init");
+
+    if (m_backend) {
+        // Set up pins
+        m_gpioInitialized = m_backend->init() == 0;
+
+        if (m_gpioInitialized) {
+            uint8_t fail = _enumPins([this](int pin) -> uint8_t {
+                return m_backend->setOutput(pin) ? 1 : 0;
+            });
 
-    //signal(SIGINT, sigintHandler);
+            if (fail) {
+                m_backend->terminate();
+                m_gpioInitialized = false;
+            }
+        }
+
+        if (m_gpioInitialized) {
+            INFO("GPIO using %s backend", m_backend->name());
+        }
 
-    if (sigaction(SIGINT, &sa, NULL) < 0) {
-        ERROR("Failed installing SIGINT handler: %s", strerror(errno));
-        return errno;
+        _flushPins();
+    } else {
+        WARNING("GPIO disabled, using mock mode");
     }
 
     _flushPins();
+    startupTrace::end(tracePhase);
 
     INFO("GPIO ready for frames");
     m_currentFrameStartUs = timeManager::getUsSinceEpoch();
 
     while (m_running.load() && !signalHandler::g_shouldExit) {
-        // Pull frame from queue, or reset timing if empty
-        Frame currentFrame;
-        {
-            lock_guard<mutex> lock(m_frameQueueMutex);
-
-            if (m_frameQueue.empty()) {
-                m_currentFrameStartUs = timeManager::getUsSinceEpoch();
-
-                if (!timingReset) {
-                    WARNING("GPIO ran out of frames, timing reset");
-                    timingReset = true;
-                }
-
+        // the previous snapshot is not referenced past this point
+        m_config = m_configs->refresh(m_configReader);
+
+        _applyFlush();
+        _applySongChange();
+
+        // Pull frame from the ring, or reset timing if empty. The previous
+        // frame stays in the ring until the current one is done with it.
+        frameRing::frame currentFrame;
+        if (!m_frameRing.peek(m_previousFrame.valid() ? 1 : 0, currentFrame)) {
+            if (m_paused.load(memory_order_acquire)) {
+                _holdWhilePaused();
                 continue;
             }
 
-            currentFrame = std::move(m_frameQueue.front());
-            m_frameQueue.pop();
+            m_currentFrameStartUs = timeManager::getUsSinceEpoch();
 
-            if (timingReset) {
-                INFO("GPIO resuming stream (%d buf)", m_frameQueue.size());
-                timingReset = false;
+            if (!timingReset) {
+                WARNING("GPIO ran out of frames, timing reset");
+                timingReset = true;
             }
+
+            // don't spin while the audio thread is idle
+            systemClock::sleepUs(defaults::MAX_WAIT_US);
+            continue;
         }
 
-        assert(currentFrame.lpf.size() == currentFrame.hpf.size());
+        if (timingReset) {
+            INFO("GPIO resuming stream (%u buf)", m_frameRing.occupancy());
+            timingReset = false;
+        }
 
-        _processFrame(currentFrame);
-        m_previousFrame = std::move(currentFrame);
+        if (!_processFrame(currentFrame)) {
+            continue;
+        }
+
+        if (m_previousFrame.valid()) {
+            m_frameRing.release();
+        }
+        m_previousFrame = currentFrame;
 
         uint64_t now = timeManager::getUsSinceEpoch();
         if (now - m_lastDebugUs > defaults::DEBUG_INTERVAL_S * 1000000) {
-            INFO("%d GPIO writes/s, thresholds [%d %d]",
+            int bodyThreshold = m_config->BODY_THRESHOLD, mouthThreshold = m_config->MOUTH_THRESHOLD;
+
+            if (m_config->AUTO_THRESHOLD && m_controllerCount > 0) {
+                bodyThreshold = m_controllers[0].learnedBodyThreshold();
+                mouthThreshold = m_controllers[0].learnedMouthThreshold();
+            }
+
+            INFO("%d GPIO writes/s, thresholds [%d %d]%s, frames %u/%u (peak %u, dropped %llu), wake late %llu/%llu us",
                  m_pinWriteCount / defaults::DEBUG_INTERVAL_S,
-                 m_config->BODY_THRESHOLD, m_config->MOUTH_THRESHOLD);
+                 bodyThreshold, mouthThreshold, m_config->AUTO_THRESHOLD ? " (auto)" : "",
+                 m_frameRing.occupancy(), m_frameRing.capacity(),
+                 m_frameRing.peakOccupancy(), (unsigned long long) m_frameRing.dropped(),
+                 (unsigned long long) m_wakeups.meanUs(), (unsigned long long) m_wakeups.maxUs);
 
             m_lastDebugUs = now;
             m_pinWriteCount = 0;
+            m_frameRing.resetPeak();
+            m_wakeups.reset();
         }
     }
 
     _flushPins();
 
-    #ifdef ENABLE_GPIO
-        if (m_gpioInitialized) {
-            gpioTerminate();
-        }
-    #endif
+    if (m_gpioInitialized) {
+        m_backend->terminate();
+    }
 
     return 0;
 }
 
-void GPIO::_processFrame(const Frame& frame) {
+bool GPIO::_processFrame(const frameRing::frame& frame) {
     bool skippedFrame = true;
-    int rmsLpf = 0, rmsHpf = 0;
+    int rmsLpf[configDefaults::MAX_FISH], rmsHpf[configDefaults::MAX_FISH];
 
-    m_currentFrameStartUs = timeManager::getUsSinceEpoch();
+    metrics::record(METRIC_FRAME_WAIT, timeManager::getUsSinceEpoch() - frame.publishedUs);
+
+    // schedule against the time the frame is actually heard, not when it was dequeued
+    m_appliedPauseUs = m_pausedUs.load(memory_order_relaxed);
+    m_currentFrameStartUs = frame.ptsUs ? frame.ptsUs + m_appliedPauseUs : timeManager::getUsSinceEpoch();
 
+    for (uint64_t now = timeManager::getUsSinceEpoch();
+         now < m_currentFrameStartUs && m_running.load() && !signalHandler::g_shouldExit;
+         now = timeManager::getUsSinceEpoch()) {
+        m_wakeups.add(rtPolicy::sleepUntilUs(min<uint64_t>(m_currentFrameStartUs, now + defaults::MAX_WAIT_US)));
+        _holdWhilePaused();
+        if (_applyFlush()) {
+            return false;
+        }
+    }
+
+    uint64_t nextTickUs = timeManager::getUsSinceEpoch();
 
     while (!signalHandler::g_shouldExit) {
+        _holdWhilePaused();
+        if (_applyFlush()) {
+            return false;
+        }
+
         uint64_t now = timeManager::getUsSinceEpoch();
 
         //DEBUG("frame us %d", now - m_currentFrameStartUs);
 
-        rmsLpf = _computeRMS(now, frame, true);
-        rmsHpf = _computeRMS(now, frame, false);
+        {
+            PERF_SPAN("gpio tick");
+            bool frameDone = false;
+
+            for (int i = 0; i < m_controllerCount && !frameDone; ++i) {
+                int fish = m_controllers[i].fish();
+
+                rmsLpf[i] = _computeRMS(now, frame, gpio::laneIndex(fish, gpio::LANE_LPF));
+                rmsHpf[i] = _computeRMS(now, frame, gpio::laneIndex(fish, gpio::LANE_HPF));
+
+                frameDone = rmsLpf[i] < 0 || rmsHpf[i] < 0;
+            }
 
-        if (rmsLpf < 0 || rmsHpf < 0) {
-            break;
+            // with no fish to drive, still pace through the frame
+            if (frameDone || (m_controllerCount == 0 && _computeRMS(now, frame, 0) < 0)) {
+                break;
+            }
+
+            _writeGPIO(now, rmsLpf, rmsHpf);
+            skippedFrame = false;
         }
 
-        _writeGPIO(rmsLpf, rmsHpf);
-        skippedFrame = false;
+        // ticks missed while preempted are skipped, not caught up
+        nextTickUs += defaults::CONTROL_TICK_US;
+        if (nextTickUs <= now) {
+            nextTickUs = now + defaults::CONTROL_TICK_US;
+        }
+        uint64_t lateUs = rtPolicy::sleepUntilUs(nextTickUs);
+        m_wakeups.add(lateUs);
+        metrics::record(METRIC_GPIO_JITTER, lateUs);
     }
 
     if (skippedFrame) {
         WARNING("GPIO skipped frame");
     }
 
-    m_currentFrameStartUs += frame.lpf.size() * 1000000 / defaults::SAMPLE_RATE;
+    m_currentFrameStartUs += (uint64_t) frame.nSamples * 1000000 / frame.sampleRate;
+    return true;
 }
 
-int GPIO::_computeRMS(uint64_t now, const Frame& frame, bool lpf) {
+int GPIO::_computeRMS(uint64_t now, const frameRing::frame& frame, int lane) {
     int cursor =
-        (now - m_currentFrameStartUs) * defaults::SAMPLE_RATE / 1000000;
-    int window = m_config->RMS_WINDOW_MS * defaults::SAMPLE_RATE / 1000;
+        (now - m_currentFrameStartUs) * frame.sampleRate / 1000000;
+    int window = m_config->RMS_WINDOW_MS * frame.sampleRate / 1000;
     int count = cursor;
     uint64_t sum = 0;
 
     //DEBUG("RMS cursor %d for time %d", now - m_currentFrameStartUs);
 
-    const std::vector<defaults::Sample>& samples = lpf ? frame.lpf : frame.hpf;
-    const std::vector<defaults::Sample>& lastSamples =
-        lpf ? m_previousFrame.lpf : m_previousFrame.hpf;
+    const defaults::Sample* samples = frame.lane(lane);
+    const defaults::Sample* lastSamples =
+        m_previousFrame.valid() ? m_previousFrame.lane(lane) : nullptr;
+    int lastCount = m_previousFrame.nSamples;
 
-    if (count < 0 || count >= int(frame.lpf.size())) {
+    if (count < 0 || count >= frame.nSamples) {
         return -1;
     }
 
@@ -231,10 +462,10 @@ int GPIO::_computeRMS(uint64_t now, const Frame& frame, bool lpf) {
         sum += samples[i] * samples[i];
     }
 
-    for (int i = 0; i > cursor - window + int(lastSamples.size()); --i) {
-        int idx = i + lastSamples.size();
+    for (int i = 0; i > cursor - window + lastCount; --i) {
+        int idx = i + lastCount;
 
-        if (idx < 0 || idx >= int(lastSamples.size())) {
+        if (idx < 0 || idx >= lastCount) {
             continue;
         }
 
@@ -244,80 +475,174 @@ int GPIO::_computeRMS(uint64_t now, const Frame& frame, bool lpf) {
     
     //DEBUG("RMS %s, %lu count, %lu sum, %lu (sum / count), %.2f sqrt(sum /count)", lpf ? "LPF" : "HPF", count, sum, sum / count, sqrt((float) sum / (float) count));
 
+    // nothing heard yet: the cursor is still in the first bin of the first frame
+    if (count == 0) {
+        return 0;
+    }
+
     return sqrt((float) sum / (float) count);
 }
 
-uint8_t GPIO::_enumPins(uint8_t (*callback)(int)) {
-    return callback(defaults::PIN_BODY_DIRECTION_A)
-         | callback(defaults::PIN_BODY_DIRECTION_B)
-         | callback(defaults::PIN_BODY_SPEED)
-         | callback(defaults::PIN_MOUTH_DIRECTION_A)
-         | callback(defaults::PIN_MOUTH_DIRECTION_B)
-         | callback(defaults::PIN_MOUTH_SPEED);
+uint8_t GPIO::_enumPins(const function<uint8_t(int)>& callback) {
+    uint8_t ret = 0;
+
+    for (int i = 0; i < m_controllerCount; ++i) {
+        for (int p = 0; p < _fishPinCount; ++p) {
+            ret |= callback(m_controllers[i].pin((fishPin) p));
+        }
+    }
+
+    return ret;
 }
 
 void GPIO::_flushPins() {
-#ifdef ENABLE_GPIO
+    _parkPins();
+
+    for (int i = 0; i < m_controllerCount; ++i) {
+        m_controllers[i].reset();
+    }
+}
+
+void GPIO::_parkPins() {
     if (m_gpioInitialized) {
-        _enumPins([](int pin) -> uint8_t { gpioWrite(pin, 0); return 0; });
+        _enumPins([this](int pin) -> uint8_t { m_backend->write(pin, 0); return 0; });
         DEBUG("GPIO pins flushed");
     }
-#endif
+
+    // the shadow matches the hardware, the next tick writes every active pin again
+    m_pinLevels = 0;
+
+    for (int i = 0; i < m_controllerCount; ++i) {
+        m_controllers[i].writtenBodyDuty = 0;
+        m_controllers[i].writtenMouthDuty = 0;
+    }
 }
 
-#ifdef ENABLE_GPIO
-void GPIO::_writeGPIO(int rmsLpf, int rmsHpf) {
-    if (!m_gpioInitialized) {
-        return;
+void GPIO::_holdWhilePaused() {
+    if (m_paused.load(memory_order_acquire)) {
+        _parkPins();
+        DEBUG("GPIO paused");
+
+        while (m_paused.load(memory_order_acquire) && m_running.load() && !signalHandler::g_shouldExit) {
+            systemClock::sleepUs(defaults::MAX_WAIT_US);
+        }
     }
 
-    static int flip;
-    static int consecutiveLow;
-    int flipIntervalMS = m_config->FLIP_INTERVAL_MS;
+    // a pause too short to be seen here still delays the queued audio
+    uint64_t pausedUs = m_pausedUs.load(memory_order_relaxed);
+    if (pausedUs != m_appliedPauseUs) {
+        m_currentFrameStartUs += pausedUs - m_appliedPauseUs;
+        for (int i = 0; i < m_controllerCount; ++i) {
+            m_controllers[i].skipTime(pausedUs - m_appliedPauseUs);
+        }
+        m_appliedPauseUs = pausedUs;
+    }
+}
 
-    //DEBUG("writeGPIO handling [%d %d] vs threshold [%d %d]", rmsLpf, rmsHpf, m_config->BODY_THRESHOLD, m_config->MOUTH_THRESHOLD);
+bool GPIO::_applyFlush() {
+    if (!m_flushPending.exchange(false, memory_order_acquire)) {
+        return false;
+    }
 
-    int move_body = rmsLpf > m_config->BODY_THRESHOLD;
-    int move_mouth = rmsHpf > m_config->MOUTH_THRESHOLD;
-    uint64_t now = timeManager::getUsSinceEpoch();
-    static uint64_t lastFlip = now;
+    // the frame being played is among the dropped ones, the next starts afresh
+    m_frameRing.releaseUntil(m_flushIndex.load(memory_order_relaxed));
+    m_previousFrame = frameRing::frame();
+    m_currentFrameStartUs = timeManager::getUsSinceEpoch();
+    _flushPins();
+    DEBUG("GPIO frames flushed");
+    return true;
+}
 
-    if (move_body) {
-        if (flip) {
-            gpioWrite(defaults::PIN_BODY_DIRECTION_A, 0);
-            gpioWrite(defaults::PIN_BODY_DIRECTION_B, 1);
-        } else {
-            gpioWrite(defaults::PIN_BODY_DIRECTION_B, 0);
-            gpioWrite(defaults::PIN_BODY_DIRECTION_A, 1);
-        }
+void GPIO::_applyPins(uint32_t levels) {
+    uint32_t changed = (levels ^ m_pinLevels) & m_directionPinMask;
 
-        gpioPWM(defaults::PIN_BODY_SPEED, defaults::BODY_DUTY);
-        consecutiveLow = 0;
-    } else {
-        gpioPWM(defaults::PIN_BODY_SPEED, 0);
-        ++consecutiveLow;
+    // the backend clears before it sets, so a direction change never drives both sides of the bridge
+    if (changed) {
+        m_backend->writeBank(changed & levels, changed & m_pinLevels);
+        m_pinLevels ^= changed;
+        m_pinWriteCount += 1;
+    }
 
-        //DEBUG("Consecutive low %d vs %d (%d / 40)", consecutiveLow, defaults::SAMPLE_RATE / 80, defaults::SAMPLE_RATE);
+    for (int i = 0; i < m_controllerCount; ++i) {
+        motorController& controller = m_controllers[i];
 
-        if (consecutiveLow > (defaults::SAMPLE_RATE / 80)) {
-            if ((now - lastFlip) / 1000 > (uint64_t) flipIntervalMS) {
-                flip ^= 1;
-                lastFlip = now;
-            }
-            //DEBUG("Performing flip %d", flip);
+        if (controller.bodyDuty() != controller.writtenBodyDuty) {
+            m_backend->pwm(controller.pin(FISH_BODY_SPEED), controller.bodyDuty());
+            controller.writtenBodyDuty = controller.bodyDuty();
+            m_pinWriteCount += 1;
         }
+
+        if (controller.mouthDuty() != controller.writtenMouthDuty) {
+            m_backend->pwm(controller.pin(FISH_MOUTH_SPEED), controller.mouthDuty());
+            controller.writtenMouthDuty = controller.mouthDuty();
+            m_pinWriteCount += 1;
+        }
+    }
+}
+
+void GPIO::_writeGPIO(uint64_t now, const int* rmsLpf, const int* rmsHpf) {
+    // direction pins keep their level while a motor is idle
+    uint32_t levels = m_pinLevels;
+
+    for (int i = 0; i < m_controllerCount; ++i) {
+        levels = m_controllers[i].update(rmsLpf[i], rmsHpf[i], now, *m_config, levels);
     }
 
-    if (move_mouth) {
-        gpioWrite(defaults::PIN_MOUTH_DIRECTION_A, 0);
-        gpioWrite(defaults::PIN_MOUTH_DIRECTION_B, 1);
-        gpioPWM(defaults::PIN_MOUTH_SPEED, defaults::MOUTH_DUTY);
-    } else {
-        gpioPWM(defaults::PIN_MOUTH_SPEED, 0);
+    // without a backend the controllers still run, only the pins are not driven
+    if (m_gpioInitialized) {
+        _applyPins(levels);
+    }
+
+    _publishStatus(now);
+    _publishEvents(now);
+}
+
+void GPIO::_publishStatus(uint64_t now) {
+    if (!m_status) {
+        return;
     }
 
-    m_pinWriteCount += 1;
+    statusMotors motors;
+    memset(&motors, 0, sizeof(motors));
+
+    motors.updatedUs = now;
+    motors.wakeLateMaxUs = m_wakeups.maxUs;
+    motors.fishCount = m_controllerCount;
+
+    for (int i = 0; i < m_controllerCount; ++i) {
+        const motorController& controller = m_controllers[i];
+        statusFish& fish = motors.fish[i];
+
+        fish.bodyEnvelope = controller.bodyEnvelope();
+        fish.mouthEnvelope = controller.mouthEnvelope();
+        fish.bodyThreshold = m_config->AUTO_THRESHOLD ? controller.learnedBodyThreshold() : m_config->bodyThreshold(controller.fish());
+        fish.mouthThreshold = m_config->AUTO_THRESHOLD ? controller.learnedMouthThreshold() : m_config->mouthThreshold(controller.fish());
+        fish.bodyDuty = controller.bodyDuty();
+        fish.mouthDuty = controller.mouthDuty();
+        fish.flags = (controller.bodyActive() ? (uint32_t) STATUS_BODY_ACTIVE : 0u) | (controller.mouthActive() ? (uint32_t) STATUS_MOUTH_ACTIVE : 0u);
+    }
+
+    m_status->publishMotors(motors);
+}
+
+void GPIO::_publishEvents(uint64_t now) {
+    if (!m_events || !m_events->active() || now - m_lastEventUs < 1000000 / (uint64_t) m_config->EVENT_RATE_HZ) {
+        return;
+    }
+    m_lastEventUs = now;
+
+    for (int i = 0; i < m_controllerCount; ++i) {
+        const motorController& controller = m_controllers[i];
+        streamEvent ev = streamEvent();
+
+        ev.timeUs = now;
+        ev.type = EVENT_ENVELOPE;
+        ev.index = controller.fish();
+        ev.flags = (controller.bodyActive() ? (uint32_t) STATUS_BODY_ACTIVE : 0u) | (controller.mouthActive() ? (uint32_t) STATUS_MOUTH_ACTIVE : 0u);
+        ev.value[0] = controller.bodyEnvelope();
+        ev.value[1] = controller.mouthEnvelope();
+        ev.value[2] = controller.bodyDuty();
+        ev.value[3] = controller.mouthDuty();
+        m_events->push(EVENT_SOURCE_GPIO, ev);
+    }
 }
-#else
-void GPIO::_writeGPIO(int, int) {}
-#endif
@@ -1,53 +1,70 @@
 #pragma once
 
 #include <cstdint>
-#include <mutex>
-#include <queue>
 #include <thread>
 #include <atomic>
-#include <vector>
+#include <functional>
+#include <mutex>
+#include <string>
 
 #include "signalProcessingDefaults.h"
 #include "b3Config.h"
+#include "configStore.h"
+#include "eventStream.h"
+#include "frameRing.h"
+#include "gpioBackend.h"
+#include "motorController.h"
+#include "rtPolicy.h"
+#include "statusSegment.h"
+#include "thresholdIndex.h"
 
 namespace b3 {
 
 namespace gpio {
 namespace defaults {
-    // Audio processing defaults
-    constexpr int SAMPLE_RATE = signalProcessingDefaults::DEFAULT_SAMPLE_RATE;
-
-    // PWM duty cycles per motor (0-255)
-    constexpr uint8_t BODY_DUTY = 255 * 90 / 100;  // 95%
-    constexpr uint8_t MOUTH_DUTY = 0;
+    // Audio sample type
+    typedef frameRing::Sample Sample;
 
-    // GPIO pin numbers
-    constexpr int PIN_BODY_DIRECTION_A = 17;
-    constexpr int PIN_BODY_DIRECTION_B = 27;
-    constexpr int PIN_MOUTH_DIRECTION_A = 24;
-    constexpr int PIN_MOUTH_DIRECTION_B = 25;
-    constexpr int PIN_BODY_SPEED = 12;
-    constexpr int PIN_MOUTH_SPEED = 13;
+    // Longest single sleep while waiting for a frame's presentation time (us)
+    constexpr uint64_t MAX_WAIT_US = 1000;
 
-    // Audio sample type
-    typedef int16_t Sample;
+    // Motor control period (us). The thread sleeps between ticks, so it can
+    // run under SCHED_FIFO without starving the rest of the system.
+    constexpr uint64_t CONTROL_TICK_US = 500;
 
     // Debug interval (seconds)
     constexpr int DEBUG_INTERVAL_S = 3;
 } // namespace defaults
+
+// Envelope lanes carried by each frame, per fish: the RMS of each band over short bins
+enum frameLane {
+    LANE_LPF,
+    LANE_HPF,
+
+    _laneCount
+};
+
+/**
+ * @return the frame ring lane holding a fish's band envelope.
+ */
+inline int laneIndex(int fish, frameLane lane) { return fish * _laneCount + lane; }
 } // namespace gpio
 
 class GPIO {
    public:
-    GPIO(b3Config* config);
+    /**
+     * @param configs The config snapshots, read once per frame by the GPIO thread.
+     * @param backend The pin backend, owned by the GPIO service. May be null, in
+     *                which case frames are consumed but no pins are driven.
+     */
+    GPIO(configStore* configs, gpioBackend* backend);
     ~GPIO();
 
     /**
-     * Starts the GPIO service.
-     *
-     * @param sigintHandler The handler to install for SIGINT.
+     * Starts the GPIO service. Termination signals should already be blocked
+     * (see signalHandler::blockSignals()), the thread inherits the mask.
      */
-    void start(void(*sigintHandler)(int));
+    void start();
 
     /**
      * Stops the GPIO thread.
@@ -55,39 +72,123 @@ class GPIO {
     void stop();
 
     /**
-     * Submits a chunk of audio samples to the GPIO thread.
+     * Gets a free frame slot to be filled in place by the audio thread.
+     * Lanes are indexed by gpio::laneIndex(). Never blocks or allocates.
      *
-     * @param lpf The low-pass filtered audio samples.
-     * @param hpf The high-pass filtered audio samples.
-     * @param n_samples The number of samples in the arrays.
+     * @param out Receives the frame slot.
+     * @return true if a slot is available, false if the frame ring is full.
      */
-    static void submitFrame(gpio::defaults::Sample* lpf,
-                            gpio::defaults::Sample* hpf, int n_samples);
+    static bool acquireFrame(frameRing::frame& out);
 
-   private:
-    // Configuration instance
-    b3Config* m_config;
+    /**
+     * Publishes the frame slot filled since the last acquireFrame().
+     *
+     * @param n_samples The number of envelope bins written to each lane.
+     * @param sampleRate The rate of the envelope bins (Hz).
+     * @param ptsUs The time the audio of the first bin will be heard (us since epoch), 0 if unknown.
+     */
+    static void publishFrame(int n_samples, uint32_t sampleRate, uint64_t ptsUs);
+
+    /**
+     * Records a chunk which was dropped because the frame ring was full.
+     */
+    static void dropFrame();
+
+    /**
+     * Pauses or resumes the motors along with the audio. While paused the
+     * motors are parked and queued frames are held; on resume they play out
+     * delayed by the pause, so they stay aligned with the audio still queued
+     * in the sink. Called from the audio thread.
+     *
+     * @param paused true to pause, false to resume.
+     */
+    static void setPaused(bool paused);
 
-    // Frame queue management
-    struct Frame {
-        Frame(gpio::defaults::Sample* lpf,
-              gpio::defaults::Sample* hpf, int n_samples)
-            : lpf(lpf, lpf + n_samples), hpf(hpf, hpf + n_samples) {}
+    /**
+     * Drops the frames queued so far, for audio which will never be heard
+     * because the sink discarded it. The GPIO thread releases them and parks
+     * the motors before it plays anything further; frames published after
+     * the call are kept. Called from the audio thread.
+     */
+    static void flush();
+
+    /**
+     * @return the number of frames queued for the GPIO thread.
+     */
+    static uint32_t frameQueueDepth();
+
+    /**
+     * @return the number of chunks dropped because the frame ring was full.
+     */
+    static uint64_t droppedFrames();
+
+    /**
+     * Sets the segment the motor states are published to. Must be called
+     * before start().
+     */
+    inline void setStatusSegment(statusSegment* status) { m_status = status; }
 
-        Frame() {}
+    /**
+     * Sets the stream the motor states are pushed to for subscribers, at
+     * event_rate_hz. Must be called before start().
+     */
+    inline void setEventStream(eventStream* events) { m_events = events; }
+
+    /**
+     * Switches the learned thresholds to another song. The thresholds the
+     * previous song ended with are written to the threshold index and the new
+     * song's are looked up; the GPIO thread swaps them in before its next
+     * frame, a song not in the index keeps learning from where it was. Called
+     * from the audio thread, which owns the index.
+     *
+     * @param song The index key of the song about to play.
+     */
+    void changeSong(const std::string& song);
 
-        std::vector<gpio::defaults::Sample> lpf, hpf;
+    /**
+     * Records the thresholds learned for the songs not yet written to the
+     * threshold index. Must be called after stop(); does nothing unless
+     * auto_threshold is set.
+     */
+    void storeThresholds();
+
+   private:
+    // Learned thresholds of every fish on one song, 0 where none are known
+    struct songThresholds {
+        std::string song;
+        int body[configDefaults::MAX_FISH];
+        int mouth[configDefaults::MAX_FISH];
     };
 
-    std::mutex m_frameQueueMutex;
-    std::queue<Frame> m_frameQueue;
-    Frame m_previousFrame;
+    // Configuration snapshot, refreshed by the GPIO thread once per frame
+    configStore* m_configs;
+    int m_configReader;
+    const b3Config* m_config;
+
+    // Pin backend (owned)
+    gpioBackend* m_backend;
+
+    // Frame ring shared with the audio thread
+    frameRing m_frameRing;
+    frameRing::frame m_previousFrame;
 
     // Time management
     uint64_t m_currentFrameStartUs;
 
+    // Pause management. Frame times are published without the time spent
+    // paused so far, which the GPIO thread adds back when it plays them.
+    std::atomic<bool> m_paused;
+    std::atomic<uint64_t> m_pausedUs;
+    uint64_t m_pauseStartUs;    // audio thread
+    uint64_t m_appliedPauseUs;  // GPIO thread
+
+    // Flush requests, frames published before m_flushIndex are dropped
+    std::atomic<bool> m_flushPending;
+    std::atomic<uint32_t> m_flushIndex;
+
     // Debug management
     uint64_t m_lastDebugUs;
+    wakeupStats m_wakeups;
 
     // Thread management
     std::thread* m_thread;
@@ -97,33 +198,61 @@ class GPIO {
     bool m_gpioInitialized;
     unsigned m_pinWriteCount;
 
+    // One controller per fish, all driven from the same control tick
+    motorController m_controllers[configDefaults::MAX_FISH];
+    int m_controllerCount;
+
+    // Thresholds learned on previous runs, owned by the audio thread
+    thresholdIndex m_thresholdIndex;
+    bool m_indexLoaded;
+
+    // Song changes. The next song's thresholds are posted by the audio thread,
+    // the finished song's handed back by the GPIO thread, both under m_songMutex
+    std::mutex m_songMutex;
+    std::atomic<bool> m_songPending;
+    songThresholds m_nextSong;
+    songThresholds m_finishedSong;
+    std::string m_currentSong;  // GPIO thread
+
+    // Live status, may be null
+    statusSegment* m_status;
+
+    // Subscription events, may be null
+    eventStream* m_events;
+    uint64_t m_lastEventUs;
+
+    // Shadow of the hardware bank 0 levels, only transitions are written out
+    uint32_t m_pinLevels;
+    uint32_t m_directionPinMask;
+
     // Internal methods
 
     /**
      * The main thread method.
      *
-     * @param sigint The handler to install for SIGINT.
      * @return 0 on success, nonzero otherwise.
      */
-    int _threadMain(void(*sigintHandler)(int));
+    int _threadMain();
 
     /**
-     * Processes a chunk of samples. Blocks until the chunk has been fully processed.
+     * Processes a chunk of samples. Waits for the frame's presentation time,
+     * then blocks until the chunk has been fully processed.
      *
      * @param frame The frame to process.
+     * @return false if the frame was flushed meanwhile.
      */
-    void _processFrame(const Frame& frame);
+    bool _processFrame(const frameRing::frame& frame);
 
     /**
      * Computes the normalized RMS of a frame for a given time point.
      *
      * @param now The current time (us since epoch)
      * @param frame The current frame
-     * @param lpf Whether to use the low-pass filtered audio
+     * @param lane The sample lane to use (see gpio::laneIndex)
      *
      * @return the RMS if the cursor is within the frame, -1 otherwise
      */
-    int _computeRMS(uint64_t now, const Frame& frame, bool lpf);
+    int _computeRMS(uint64_t now, const frameRing::frame& frame, int lane);
 
     /**
      * Enumerates the GPIO pins over a callback method.
@@ -131,20 +260,82 @@ class GPIO {
      * @param f The callback method, called for each pin number.
      * @return the union of each invocation's return value.
      */
-    uint8_t _enumPins(uint8_t (*f)(int));
+    uint8_t _enumPins(const std::function<uint8_t(int)>& f);
 
     /**
-     * Sets all pin outputs to the low state.
+     * Sets all pin outputs to the low state and resets the motion state.
      */
     void _flushPins();
 
     /**
-     * Writes the GPIO pins based on the RMS values.
+     * Sets all pin outputs to the low state, keeping the motion state so the
+     * motors pick up where they were on the next tick.
+     */
+    void _parkPins();
+
+    /**
+     * Parks the motors and sleeps while playback is paused, then shifts the
+     * current frame and the motion timestamps by the time spent paused.
+     */
+    void _holdWhilePaused();
+
+    /**
+     * Carries out a pending changeSong(): hands the thresholds learned on the
+     * song playing back to the audio thread and seeds the new song's.
+     */
+    void _applySongChange();
+
+    /**
+     * Copies the thresholds the controllers learned so far.
+     */
+    void _learnedThresholds(songThresholds& out) const;
+
+    /**
+     * Adds a song's learned thresholds to the threshold index. Audio thread.
+     */
+    void _indexThresholds(const songThresholds& learned);
+
+    /**
+     * Carries out a pending flush(): releases the dropped frames, including
+     * the one being played, and flushes the pins.
+     *
+     * @return true if frames were flushed.
+     */
+    bool _applyFlush();
+
+    /**
+     * Writes the difference between the requested and the shadowed pin state
+     * to the hardware. Direction pins of all fish are changed with one bank
+     * clear and one bank set; PWM is only written for duty cycles that changed.
      *
-     * @param rmsLpf The RMS value of the low-pass filtered audio.
-     * @param rmsHpf The RMS value of the high-pass filtered audio.
+     * @param levels The requested direction pin levels (bit per pin).
+     */
+    void _applyPins(uint32_t levels);
+
+    /**
+     * Runs the motor controllers of every fish on the RMS values, drives the
+     * pins when a backend is initialized and publishes the motor state.
+     *
+     * @param now The current time (us since epoch)
+     * @param rmsLpf The RMS values of the low-pass filtered audio, per fish.
+     * @param rmsHpf The RMS values of the high-pass filtered audio, per fish.
+     */
+    void _writeGPIO(uint64_t now, const int* rmsLpf, const int* rmsHpf);
+
+    /**
+     * Publishes the motor states to the status segment.
+     *
+     * @param now The current time (us since epoch)
+     */
+    void _publishStatus(uint64_t now);
+
+    /**
+     * Pushes the envelope and motor state of every fish to the event stream,
+     * at most event_rate_hz times per second.
+     *
+     * @param now The current time (us since epoch)
      */
-    void _writeGPIO(int rmsLpf, int rmsHpf);
+    void _publishEvents(uint64_t now);
 }; // class GPIO
 
 }  // namespace b3
@@ -0,0 +1,153 @@
+#include "gpioBackend.h"
+
+#include "logger.h"
+#include "timeManager.h"
+
+#ifdef ENABLE_GPIO
+#include <pigpio.h>
+#endif
+
+#include <cerrno>
+#include <cstring>
+
+using namespace b3;
+
+gpioBackend* gpioBackend::create(const char* tracePath) {
+    if (tracePath && tracePath[0]) {
+        return new gpioTraceBackend(tracePath);
+    }
+
+#ifdef ENABLE_GPIO
+    return new pigpioBackend();
+#else
+    return nullptr;
+#endif
+}
+
+#ifdef ENABLE_GPIO
+int pigpioBackend::init() {
+    if (gpioInitialise() < 0) {
+        ERROR("Failed to initialize GPIO: %s", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+void pigpioBackend::terminate() {
+    gpioTerminate();
+}
+
+int pigpioBackend::setOutput(int pin) {
+    if (gpioSetMode(pin, PI_OUTPUT) < 0) {
+        ERROR("Failed to set pin %d mode: %s", pin, strerror(errno));
+        return 1;
+    }
+
+    return 0;
+}
+
+void pigpioBackend::write(int pin, int level) {
+    gpioWrite(pin, level);
+}
+
+void pigpioBackend::writeBank(uint32_t setMask, uint32_t clearMask) {
+    if (clearMask) {
+        gpioWrite_Bits_0_31_Clear(clearMask);
+    }
+
+    if (setMask) {
+        gpioWrite_Bits_0_31_Set(setMask);
+    }
+}
+
+void pigpioBackend::pwm(int pin, int duty) {
+    gpioPWM(pin, duty);
+}
+#endif
+
+gpioTraceBackend::gpioTraceBackend(const char* path) : m_file(nullptr),
+                                                       m_recordCount(0) {
+    snprintf(m_path, sizeof(m_path), "%s", path);
+}
+
+gpioTraceBackend::~gpioTraceBackend() {
+    terminate();
+}
+
+int gpioTraceBackend::init() {
+    m_file = fopen(m_path, "wb");
+
+    if (!m_file) {
+        ERROR("Failed to open GPIO trace %s: %s", m_path, strerror(errno));
+        return -1;
+    }
+
+    setvbuf(m_file, nullptr, _IOFBF, gpioTraceDefaults::WRITE_BUFFER_SIZE);
+
+    gpioTraceHeader header;
+    memcpy(header.magic, gpioTraceDefaults::MAGIC, sizeof(header.magic));
+    header.version = gpioTraceDefaults::VERSION;
+    header.recordSize = sizeof(gpioTraceRecord);
+    header.startUs = timeManager::getUsSinceEpoch();
+
+    if (fwrite(&header, sizeof(header), 1, m_file) != 1) {
+        ERROR("Failed to write GPIO trace header: %s", strerror(errno));
+        fclose(m_file);
+        m_file = nullptr;
+        return -1;
+    }
+
+    INFO("Recording GPIO trace to %s", m_path);
+    return 0;
+}
+
+void gpioTraceBackend::terminate() {
+    if (m_file) {
+        fclose(m_file);
+        m_file = nullptr;
+        INFO("GPIO trace %s closed, %llu records", m_path, (unsigned long long) m_recordCount);
+    }
+}
+
+int gpioTraceBackend::setOutput(int pin) {
+    _record(TRACE_MODE, pin, 1);
+    return 0;
+}
+
+void gpioTraceBackend::write(int pin, int level) {
+    _record(TRACE_LEVEL, pin, level ? 1 : 0);
+}
+
+void gpioTraceBackend::writeBank(uint32_t setMask, uint32_t clearMask) {
+    for (int pin = 0; clearMask; ++pin, clearMask >>= 1) {
+        if (clearMask & 1) {
+            _record(TRACE_LEVEL, pin, 0);
+        }
+    }
+
+    for (int pin = 0; setMask; ++pin, setMask >>= 1) {
+        if (setMask & 1) {
+            _record(TRACE_LEVEL, pin, 1);
+        }
+    }
+}
+
+void gpioTraceBackend::pwm(int pin, int duty) {
+    _record(TRACE_PWM, pin, duty);
+}
+
+void gpioTraceBackend::_record(gpioTraceEvent event, int pin, int value) {
+    if (!m_file) {
+        return;
+    }
+
+    gpioTraceRecord record;
+    record.timeUs = timeManager::getUsSinceEpoch();
+    record.event = event;
+    record.pin = pin;
+    record.value = value;
+
+    fwrite(&record, sizeof(record), 1, m_file);
+    m_recordCount += 1;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+#include "gpioTrace.h"
+#include "signalProcessingDefaults.h"
+
+namespace b3 {
+
+/**
+ * Hardware access used by the GPIO service. The GPIO service only hands
+ * transitions to the backend, so every call corresponds to a real change.
+ */
+class gpioBackend {
+   public:
+    virtual ~gpioBackend() {}
+
+    /**
+     * Initializes the backend.
+     *
+     * @return 0 on success, nonzero otherwise.
+     */
+    virtual int init() = 0;
+
+    /**
+     * Releases the backend. Only called after a successful init().
+     */
+    virtual void terminate() = 0;
+
+    /**
+     * Configures a pin as an output.
+     *
+     * @return 0 on success, nonzero otherwise.
+     */
+    virtual int setOutput(int pin) = 0;
+
+    /**
+     * Writes a single pin level.
+     */
+    virtual void write(int pin, int level) = 0;
+
+    /**
+     * Writes pins 0-31 as one bank update. Pins in clearMask are driven low
+     * before pins in setMask are driven high.
+     */
+    virtual void writeBank(uint32_t setMask, uint32_t clearMask) = 0;
+
+    /**
+     * Sets the PWM duty cycle of a pin.
+     */
+    virtual void pwm(int pin, int duty) = 0;
+
+    /**
+     * @return a short human readable backend name.
+     */
+    virtual const char* name() const = 0;
+
+    /**
+     * Creates the backend selected at runtime.
+     *
+     * @param tracePath If set, pin traffic is recorded to this file instead of driving hardware.
+     * @return a new backend owned by the caller, or nullptr if no backend is available.
+     */
+    static gpioBackend* create(const char* tracePath);
+}; // class gpioBackend
+
+#ifdef ENABLE_GPIO
+/**
+ * Drives the pins through pigpio.
+ */
+class pigpioBackend : public gpioBackend {
+   public:
+    int init() override;
+    void terminate() override;
+    int setOutput(int pin) override;
+    void write(int pin, int level) override;
+    void writeBank(uint32_t setMask, uint32_t clearMask) override;
+    void pwm(int pin, int duty) override;
+    const char* name() const override { return "pigpio"; }
+}; // class pigpioBackend
+#endif
+
+/**
+ * Records every pin and PWM transition with its timestamp into a compact
+ * binary trace (see gpioTrace.h). Use b3trace to convert it to CSV or VCD.
+ */
+class gpioTraceBackend : public gpioBackend {
+   public:
+    gpioTraceBackend(const char* path);
+    ~gpioTraceBackend();
+
+    int init() override;
+    void terminate() override;
+    int setOutput(int pin) override;
+    void write(int pin, int level) override;
+    void writeBank(uint32_t setMask, uint32_t clearMask) override;
+    void pwm(int pin, int duty) override;
+    const char* name() const override { return "trace"; }
+
+   private:
+    void _record(gpioTraceEvent event, int pin, int value);
+
+    char m_path[signalProcessingDefaults::FILE_NAME_BUFFER_SIZE];
+    FILE* m_file;
+    uint64_t m_recordCount;
+}; // class gpioTraceBackend
+
+}  // namespace b3
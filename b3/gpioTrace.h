@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * On-disk format of GPIO traces written by gpioTraceBackend and read by b3trace.
+ *
+ * A trace is a gpioTraceHeader followed by fixed-size gpioTraceRecords in
+ * timestamp order. All fields are little endian.
+ */
+namespace b3 {
+    namespace gpioTraceDefaults {
+        constexpr char MAGIC[4] = { 'B', '3', 'G', 'T' };
+        constexpr uint16_t VERSION = 1;
+
+        // records are buffered in userspace and written in blocks
+        constexpr int WRITE_BUFFER_SIZE = 64 * 1024;
+    };
+
+    enum gpioTraceEvent : uint8_t {
+        TRACE_LEVEL,    // digital pin level change, value is 0 or 1
+        TRACE_PWM,      // PWM duty cycle change, value is the duty cycle
+        TRACE_MODE,     // pin configured as output
+    };
+
+    struct __attribute__((packed)) gpioTraceHeader {
+        char magic[4];
+        uint16_t version;
+        uint16_t recordSize;
+        uint64_t startUs;       // timestamp of trace start (us since epoch)
+    };
+
+    struct __attribute__((packed)) gpioTraceRecord {
+        uint64_t timeUs;        // us since epoch
+        uint8_t event;          // gpioTraceEvent
+        uint8_t pin;
+        uint16_t value;
+    };
+
+    static_assert(sizeof(gpioTraceRecord) == 12, "gpio trace records must stay compact");
+}; // namespace b3
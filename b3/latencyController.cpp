@@ -0,0 +1,59 @@
+#include "latencyController.h"
+
+#include "logger.h"
+
+using namespace b3;
+
+void latencyController::reset(uint64_t chunkUs, int minChunks, int maxChunks, int startChunks, uint64_t xruns)
+{
+    m_chunkUs = chunkUs;
+    m_minChunks = minChunks < 1 ? 1 : minChunks;
+    m_maxChunks = maxChunks < m_minChunks ? m_minChunks : maxChunks;
+    m_targetChunks = startChunks < m_minChunks ? m_minChunks : (startChunks > m_maxChunks ? m_maxChunks : startChunks);
+
+    m_chunkCount = 0;
+    m_cooldown = latencyDefaults::SHRINK_COOLDOWN_CHUNKS;
+    m_lastXruns = xruns;
+    m_processUs.reset(latencyDefaults::PROCESS_QUANTILE);
+}
+
+bool latencyController::update(uint64_t processUs, uint64_t xruns)
+{
+    m_processUs.add(processUs);
+    m_chunkCount++;
+    if (m_cooldown > 0)
+        m_cooldown--;
+
+    // an underrun means the queue was too short, react right away
+    if (xruns != m_lastXruns) {
+        m_lastXruns = xruns;
+        m_cooldown = latencyDefaults::SHRINK_COOLDOWN_CHUNKS;
+
+        if (m_targetChunks < m_maxChunks) {
+            m_targetChunks++;
+            INFO("Audio underrun, queue grown to %d chunks (%llu ms)", m_targetChunks, m_targetChunks * m_chunkUs / 1000);
+            return true;
+        }
+        return false;
+    }
+
+    if (m_chunkCount < latencyDefaults::EVAL_CHUNKS)
+        return false;
+
+    uint64_t slowUs = m_processUs.value();
+    m_chunkCount = 0;
+    m_processUs.reset(latencyDefaults::PROCESS_QUANTILE);
+
+    // the queue dips one chunk below the target before the next chunk is produced
+    uint64_t coveredUs = m_targetChunks > 2 ? (m_targetChunks - 2) * m_chunkUs : 0;
+
+    if (m_cooldown == 0 && m_targetChunks > m_minChunks
+        && slowUs * latencyDefaults::HEADROOM_FACTOR < coveredUs) {
+        m_targetChunks--;
+        DEBUG("Audio queue shrunk to %d chunks (%llu ms, p95 processing %llu us)",
+              m_targetChunks, m_targetChunks * m_chunkUs / 1000, slowUs);
+        return true;
+    }
+
+    return false;
+}
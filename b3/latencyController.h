@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+
+#include "p2Quantile.h"
+
+namespace b3 {
+    namespace latencyDefaults {
+        // chunks between two decisions
+        constexpr int EVAL_CHUNKS = 50;
+
+        // processing time percentile the queue has to cover
+        constexpr double PROCESS_QUANTILE = 0.95;
+
+        // the queue must hold this many times the processing time percentile before it shrinks
+        constexpr int HEADROOM_FACTOR = 4;
+
+        // chunks to wait after growing before shrinking is considered again
+        constexpr int SHRINK_COOLDOWN_CHUNKS = 1000;
+    };
+
+    /**
+     * @brief
+     * Picks the number of chunks kept queued in the audio device.
+     *
+     * Each chunk reports its processing time and the device's XRUN count. An
+     * XRUN grows the queue by one chunk immediately. The queue shrinks by one
+     * chunk per evaluation window once it covers the window's processing time
+     * percentile with headroom, and no XRUN happened for a cooldown period. The
+     * queue always stays within the configured bounds.
+     */
+    class latencyController {
+    public:
+        latencyController() :
+            m_chunkUs(0),
+            m_minChunks(1),
+            m_maxChunks(1),
+            m_targetChunks(1),
+            m_chunkCount(0),
+            m_cooldown(0),
+            m_lastXruns(0),
+            m_processUs(latencyDefaults::PROCESS_QUANTILE)
+        {}
+
+        /**
+         * @brief Starts over with new bounds.
+         *
+         * @param chunkUs The playout duration of one chunk (us).
+         * @param minChunks The smallest queue depth allowed.
+         * @param maxChunks The largest queue depth allowed (the device buffer size).
+         * @param startChunks The initial queue depth.
+         * @param xruns The device's current XRUN count.
+         */
+        void reset(uint64_t chunkUs, int minChunks, int maxChunks, int startChunks, uint64_t xruns);
+
+        /**
+         * @brief Records one processed chunk.
+         *
+         * @param processUs The time spent producing the chunk (us).
+         * @param xruns The device's XRUN count after the chunk was written.
+         * @return true if the target depth changed.
+         */
+        bool update(uint64_t processUs, uint64_t xruns);
+
+        /**
+         * @return the number of chunks to keep queued in the device
+         */
+        inline int targetChunks() const { return m_targetChunks; }
+
+        /**
+         * @return the processing time percentile of the current window (us)
+         */
+        inline uint64_t processUs() const { return m_processUs.value(); }
+
+    private:
+        uint64_t m_chunkUs;
+        int m_minChunks;
+        int m_maxChunks;
+        int m_targetChunks;
+
+        int m_chunkCount;
+        int m_cooldown;
+        uint64_t m_lastXruns;
+
+        p2Quantile m_processUs;
+    }; // class latencyController
+}; // namespace b3
@@ -0,0 +1,77 @@
+#include "latencyHistogram.h"
+
+#include <algorithm>
+
+using namespace b3;
+using namespace latencyHistogramDefaults;
+using namespace std;
+
+latencyHistogram::latencyHistogram() :
+    m_max(0)
+{
+    for (auto &count : m_counts)
+        count.store(0, memory_order_relaxed);
+}
+
+int latencyHistogram::bucketIndex(uint64_t value)
+{
+    value = min(value, MAX_VALUE);
+    if (value < SUB_BUCKETS)
+        return (int)value;
+
+    // the top SUB_BUCKET_BITS bits of the value pick the sub-bucket
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - SUB_BUCKET_BITS + 1;
+    uint64_t mantissa = value >> shift;
+    return (int)(SUB_BUCKETS + (shift - 1) * (SUB_BUCKETS / 2) + (mantissa - SUB_BUCKETS / 2));
+}
+
+uint64_t latencyHistogram::bucketHighest(int index)
+{
+    if ((uint64_t)index < SUB_BUCKETS)
+        return index;
+
+    int k = index - SUB_BUCKETS;
+    int shift = k / (SUB_BUCKETS / 2) + 1;
+    uint64_t mantissa = k % (SUB_BUCKETS / 2) + SUB_BUCKETS / 2;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void latencyHistogram::record(uint64_t value)
+{
+    m_counts[bucketIndex(value)].fetch_add(1, memory_order_relaxed);
+
+    uint64_t max = m_max.load(memory_order_relaxed);
+    while (value > max && !m_max.compare_exchange_weak(max, value, memory_order_relaxed))
+        ;
+}
+
+latencyHistogram::summary latencyHistogram::summarize() const
+{
+    // counts keep moving while they are read, the summary is of the copy
+    uint64_t counts[BUCKET_COUNT];
+    summary s = {};
+
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        counts[i] = m_counts[i].load(memory_order_relaxed);
+        s.count += counts[i];
+    }
+    s.max = m_max.load(memory_order_relaxed);
+    if (!s.count)
+        return s;
+
+    // ranks of the percentiles, in thousandths
+    const uint64_t permille[] = { 500, 990, 999 };
+    uint64_t *results[] = { &s.p50, &s.p99, &s.p999 };
+    uint64_t seen = 0;
+    int next = 0;
+
+    for (int i = 0; i < BUCKET_COUNT && next < 3; i++) {
+        seen += counts[i];
+        while (next < 3 && seen * 1000 >= s.count * permille[next]) {
+            *results[next] = min(bucketHighest(i), s.max);
+            next++;
+        }
+    }
+    return s;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace b3 {
+    namespace latencyHistogramDefaults {
+        // linear sub-buckets per power of two, the relative error is 2 / SUB_BUCKETS
+        constexpr int SUB_BUCKET_BITS = 6;
+        constexpr uint64_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+
+        // values above are counted as this, a bit over an hour in us
+        constexpr uint64_t MAX_VALUE = (1ull << 32) - 1;
+
+        // the first SUB_BUCKETS values have a bucket each, every higher power of two half as many
+        constexpr int BUCKET_COUNT = SUB_BUCKETS + (32 - SUB_BUCKET_BITS) * (SUB_BUCKETS / 2);
+    };
+
+    /**
+     * @brief
+     * Fixed-bucket log-linear histogram (as in HdrHistogram) of non-negative values,
+     * typically latencies in us. Values below SUB_BUCKETS are exact, larger ones
+     * fall in buckets within 2 / SUB_BUCKETS of their value. Recording is lock free
+     * and may happen on any thread while another one reads the histogram.
+     */
+    class latencyHistogram {
+    public:
+        struct summary {
+            uint64_t count;
+            uint64_t p50;
+            uint64_t p99;
+            uint64_t p999;
+            uint64_t max;
+        };
+
+        latencyHistogram();
+
+        /**
+         * @brief Counts one value.
+         */
+        void record(uint64_t value);
+
+        /**
+         * @brief Takes the median, the 99th and 99.9th percentiles and the maximum
+         * of the values recorded so far. A percentile is the highest value of its
+         * bucket, so it is never under-reported.
+         */
+        summary summarize() const;
+
+        /**
+         * @return the bucket a value is counted in.
+         */
+        static int bucketIndex(uint64_t value);
+
+        /**
+         * @return the highest value counted in a bucket.
+         */
+        static uint64_t bucketHighest(int index);
+
+    private:
+        std::atomic<uint64_t> m_counts[latencyHistogramDefaults::BUCKET_COUNT];
+        std::atomic<uint64_t> m_max;
+    }; // class latencyHistogram
+};
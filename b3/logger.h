@@ -2,8 +2,33 @@
 
 
 #ifndef LOGGING_DISABLED
-# define LOG_V(LEVEL, MESSAGE, ...) _logger::log(LEVEL, __FILE_NAME__, __LINE__, __func__, MESSAGE, ##__VA_ARGS__)
-# define LOG(LEVEL, MESSAGE, ...) _logger::log(LEVEL,"",0,"", MESSAGE, ##__VA_ARGS__)
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// log sites below this level are compiled out, arguments included
+// (0 debug, 1 info, 2 warning, 3 error)
+#ifndef LOG_MIN_LEVEL
+# define LOG_MIN_LEVEL 0
+#endif
+
+// every site has its own rate limit, see _logger::logSite
+# define LOG_SITE(LEVEL, FILE, LINE, FUNC, MESSAGE, ...)                                     \
+    do {                                                                                    \
+        if constexpr ((int)(LEVEL) >= LOG_MIN_LEVEL) {                                      \
+            if (_logger::enabled(LEVEL)) {                                                  \
+                static _logger::logSite _logSite(LEVEL, MESSAGE);                           \
+                uint32_t _suppressed;                                                       \
+                if (_logSite.allow(_suppressed))                                            \
+                    _logger::log(LEVEL, _suppressed, FILE, LINE, FUNC, MESSAGE, ##__VA_ARGS__); \
+            }                                                                               \
+        }                                                                                   \
+    } while (0)
+
+# define LOG_V(LEVEL, MESSAGE, ...) LOG_SITE(LEVEL, __FILE_NAME__, __LINE__, __func__, MESSAGE, ##__VA_ARGS__)
+# define LOG(LEVEL, MESSAGE, ...) LOG_SITE(LEVEL,"",0,"", MESSAGE, ##__VA_ARGS__)
 # define DEBUG(MESSAGE, ...) LOG(_logger::LogLevel::DEBUG, MESSAGE, ##__VA_ARGS__)
 # define INFO(MESSAGE, ...) LOG(_logger::LogLevel::INFO, MESSAGE, ##__VA_ARGS__)
 # define WARNING(MESSAGE, ...) LOG(_logger::LogLevel::WARNING, MESSAGE, ##__VA_ARGS__)
@@ -21,7 +46,178 @@ namespace _logger {
         ERROR
     };
 
-    void log(LogLevel level, const char *file, int line, const char *func, const char *message, ...);
+    // bytes of captured arguments per record, longer strings are truncated
+    constexpr int RECORD_ARG_BYTES = 200;
+
+    // records per second a log site may sustain, and the burst it may write at once
+    constexpr uint64_t SITE_RATE_PER_S = 10;
+    constexpr uint64_t SITE_BURST = 20;
+
+    inline bool enabled(LogLevel level) { return level != DEBUG || g_log_verbose; }
+
+    /**
+     * The rate limit of one log site, a token bucket kept as the time it is
+     * next full (the generic cell rate algorithm), so a single atomic holds it.
+     * Records over the limit are counted; the count is attached to the site's
+     * next record, or reported by the writer once the site went quiet.
+     */
+    class logSite {
+    public:
+        constexpr logSite(LogLevel level, const char *format) :
+            m_level(level),
+            m_format(format),
+            m_fullAtUs(0),
+            m_suppressed(0),
+            m_listed(false),
+            m_next(nullptr)
+        {}
+
+        /**
+         * @brief Takes a token. Lock free, may be called from any thread.
+         * @param suppressed Receives the records suppressed since the last one allowed.
+         * @return true if the record may be written.
+         */
+        bool allow(uint32_t &suppressed);
+
+        /**
+         * @brief Takes the count of suppressed records if the site's bucket filled up again.
+         * @param nowUs The current time (us, CLOCK_MONOTONIC_COARSE)
+         * @return the suppressed records to report, 0 if none or the site is still busy.
+         */
+        uint32_t takeQuietCount(uint64_t nowUs);
+
+        inline LogLevel level() const { return m_level; }
+        inline const char *format() const { return m_format; }
+        inline logSite *next() const { return m_next; }
+
+    private:
+        LogLevel m_level;
+        const char *m_format;
+        std::atomic<uint64_t> m_fullAtUs;
+        std::atomic<uint32_t> m_suppressed;
+        std::atomic<bool> m_listed;     // on the list of sites which suppressed records
+        logSite *m_next;
+    };
+
+    /**
+     * A log line as captured by the calling thread. The format and the call site
+     * strings must be literals, they are only read when the record is written.
+     * Arguments are copied as tagged values, strings by content.
+     */
+    struct logRecord {
+        enum argTag : uint8_t {
+            ARG_SIGNED,
+            ARG_UNSIGNED,
+            ARG_DOUBLE,
+            ARG_POINTER,
+            ARG_STRING
+        };
+
+        uint64_t timeUs;        // wall clock (us since the unix epoch)
+        const char *file;
+        const char *func;
+        const char *format;
+        int line;
+        uint32_t suppressed;    // records of the same site suppressed before this one
+        uint8_t level;
+        uint8_t argCount;
+        uint16_t argBytes;
+        uint8_t args[RECORD_ARG_BYTES];
+    };
+
+    /**
+     * Starts the thread writing the log. Until it runs, and after stop(), records
+     * are written by the logging thread itself. Termination signals should already
+     * be blocked (see signalHandler::blockSignals()), the thread inherits the mask.
+     * The log is flushed and the thread stopped at exit.
+     */
+    void start();
+
+    /**
+     * Writes the records still queued and stops the writer thread.
+     */
+    void stop();
+
+    /**
+     * @brief Timestamps the record and queues it for the writer thread. Never blocks
+     * while the writer runs; records which do not fit the thread's ring are dropped,
+     * counted and reported by the writer.
+     */
+    void submit(logRecord &record);
+
+    inline void _capture(logRecord &record, uint8_t tag, const void *value, int size)
+    {
+        if (record.argBytes + 1 + size > RECORD_ARG_BYTES)
+            return;
+        record.args[record.argBytes] = tag;
+        memcpy(record.args + record.argBytes + 1, value, size);
+        record.argBytes += 1 + size;
+        record.argCount++;
+    }
+
+    inline void _capture(logRecord &record, const char *str)
+    {
+        if (!str)
+            str = "(null)";
+
+        // tag, length, then the characters, cut to what is left of the record
+        int room = RECORD_ARG_BYTES - record.argBytes - 3;
+        if (room < 0)
+            return;
+        size_t len = strnlen(str, room);
+        uint16_t len16 = (uint16_t)len;
+
+        record.args[record.argBytes] = logRecord::ARG_STRING;
+        memcpy(record.args + record.argBytes + 1, &len16, sizeof(len16));
+        memcpy(record.args + record.argBytes + 3, str, len);
+        record.argBytes += 3 + len;
+        record.argCount++;
+    }
+
+    inline void _capture(logRecord &record, char *str) { _capture(record, (const char *)str); }
+    inline void _capture(logRecord &record, std::nullptr_t) { _capture(record, (const char *)nullptr); }
+
+    template<typename T>
+    inline void _capture(logRecord &record, T value)
+    {
+        if constexpr (std::is_enum<T>::value) {
+            _capture(record, (typename std::underlying_type<T>::type)value);
+        } else if constexpr (std::is_floating_point<T>::value) {
+            double v = value;
+            _capture(record, logRecord::ARG_DOUBLE, &v, sizeof(v));
+        } else if constexpr (std::is_integral<T>::value && std::is_signed<T>::value) {
+            int64_t v = value;
+            _capture(record, logRecord::ARG_SIGNED, &v, sizeof(v));
+        } else if constexpr (std::is_integral<T>::value) {
+            uint64_t v = value;
+            _capture(record, logRecord::ARG_UNSIGNED, &v, sizeof(v));
+        } else {
+            static_assert(std::is_pointer<T>::value, "log arguments must be numbers, strings or pointers");
+            const void *v = (const void *)value;
+            _capture(record, logRecord::ARG_POINTER, &v, sizeof(v));
+        }
+    }
+
+    /**
+     * @brief Logs a printf style message. The arguments are captured as they are and
+     * only formatted by the writer thread, off the caller's path. Called through the
+     * macros, which check the level and the site's rate limit first.
+     */
+    template<typename... Args>
+    void log(LogLevel level, uint32_t suppressed, const char *file, int line, const char *func, const char *message, Args... args)
+    {
+        logRecord record;
+        record.file = file;
+        record.func = func;
+        record.format = message;
+        record.line = line;
+        record.suppressed = suppressed;
+        record.level = level;
+        record.argCount = 0;
+        record.argBytes = 0;
+        (_capture(record, args), ...);
+        submit(record);
+    }
 
 }; // namespace b3
 
@@ -32,5 +228,10 @@ namespace _logger {
 # define ERROR(MESSAGE, ...)
 
 #define SET_VERBOSE_LOGGING(VERBOSE)
+
+namespace _logger {
+    inline void start() {}
+    inline void stop() {}
+};
 #endif
 
@@ -0,0 +1,131 @@
+#include "metrics.h"
+
+extern "C" {
+#include <pthread.h>
+#include <time.h>
+}
+
+#include <atomic>
+#include <cstdio>
+
+#include "logger.h"
+
+using namespace b3;
+using namespace metricsDefaults;
+using namespace std;
+
+namespace {
+    const char *METRIC_NAMES[] = { "chunk_us", "decode_us", "sink_write_us", "gpio_jitter_us", "frame_wait_us" };
+    static_assert(sizeof(METRIC_NAMES) / sizeof(METRIC_NAMES[0]) == _metricCount, "every metric needs a name");
+
+    latencyHistogram g_histograms[_metricCount];
+
+    struct threadClock {
+        char name[16];
+        clockid_t clock;            // the thread's CPU clock, readable from other threads
+        atomic<uint64_t> doneNs;    // CPU time the thread ended with, 0 while it runs
+        atomic<bool> ready;
+    };
+
+    threadClock g_threads[MAX_THREADS];
+    atomic<int> g_threadCount(0);
+    thread_local threadClock *t_thread;
+
+    uint64_t clockNs(clockid_t clock)
+    {
+        struct timespec ts;
+        if (clock_gettime(clock, &ts) != 0)
+            return 0;
+        return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+
+    /**
+     * @return the CPU time of a registered thread (ns), 0 if it is not known
+     */
+    uint64_t threadCpuNs(const threadClock &thread)
+    {
+        uint64_t doneNs = thread.doneNs.load(memory_order_acquire);
+        return doneNs ? doneNs : clockNs(thread.clock);
+    }
+};
+
+void metrics::record(metric m, uint64_t us)
+{
+    g_histograms[m].record(us);
+}
+
+const latencyHistogram &metrics::histogram(metric m)
+{
+    return g_histograms[m];
+}
+
+void metrics::registerThread()
+{
+    if (t_thread)
+        return;
+
+    int ndx = g_threadCount.fetch_add(1, memory_order_relaxed);
+    if (ndx >= MAX_THREADS) {
+        WARNING("Too many threads to account their CPU time");
+        return;
+    }
+
+    threadClock &thread = g_threads[ndx];
+    if (pthread_getname_np(pthread_self(), thread.name, sizeof(thread.name)) != 0)
+        snprintf(thread.name, sizeof(thread.name), "thread%d", ndx);
+    if (pthread_getcpuclockid(pthread_self(), &thread.clock) != 0)
+        thread.clock = CLOCK_THREAD_CPUTIME_ID;
+    thread.doneNs.store(0, memory_order_relaxed);
+    thread.ready.store(true, memory_order_release);
+    t_thread = &thread;
+}
+
+void metrics::threadDone()
+{
+    if (t_thread)
+        t_thread->doneNs.store(max<uint64_t>(clockNs(CLOCK_THREAD_CPUTIME_ID), 1), memory_order_release);
+}
+
+std::string metrics::format()
+{
+    std::string out;
+    char field[96];
+
+    for (int m = 0; m < _metricCount; m++) {
+        latencyHistogram::summary s = g_histograms[m].summarize();
+        snprintf(field, sizeof(field), "%s%s=%llu/%llu/%llu/%llu/%llu", out.empty() ? "" : " ", METRIC_NAMES[m],
+                 (unsigned long long)s.count, (unsigned long long)s.p50, (unsigned long long)s.p99,
+                 (unsigned long long)s.p999, (unsigned long long)s.max);
+        out += field;
+    }
+
+    int count = min(g_threadCount.load(memory_order_relaxed), MAX_THREADS);
+    for (int t = 0; t < count; t++) {
+        if (!g_threads[t].ready.load(memory_order_acquire))
+            continue;
+        snprintf(field, sizeof(field), " cpu_%s=%.3f", g_threads[t].name, threadCpuNs(g_threads[t]) / 1e9);
+        out += field;
+    }
+
+    snprintf(field, sizeof(field), " cpu_total=%.3f", clockNs(CLOCK_PROCESS_CPUTIME_ID) / 1e9);
+    out += field;
+    return out;
+}
+
+void metrics::report()
+{
+    for (int m = 0; m < _metricCount; m++) {
+        latencyHistogram::summary s = g_histograms[m].summarize();
+        if (!s.count)
+            continue;
+        INFO("%-15s %8llu samples, p50 %6llu us, p99 %6llu us, p99.9 %6llu us, max %6llu us", METRIC_NAMES[m],
+             (unsigned long long)s.count, (unsigned long long)s.p50, (unsigned long long)s.p99,
+             (unsigned long long)s.p999, (unsigned long long)s.max);
+    }
+
+    int count = min(g_threadCount.load(memory_order_relaxed), MAX_THREADS);
+    for (int t = 0; t < count; t++) {
+        if (g_threads[t].ready.load(memory_order_acquire))
+            INFO("%-15s %8.3f s CPU", g_threads[t].name, threadCpuNs(g_threads[t]) / 1e9);
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "latencyHistogram.h"
+
+namespace b3 {
+    namespace metricsDefaults {
+        // threads whose CPU time is accounted, later ones are not
+        constexpr int MAX_THREADS = 8;
+    };
+
+    // latencies recorded since start up, all in us
+    enum metric {
+        METRIC_CHUNK,           // processing one chunk, from decoding to handing it to the GPIO thread
+        METRIC_DECODE,          // decoding and resampling one chunk
+        METRIC_SINK_WRITE,      // waiting for and writing to the audio sink, per chunk
+        METRIC_GPIO_JITTER,     // GPIO control tick wake-up lateness
+        METRIC_FRAME_WAIT,      // a frame's time in the frame ring before the GPIO thread takes it
+
+        _metricCount
+    };
+
+    /**
+     * Latency histograms of the playback pipeline and the CPU time of its
+     * threads, for sizing boards and chunk settings. Recording is lock free and
+     * never allocates, so it may happen on the real-time threads.
+     */
+    namespace metrics {
+
+        /**
+         * Records one latency.
+         *
+         * @param m The metric.
+         * @param us The latency (us).
+         */
+        void record(metric m, uint64_t us);
+
+        /**
+         * @return the histogram of a metric.
+         */
+        const latencyHistogram &histogram(metric m);
+
+        /**
+         * Accounts the CPU time of the calling thread (CLOCK_THREAD_CPUTIME_ID)
+         * under its current name, see pthread_setname_np().
+         */
+        void registerThread();
+
+        /**
+         * Keeps the CPU time of the calling thread, registered before, once it
+         * stopped running. Called last thing on the thread.
+         */
+        void threadDone();
+
+        /**
+         * @return every metric as "<name>=<count>/<p50>/<p99>/<p99.9>/<max>" and
+         *         the CPU time of every thread as "cpu_<thread>=<seconds>",
+         *         separated by blanks.
+         */
+        std::string format();
+
+        /**
+         * Logs every metric and the CPU time of every thread.
+         */
+        void report();
+    };
+}; // namespace b3
@@ -0,0 +1,196 @@
+#include "motorController.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+
+#include "logger.h"
+
+using namespace b3;
+
+static inline uint32_t pinBit(int pin) {
+    return 1u << pin;
+}
+
+// Fraction of the running duty range for each curve step, built once
+static const struct dutyCurve {
+    float steps[motorDefaults::DUTY_CURVE_SIZE];
+
+    dutyCurve() {
+        for (int i = 0; i < motorDefaults::DUTY_CURVE_SIZE; ++i) {
+            steps[i] = powf((float) i / (motorDefaults::DUTY_CURVE_SIZE - 1), motorDefaults::DUTY_CURVE_GAMMA);
+        }
+    }
+} g_dutyCurve;
+
+motorController::motorController() : writtenBodyDuty(0),
+                                     writtenMouthDuty(0),
+                                     m_fish(-1),
+                                     m_directionMask(0),
+                                     m_lastFlipUs(0) {
+    memset(m_pins, -1, sizeof(m_pins));
+    m_body.learnedThreshold = 0;
+    m_mouth.learnedThreshold = 0;
+    reset();
+}
+
+int motorController::setup(int fish, const int* pins) {
+    const fishPin directionPins[] = { FISH_BODY_A, FISH_BODY_B, FISH_MOUTH_A, FISH_MOUTH_B };
+
+    m_fish = fish;
+    m_directionMask = 0;
+
+    for (int i = 0; i < _fishPinCount; ++i) {
+        if (pins[i] < 0) {
+            ERROR("Fish %d has no pin %d assigned", fish, i);
+            return -1;
+        }
+    }
+
+    // direction pins are written through the bank 0 set/clear registers
+    for (fishPin p : directionPins) {
+        if (pins[p] >= 32) {
+            ERROR("Fish %d direction pin %d is not in bank 0", fish, pins[p]);
+            return -1;
+        }
+
+        m_directionMask |= pinBit(pins[p]);
+    }
+
+    memcpy(m_pins, pins, sizeof(m_pins));
+    reset();
+    return 0;
+}
+
+void motorController::reset() {
+    for (motorDrive* drive : { &m_body, &m_mouth }) {
+        drive->envelope = 0.0f;
+        drive->active = false;
+        drive->duty = 0;
+    }
+
+    m_lastUpdateUs = 0;
+    m_flip = 0;
+    m_idleSinceUs = 0;
+}
+
+void motorController::skipTime(uint64_t us) {
+    for (uint64_t* t : { &m_lastUpdateUs, &m_idleSinceUs, &m_lastFlipUs }) {
+        if (*t) {
+            *t += us;
+        }
+    }
+}
+
+void motorController::seedThresholds(int body, int mouth) {
+    m_body.learnedThreshold = body;
+    m_mouth.learnedThreshold = mouth;
+}
+
+int motorController::_learnThreshold(motorDrive& drive, int rms, int configured, uint64_t dtUs, const b3Config& config) {
+    double p = config.AUTO_THRESHOLD_PCT / 100.0;
+
+    if (drive.levels.quantile() != p) {
+        drive.levels.reset(p);
+    }
+
+    drive.levels.add(rms);
+
+    // start from the seed or the configured threshold, never jump to the first estimates
+    if (drive.learnedThreshold <= 0) {
+        drive.learnedThreshold = configured;
+    }
+
+    if (drive.levels.count() >= p2Quantile::MARKER_COUNT) {
+        float target = drive.levels.value();
+        float maxStep = drive.learnedThreshold * config.AUTO_THRESHOLD_RATE_PCT / 100.0f * dtUs / 1000000.0f;
+        float step = target - drive.learnedThreshold;
+
+        step = step > maxStep ? maxStep : (step < -maxStep ? -maxStep : step);
+        drive.learnedThreshold += step;
+
+        if (drive.learnedThreshold < motorDefaults::MIN_AUTO_THRESHOLD) {
+            drive.learnedThreshold = motorDefaults::MIN_AUTO_THRESHOLD;
+        }
+    }
+
+    return (int) drive.learnedThreshold;
+}
+
+bool motorController::_hysteresis(bool active, float level, int threshold, int hysteresisPct) {
+    if (active) {
+        return level > threshold * (100 - hysteresisPct) / 100;
+    }
+
+    return level > threshold;
+}
+
+void motorController::_drive(motorDrive& drive, int rms, int threshold, int maxDuty, uint64_t dtUs, const b3Config& config) {
+    // one pole smoothing, the time constant depends on the direction of the change
+    float tauUs = (rms > drive.envelope ? config.ATTACK_MS : config.RELEASE_MS) * 1000.0f;
+    float alpha = (dtUs == 0 || tauUs <= 0) ? 1.0f : dtUs / (tauUs + dtUs);
+
+    drive.envelope += alpha * (rms - drive.envelope);
+    drive.active = _hysteresis(drive.active, drive.envelope, threshold, config.HYSTERESIS_PCT);
+
+    if (!drive.active || threshold <= 0) {
+        drive.duty = 0;
+        return;
+    }
+
+    float position = (drive.envelope / threshold - 1.0f) / (motorDefaults::DUTY_CURVE_FULL_SCALE - 1.0f);
+    int step = (int) (position * (motorDefaults::DUTY_CURVE_SIZE - 1));
+    step = step < 0 ? 0 : (step >= motorDefaults::DUTY_CURVE_SIZE ? motorDefaults::DUTY_CURVE_SIZE - 1 : step);
+
+    int duty = motorDefaults::MIN_DUTY + (int) (g_dutyCurve.steps[step] * (maxDuty - motorDefaults::MIN_DUTY));
+
+    // starting, stopping and reaching full scale always go through, small corrections do not
+    if (drive.duty == 0 || duty == maxDuty || abs(duty - drive.duty) >= config.DUTY_DEADBAND) {
+        drive.duty = duty;
+    }
+}
+
+uint32_t motorController::update(int rmsLpf, int rmsHpf, uint64_t now, const b3Config& config, uint32_t levels) {
+    //DEBUG("fish %d handling [%d %d] vs threshold [%d %d]", m_fish, rmsLpf, rmsHpf, config.bodyThreshold(m_fish), config.mouthThreshold(m_fish));
+
+    uint64_t dtUs = (m_lastUpdateUs && now > m_lastUpdateUs) ? now - m_lastUpdateUs : 0;
+    m_lastUpdateUs = now;
+
+    int bodyThreshold = config.bodyThreshold(m_fish);
+    int mouthThreshold = config.mouthThreshold(m_fish);
+
+    if (config.AUTO_THRESHOLD) {
+        bodyThreshold = _learnThreshold(m_body, rmsLpf, bodyThreshold, dtUs, config);
+        mouthThreshold = _learnThreshold(m_mouth, rmsHpf, mouthThreshold, dtUs, config);
+    }
+
+    _drive(m_body, rmsLpf, bodyThreshold, motorDefaults::BODY_MAX_DUTY, dtUs, config);
+    _drive(m_mouth, rmsHpf, mouthThreshold, motorDefaults::MOUTH_MAX_DUTY, dtUs, config);
+
+    // direction pins keep their level while a motor is idle
+    if (m_body.active) {
+        levels &= ~(pinBit(m_pins[FISH_BODY_A]) | pinBit(m_pins[FISH_BODY_B]));
+        levels |= pinBit(m_flip ? m_pins[FISH_BODY_B] : m_pins[FISH_BODY_A]);
+
+        m_idleSinceUs = 0;
+    } else {
+        if (!m_idleSinceUs) {
+            m_idleSinceUs = now;
+        }
+
+        if (now - m_idleSinceUs > motorDefaults::FLIP_IDLE_US) {
+            if ((now - m_lastFlipUs) / 1000 > (uint64_t) config.FLIP_INTERVAL_MS) {
+                m_flip ^= 1;
+                m_lastFlipUs = now;
+            }
+        }
+    }
+
+    if (m_mouth.active) {
+        levels &= ~pinBit(m_pins[FISH_MOUTH_A]);
+        levels |= pinBit(m_pins[FISH_MOUTH_B]);
+    }
+
+    return levels;
+}
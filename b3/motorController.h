@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstdint>
+
+#include "b3Config.h"
+#include "p2Quantile.h"
+
+namespace b3 {
+
+namespace motorDefaults {
+    // PWM duty cycle range of a running motor (0-255); below MIN_DUTY the motors stall
+    constexpr uint8_t MIN_DUTY = 255 * 35 / 100;
+    constexpr uint8_t BODY_MAX_DUTY = 255 * 90 / 100;
+    constexpr uint8_t MOUTH_MAX_DUTY = 255 * 80 / 100;
+
+    // Envelope to duty cycle curve. The curve spans envelopes from the
+    // threshold up to FULL_SCALE times the threshold, with a concave shape
+    // so quiet passages still move visibly.
+    constexpr int DUTY_CURVE_SIZE = 256;
+    constexpr float DUTY_CURVE_FULL_SCALE = 4.0f;
+    constexpr float DUTY_CURVE_GAMMA = 0.6f;
+
+    // Pins of the first fish when none are configured
+    constexpr int DEFAULT_PINS[_fishPinCount] = {
+        17,     // FISH_BODY_A
+        27,     // FISH_BODY_B
+        12,     // FISH_BODY_SPEED
+        24,     // FISH_MOUTH_A
+        25,     // FISH_MOUTH_B
+        13,     // FISH_MOUTH_SPEED
+    };
+
+    // Learned thresholds never fall below this, so silence does not arm the motors
+    constexpr int MIN_AUTO_THRESHOLD = 500;
+
+    // Time the body must stay idle before it may flip direction (us)
+    constexpr uint64_t FLIP_IDLE_US = 1000000 / 80;
+} // namespace motorDefaults
+
+/**
+ * Control state of one fish. Turns the envelopes of its audio lanes into
+ * requested direction pin levels and PWM duty cycles once per control tick;
+ * the GPIO service batches the requests of all controllers into one write.
+ *
+ * Each motor smooths its RMS input with separate attack and release time
+ * constants, then maps the envelope through a lookup curve to a duty cycle.
+ * Duty changes smaller than the configured deadband are not requested.
+ *
+ * In auto-threshold mode each envelope also feeds a streaming quantile
+ * estimate; the thresholds follow the configured percentile, moving at most
+ * AUTO_THRESHOLD_RATE_PCT percent per second.
+ */
+class motorController {
+   public:
+    motorController();
+
+    /**
+     * Assigns the controller to a fish.
+     *
+     * @param fish The fish index, used to look up routing and thresholds.
+     * @param pins The pin map, indexed by fishPin.
+     * @return 0 on success, nonzero if the pin map cannot be driven.
+     */
+    int setup(int fish, const int* pins);
+
+    /**
+     * Runs one control tick.
+     *
+     * @param rmsLpf The RMS value of the low-pass filtered audio.
+     * @param rmsHpf The RMS value of the high-pass filtered audio.
+     * @param now The current time (us since epoch).
+     * @param config The configuration instance.
+     * @param levels The requested bank 0 pin levels so far.
+     * @return levels with this controller's direction pins updated.
+     */
+    uint32_t update(int rmsLpf, int rmsHpf, uint64_t now, const b3Config& config, uint32_t levels);
+
+    /**
+     * Parks the motors and forgets all motion state. Learned thresholds are kept.
+     */
+    void reset();
+
+    /**
+     * Moves the motion timestamps forward, so time spent paused does not
+     * count as elapsed between two control ticks. Envelopes are kept.
+     *
+     * @param us The pause length (us).
+     */
+    void skipTime(uint64_t us);
+
+    /**
+     * Sets the starting point of the learned thresholds, e.g. from a previous run.
+     */
+    void seedThresholds(int body, int mouth);
+
+    // learned thresholds, 0 until the first auto-threshold tick
+    inline int learnedBodyThreshold() const { return (int) m_body.learnedThreshold; }
+    inline int learnedMouthThreshold() const { return (int) m_mouth.learnedThreshold; }
+
+    inline int fish() const { return m_fish; }
+    inline int pin(fishPin p) const { return m_pins[p]; }
+    inline uint32_t directionMask() const { return m_directionMask; }
+
+    // requested duty cycles, valid after update()
+    inline int bodyDuty() const { return m_body.duty; }
+    inline int mouthDuty() const { return m_mouth.duty; }
+
+    // smoothed levels and motor states, valid after update()
+    inline int bodyEnvelope() const { return (int) m_body.envelope; }
+    inline int mouthEnvelope() const { return (int) m_mouth.envelope; }
+    inline bool bodyActive() const { return m_body.active; }
+    inline bool mouthActive() const { return m_mouth.active; }
+
+    // duty cycles last written to the hardware, maintained by the GPIO service
+    int writtenBodyDuty;
+    int writtenMouthDuty;
+
+   private:
+    // drive state of one motor
+    struct motorDrive {
+        float envelope;
+        bool active;
+        int duty;
+
+        p2Quantile levels;
+        float learnedThreshold;
+    };
+
+    /**
+     * Feeds a motor's RMS input to its quantile estimate and moves the learned threshold towards it.
+     *
+     * @return the threshold to use for this tick.
+     */
+    static int _learnThreshold(motorDrive& drive, int rms, int configured, uint64_t dtUs, const b3Config& config);
+
+    /**
+     * Applies a hysteresis band to a motor activation threshold.
+     */
+    static bool _hysteresis(bool active, float level, int threshold, int hysteresisPct);
+
+    /**
+     * Advances a motor's envelope by one control tick and updates its requested duty cycle.
+     *
+     * @param drive The motor to update.
+     * @param rms The RMS value of the motor's audio lane.
+     * @param threshold The activation threshold.
+     * @param maxDuty The duty cycle at full scale.
+     * @param dtUs The time since the last control tick (us), 0 on the first tick.
+     * @param config The configuration instance.
+     */
+    static void _drive(motorDrive& drive, int rms, int threshold, int maxDuty, uint64_t dtUs, const b3Config& config);
+
+    int m_fish;
+    int m_pins[_fishPinCount];
+    uint32_t m_directionMask;
+
+    motorDrive m_body;
+    motorDrive m_mouth;
+    uint64_t m_lastUpdateUs;
+
+    // body direction flipping
+    int m_flip;
+    uint64_t m_idleSinceUs;
+    uint64_t m_lastFlipUs;
+}; // class motorController
+
+}  // namespace b3
@@ -0,0 +1,107 @@
+#include "p2Quantile.h"
+
+#include <algorithm>
+
+using namespace b3;
+
+void p2Quantile::reset(double p)
+{
+    m_p = p;
+    m_count = 0;
+
+    for (int i = 0; i < MARKER_COUNT; i++) {
+        m_heights[i] = 0;
+        m_positions[i] = i;
+    }
+
+    m_desired[0] = 0;
+    m_desired[1] = 2 * p;
+    m_desired[2] = 4 * p;
+    m_desired[3] = 2 + 2 * p;
+    m_desired[4] = 4;
+
+    m_increments[0] = 0;
+    m_increments[1] = p / 2;
+    m_increments[2] = p;
+    m_increments[3] = (1 + p) / 2;
+    m_increments[4] = 1;
+}
+
+void p2Quantile::add(double x)
+{
+    // collect the first observations as the initial marker heights
+    if (m_count < MARKER_COUNT) {
+        m_heights[m_count++] = x;
+        if (m_count == MARKER_COUNT)
+            std::sort(m_heights, m_heights + MARKER_COUNT);
+        return;
+    }
+
+    // find the cell holding x, extending the extreme markers if needed
+    int k;
+    if (x < m_heights[0]) {
+        m_heights[0] = x;
+        k = 0;
+    } else if (x >= m_heights[4]) {
+        m_heights[4] = x;
+        k = 3;
+    } else {
+        k = 0;
+        while (x >= m_heights[k + 1])
+            k++;
+    }
+
+    for (int i = k + 1; i < MARKER_COUNT; i++)
+        m_positions[i] += 1;
+    for (int i = 0; i < MARKER_COUNT; i++)
+        m_desired[i] += m_increments[i];
+
+    // move the middle markers towards their desired positions
+    for (int i = 1; i < MARKER_COUNT - 1; i++) {
+        double d = m_desired[i] - m_positions[i];
+
+        if ((d >= 1 && m_positions[i + 1] - m_positions[i] > 1) ||
+            (d <= -1 && m_positions[i - 1] - m_positions[i] < -1)) {
+            int step = d > 0 ? 1 : -1;
+            double h = _parabolic(i, step);
+
+            if (h <= m_heights[i - 1] || h >= m_heights[i + 1])
+                h = _linear(i, step);
+
+            m_heights[i] = h;
+            m_positions[i] += step;
+        }
+    }
+
+    m_count++;
+}
+
+double p2Quantile::value() const
+{
+    if (m_count == 0)
+        return 0;
+
+    if (m_count < MARKER_COUNT) {
+        double sorted[MARKER_COUNT];
+        std::copy(m_heights, m_heights + m_count, sorted);
+        std::sort(sorted, sorted + m_count);
+        return sorted[(int)(m_p * (m_count - 1) + 0.5)];
+    }
+
+    return m_heights[2];
+}
+
+double p2Quantile::_parabolic(int i, int d) const
+{
+    const double *q = m_heights;
+    const double *n = m_positions;
+
+    return q[i] + d / (n[i + 1] - n[i - 1]) *
+        ((n[i] - n[i - 1] + d) * (q[i + 1] - q[i]) / (n[i + 1] - n[i]) +
+         (n[i + 1] - n[i] - d) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+}
+
+double p2Quantile::_linear(int i, int d) const
+{
+    return m_heights[i] + d * (m_heights[i + d] - m_heights[i]) / (m_positions[i + d] - m_positions[i]);
+}
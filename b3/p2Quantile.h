@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+
+namespace b3 {
+    /**
+     * @brief
+     * Streaming estimate of a single quantile using the P-square algorithm
+     * (Jain & Chlamtac). Keeps five markers whose heights are adjusted with
+     * a piecewise-parabolic fit as observations arrive, so memory and time
+     * per observation are constant.
+     */
+    class p2Quantile {
+    public:
+        /**
+         * @param p The quantile to track, in (0, 1).
+         */
+        p2Quantile(double p = 0.5) { reset(p); }
+
+        /**
+         * @brief Forgets all observations and tracks a new quantile.
+         * @param p The quantile to track, in (0, 1).
+         */
+        void reset(double p);
+
+        /**
+         * @brief Adds one observation.
+         */
+        void add(double x);
+
+        /**
+         * @return The current quantile estimate, 0 if nothing was observed yet.
+         */
+        double value() const;
+
+        inline double quantile() const { return m_p; }
+        inline uint64_t count() const { return m_count; }
+
+        // observations needed before the markers are in use
+        static constexpr int MARKER_COUNT = 5;
+
+    private:
+        double _parabolic(int i, int d) const;
+        double _linear(int i, int d) const;
+
+        double m_p;
+        uint64_t m_count;
+
+        double m_heights[MARKER_COUNT];     // marker heights
+        double m_positions[MARKER_COUNT];   // actual marker positions
+        double m_desired[MARKER_COUNT];     // desired marker positions
+        double m_increments[MARKER_COUNT];  // desired position increment per observation
+    }; // class p2Quantile
+}; // namespace b3
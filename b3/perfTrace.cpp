@@ -0,0 +1,187 @@
+#include "perfTrace.h"
+
+extern "C" {
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+}
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "logger.h"
+
+using namespace b3;
+using namespace perfTraceDefaults;
+using namespace std;
+
+bool perfTrace::g_enabled = false;
+
+namespace {
+    struct traceSpan {
+        const char *name;
+        uint64_t beginNs;
+        uint64_t endNs;
+    };
+
+    // written by its thread only, read by the dump while it records
+    struct threadBuffer {
+        pid_t tid;
+        char name[16];              // taken on the first span, threads name themselves first
+        atomic<uint64_t> count;     // spans recorded, the last SPANS_PER_THREAD are kept
+        traceSpan spans[SPANS_PER_THREAD];
+    };
+
+    threadBuffer *g_buffers;
+    atomic<int> g_threadCount(0);
+    thread_local threadBuffer *t_buffer;
+    thread_local bool t_untraced;
+
+    string g_path;
+    mutex g_dumpMutex;
+    thread g_dumpThread;
+    atomic<bool> g_dumping(false);
+
+    int writeTrace()
+    {
+        // the threads keep recording, spans overwritten while they are copied are left out
+        vector<traceSpan> spans;
+        vector<pair<const threadBuffer *, size_t>> threads;    // index of the first span of each
+        int threadCount = min(g_threadCount.load(memory_order_acquire), MAX_THREADS);
+
+        for (int t = 0; t < threadCount; t++) {
+            threadBuffer &buffer = g_buffers[t];
+            uint64_t end = buffer.count.load(memory_order_acquire);
+            uint64_t begin = end > SPANS_PER_THREAD ? end - SPANS_PER_THREAD : 0;
+            if (!end)
+                continue;   // claimed, the thread id is published with the first span
+
+            threads.push_back({ &buffer, spans.size() });
+            size_t first = spans.size();
+            for (uint64_t i = begin; i < end; i++)
+                spans.push_back(buffer.spans[i % SPANS_PER_THREAD]);
+
+            // the slot of the span being recorded counts as overwritten as well
+            uint64_t now = buffer.count.load(memory_order_acquire) + 1;
+            uint64_t overwritten = now > SPANS_PER_THREAD ? now - SPANS_PER_THREAD : 0;
+            if (overwritten > begin)
+                spans.erase(spans.begin() + first, spans.begin() + first + min<uint64_t>(overwritten - begin, end - begin));
+        }
+
+        string tmpPath = g_path + ".tmp";
+        FILE *f = fopen(tmpPath.c_str(), "w");
+        if (!f) {
+            ERROR("Failed to open %s: %s", tmpPath.c_str(), strerror(errno));
+            return -1;
+        }
+
+        int pid = getpid();
+        fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"b3\"}}", pid);
+
+        for (size_t t = 0; t < threads.size(); t++) {
+            pid_t tid = threads[t].first->tid;
+            size_t end = t + 1 < threads.size() ? threads[t + 1].second : spans.size();
+
+            fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    pid, (int)tid, threads[t].first->name);
+
+            // complete events, in us with ns precision
+            for (size_t i = threads[t].second; i < end; i++) {
+                const traceSpan &s = spans[i];
+                fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%llu.%03u,\"dur\":%llu.%03u}",
+                        s.name, pid, (int)tid,
+                        (unsigned long long)(s.beginNs / 1000), (unsigned)(s.beginNs % 1000),
+                        (unsigned long long)((s.endNs - s.beginNs) / 1000), (unsigned)((s.endNs - s.beginNs) % 1000));
+            }
+        }
+        fprintf(f, "\n]}\n");
+
+        if (fclose(f) != 0 || rename(tmpPath.c_str(), g_path.c_str()) != 0) {
+            ERROR("Failed to write %s: %s", g_path.c_str(), strerror(errno));
+            return -1;
+        }
+
+        INFO("Wrote %zu spans of %zu threads to %s", spans.size(), threads.size(), g_path.c_str());
+        return 0;
+    }
+};
+
+int perfTrace::enable(const char *path)
+{
+    g_buffers = new (nothrow) threadBuffer[MAX_THREADS];
+    if (!g_buffers) {
+        ERROR("Failed to allocate the span buffers");
+        return -1;
+    }
+
+    g_path = path;
+    g_enabled = true;
+    INFO("Recording spans, SIGUSR1 writes them to %s", path);
+    return 0;
+}
+
+bool perfTrace::enabled()
+{
+    return g_enabled;
+}
+
+void perfTrace::record(const char *name, uint64_t beginNs, uint64_t endNs)
+{
+    // a buffer is claimed on the thread's first span
+    threadBuffer *buffer = t_buffer;
+    if (!buffer) {
+        if (t_untraced)
+            return;
+
+        int t = g_threadCount.fetch_add(1, memory_order_relaxed);
+        if (t >= MAX_THREADS) {
+            t_untraced = true;
+            return;
+        }
+
+        buffer = t_buffer = &g_buffers[t];
+        buffer->tid = (pid_t)syscall(SYS_gettid);
+        if (pthread_getname_np(pthread_self(), buffer->name, sizeof(buffer->name)) != 0)
+            snprintf(buffer->name, sizeof(buffer->name), "thread %d", (int)buffer->tid);
+        buffer->count.store(0, memory_order_relaxed);
+    }
+
+    uint64_t n = buffer->count.load(memory_order_relaxed);
+    buffer->spans[n % SPANS_PER_THREAD] = { name, beginNs, endNs };
+    buffer->count.store(n + 1, memory_order_release);
+}
+
+void perfTrace::dumpAsync()
+{
+    if (!g_enabled || g_dumping.exchange(true))
+        return;
+
+    lock_guard<mutex> lock(g_dumpMutex);
+    if (g_dumpThread.joinable())
+        g_dumpThread.join();
+
+    g_dumpThread = thread([]() {
+        pthread_setname_np(pthread_self(), "b3-trace");
+        writeTrace();
+        g_dumping.store(false);
+    });
+}
+
+int perfTrace::dump()
+{
+    if (!g_enabled)
+        return -1;
+
+    lock_guard<mutex> lock(g_dumpMutex);
+    if (g_dumpThread.joinable())
+        g_dumpThread.join();
+    return writeTrace();
+}
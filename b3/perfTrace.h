@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+
+extern "C" {
+#include <time.h>
+}
+
+#ifndef PERF_TRACE_DISABLED
+# define PERF_CONCAT_(A, B) A##B
+# define PERF_CONCAT(A, B) PERF_CONCAT_(A, B)
+// times the rest of the enclosing scope as a span called NAME (a string literal)
+# define PERF_SPAN(NAME) b3::perfTrace::span PERF_CONCAT(_perfSpan, __LINE__)(NAME)
+#else
+# define PERF_SPAN(NAME)
+#endif
+
+namespace b3 {
+    namespace perfTraceDefaults {
+        // threads recording spans, later ones are not traced
+        constexpr int MAX_THREADS = 8;
+
+        // spans kept per thread, the oldest are overwritten (about 8 s of GPIO ticks)
+        constexpr uint32_t SPANS_PER_THREAD = 16384;
+    };
+
+    /**
+     * Records timed spans of the playback pipeline into a buffer per thread and
+     * writes them out in the Chrome trace event format, which Perfetto and
+     * chrome://tracing open. Recording is off unless enable() was called; a
+     * span then costs two clock reads and a store, and never blocks or allocates.
+     */
+    namespace perfTrace {
+
+        /**
+         * Turns recording on and allocates the buffers. Called from main() before
+         * any thread records a span.
+         *
+         * @param path The file dump() writes the trace to.
+         * @return 0 on success, -1 if the buffers could not be allocated.
+         */
+        int enable(const char *path);
+
+        /**
+         * @return true once enable() succeeded.
+         */
+        bool enabled();
+
+        /**
+         * Writes the spans recorded so far to the trace file, from a thread of its
+         * own so the calling thread is not held up. A dump still running is not
+         * started again.
+         */
+        void dumpAsync();
+
+        /**
+         * Writes the spans recorded so far to the trace file, after any dump
+         * started by dumpAsync() finished.
+         *
+         * @return 0 on success, -1 on failure or if recording is off.
+         */
+        int dump();
+
+        /**
+         * Records a finished span on the calling thread's buffer.
+         */
+        void record(const char *name, uint64_t beginNs, uint64_t endNs);
+
+        /**
+         * @return CLOCK_MONOTONIC (ns)
+         */
+        inline uint64_t nowNs()
+        {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+        }
+
+        extern bool g_enabled;
+
+        /**
+         * Times its own lifetime, see PERF_SPAN.
+         */
+        class span {
+        public:
+            inline span(const char *name) :
+                m_name(name),
+                m_beginNs(g_enabled ? nowNs() : 0)
+            {}
+
+            inline ~span()
+            {
+                if (m_beginNs)
+                    record(m_name, m_beginNs, nowNs());
+            }
+
+            span(const span &) = delete;
+            span &operator=(const span &) = delete;
+
+        private:
+            const char *m_name;
+            uint64_t m_beginNs;
+        };
+    };
+}; // namespace b3
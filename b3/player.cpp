@@ -0,0 +1,227 @@
+#include "player.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "logger.h"
+#include "startupTrace.h"
+
+using namespace b3;
+
+player::player(eventLoop &loop, signalProcessor &processor, audioSink *sink) :
+    m_loop(loop),
+    m_processor(processor),
+    m_sink(sink),
+    m_prefetchTimetag(0),
+    m_prefetchResult(-1),
+    m_state(State::STOPPED),
+    m_sinkFdCount(0),
+    m_attached(false)
+{
+    m_processor.setAudioSink(sink);
+}
+
+player::~player()
+{
+    stop();
+}
+
+int player::load(const char *name, uint64_t timetag)
+{
+    if (!name || !name[0])
+        return -1;
+
+    char path[signalProcessingDefaults::FILE_NAME_BUFFER_SIZE];
+    _resolvePath(name, path, sizeof(path));
+
+    // a prefetch only runs while stopped, there is nothing to stop if it opened the file
+    if (!_joinPrefetch(path, timetag)) {
+        stop();
+
+        if (m_file.openFile(path, timetag) != 0) {
+            WARNING("Failed to open %s", path);
+            return -1;
+        }
+    }
+    INFO("Loaded %s", path);
+    if (m_onLoad)
+        m_onLoad(path);
+
+    // opens the sink at the file's rate, audio starts flowing with play()
+    m_processor.setFile(&m_file);
+    m_processor.setState(State::PAUSED);
+    m_state = State::PAUSED;
+    return 0;
+}
+
+void player::prefetch(const char *name, uint64_t timetag)
+{
+    if (!name || !name[0] || m_state != State::STOPPED || m_prefetch.joinable())
+        return;
+
+    _resolvePath(name, m_prefetchPath, sizeof(m_prefetchPath));
+    m_prefetchTimetag = timetag;
+
+    m_prefetch = std::thread([this]() {
+        int phase = startupTrace::begin("file probe");
+        m_prefetchResult = m_file.openFile(m_prefetchPath, m_prefetchTimetag);
+        startupTrace::end(phase);
+    });
+}
+
+int player::play()
+{
+    if (m_state == State::PLAYING)
+        return 0;
+
+    if (m_state == State::STOPPED) {
+        bool loaded = false;
+        while (!loaded && !m_queue.empty()) {
+            std::string name = m_queue.front();
+            m_queue.pop_front();
+            loaded = load(name.c_str()) == 0;
+        }
+        if (!loaded)
+            return -1;
+    }
+
+    m_processor.setState(State::PLAYING);
+    m_state = State::PLAYING;
+    _attachSink();
+    return 0;
+}
+
+void player::pause()
+{
+    if (m_state != State::PLAYING)
+        return;
+
+    _detachSink();
+    m_processor.setState(State::PAUSED);
+    m_state = State::PAUSED;
+}
+
+void player::stop()
+{
+    _joinPrefetch(nullptr, 0);
+    _detachSink();
+    if (m_state != State::STOPPED)
+        m_processor.setState(State::STOPPED);
+    m_file.closeFile();
+    m_state = State::STOPPED;
+}
+
+int player::seek(uint64_t positionUs)
+{
+    if (m_state == State::STOPPED)
+        return -1;
+    return m_file.seekUs(positionUs);
+}
+
+int player::enqueue(const char *name)
+{
+    if (!name || !name[0] || m_queue.size() >= playerDefaults::MAX_QUEUE)
+        return -1;
+
+    m_queue.emplace_back(name);
+    return 0;
+}
+
+int player::next()
+{
+    if (m_queue.empty())
+        return -1;
+
+    bool resume = m_state == State::PLAYING;
+    std::string name = m_queue.front();
+    m_queue.pop_front();
+
+    if (load(name.c_str()) != 0)
+        return -1;
+    return resume ? play() : 0;
+}
+
+void player::_resolvePath(const char *name, char *path, size_t size)
+{
+    if (name[0] == '/')
+        snprintf(path, size, "%s", name);
+    else
+        snprintf(path, size, "%s/%s", audioFileDefaults::AUDIO_FILES_PATH, name);
+}
+
+bool player::_joinPrefetch(const char *path, uint64_t timetag)
+{
+    if (!m_prefetch.joinable())
+        return false;
+
+    m_prefetch.join();
+    if (m_prefetchResult != 0)
+        return false;
+
+    if (path && !strcmp(path, m_prefetchPath) && timetag == m_prefetchTimetag)
+        return true;
+
+    m_file.closeFile();
+    return false;
+}
+
+void player::_pump()
+{
+    m_processor.update(State::PLAYING);
+
+    // the processor closes the file's stream by itself at the end of the file
+    if (m_processor.getState() == State::STOPPED)
+        _endOfFile();
+}
+
+void player::_endOfFile()
+{
+    _detachSink();
+    m_file.closeFile();
+    m_state = State::STOPPED;
+
+    if (play() == 0)
+        return;
+
+    INFO("Queue empty, playback stopped");
+    if (m_onIdle)
+        m_onIdle();
+}
+
+void player::_attachSink()
+{
+    if (m_attached)
+        return;
+
+    struct pollfd fds[audioSinkDefaults::MAX_POLL_FDS];
+    int count = m_sink->pollDescriptors(fds, audioSinkDefaults::MAX_POLL_FDS);
+
+    m_sinkFdCount = 0;
+    for (int i = 0; i < count; i++) {
+        int fd = fds[i].fd;
+        if (m_loop.addFd(fd, fds[i].events, [this, fd](uint32_t events) {
+            if (m_sink->pollReady(fd, events))
+                _pump();
+        }) == 0)
+            m_sinkFds[m_sinkFdCount++] = fd;
+    }
+
+    // sinks without poll descriptors pace themselves by blocking in their writes
+    if (count <= 0)
+        m_loop.setIdle([this]() { _pump(); });
+
+    m_attached = true;
+}
+
+void player::_detachSink()
+{
+    if (!m_attached)
+        return;
+
+    for (int i = 0; i < m_sinkFdCount; i++)
+        m_loop.removeFd(m_sinkFds[i]);
+    m_sinkFdCount = 0;
+    m_loop.setIdle(nullptr);
+
+    m_attached = false;
+}
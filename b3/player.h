@@ -0,0 +1,193 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include "audioFile.h"
+#include "audioSink.h"
+#include "eventLoop.h"
+#include "signalProcessing.h"
+#include "state.h"
+
+namespace b3 {
+    namespace playerDefaults {
+        // files waiting behind the one playing
+        constexpr size_t MAX_QUEUE = 64;
+    };
+
+    /**
+     * @brief
+     * Plays a sequence of audio files. Owns the open file and the queue of files
+     * waiting behind it, drives the signal processor, and hooks the audio sink
+     * into the event loop only while audio plays, so a paused or stopped player
+     * leaves the loop asleep.
+     *
+     * Every method runs on the event loop thread.
+     */
+    class player {
+    public:
+        /**
+         * @param loop The loop the sink readiness is dispatched from.
+         * @param processor Decodes, filters and writes the audio.
+         * @param sink The sink the processor writes to, not owned.
+         */
+        player(eventLoop &loop, signalProcessor &processor, audioSink *sink);
+        ~player();
+
+        /**
+         * @brief Opens a file, replacing the current one. The player is paused at the start
+         * position afterwards.
+         *
+         * @param name The file, relative to audioFileDefaults::AUDIO_FILES_PATH unless absolute.
+         * @param timetag The start position as a decoder timestamp (the seek_time saved at
+         *                shutdown), see audioFile::openFile().
+         * @return 0 on success, -1 on failure.
+         */
+        int load(const char *name, uint64_t timetag = 0);
+
+        /**
+         * @brief Starts opening a file on a helper thread, so probing it overlaps the rest of
+         * the start up. A later load() of the same file and position picks up the open file
+         * instead of probing it again. Does nothing unless the player is stopped.
+         *
+         * @param name The file, as for load().
+         * @param timetag The start position, as for load().
+         */
+        void prefetch(const char *name, uint64_t timetag = 0);
+
+        /**
+         * @brief Starts or resumes playback. Loads the next queued file if none is open.
+         * @return 0 on success, -1 if there is nothing to play.
+         */
+        int play();
+
+        /**
+         * @brief Pauses the sink and the motors in place. The decoder, the filters and the
+         * audio queued in the sink are kept, play() resumes without seeking.
+         */
+        void pause();
+
+        /**
+         * @brief Stops playback and closes the file. The queue is kept.
+         */
+        void stop();
+
+        /**
+         * @brief Moves playback within the current file.
+         * @param positionUs The position (us from the start of the file).
+         * @return 0 on success, -1 on failure.
+         */
+        int seek(uint64_t positionUs);
+
+        /**
+         * @brief Appends a file to the queue, played when the current one ends.
+         * @return 0 on success, -1 if the queue is full or the name is empty.
+         */
+        int enqueue(const char *name);
+
+        /**
+         * @brief Skips to the next queued file, keeping the play/pause state.
+         * @return 0 on success, -1 if the queue is empty or the file could not be opened.
+         */
+        int next();
+
+        /**
+         * @brief Empties the queue.
+         */
+        inline void clearQueue() { m_queue.clear(); }
+
+        /**
+         * @brief Sets a handler called when playback ends because the queue ran empty.
+         */
+        inline void setIdleHandler(std::function<void()> h) { m_onIdle = h; }
+
+        /**
+         * @brief Sets a handler called with the path of every file loaded, before it plays.
+         */
+        inline void setLoadHandler(std::function<void(const char *path)> h) { m_onLoad = h; }
+
+        /**
+         * @return The playback state
+         */
+        inline State state() const { return m_state; }
+
+        /**
+         * @return The path of the open file, empty if none is open
+         */
+        inline const char *fileName() const { return m_file.fileName(); }
+
+        /**
+         * @return The position in the open file (us)
+         */
+        inline uint64_t positionUs() const { return m_file.positionUs(); }
+
+        /**
+         * @return The position in the open file as a decoder timestamp, see load()
+         */
+        inline uint64_t timetag() const { return m_file.getCurrentTimestampUs(); }
+
+        /**
+         * @return The number of queued files
+         */
+        inline size_t queueLength() const { return m_queue.size(); }
+
+    private:
+        /**
+         * @brief Turns a file name as given to load() into a path.
+         */
+        static void _resolvePath(const char *name, char *path, size_t size);
+
+        /**
+         * @brief Waits for a prefetch() to finish.
+         * @return true if it opened path at timetag, the file is kept open then; otherwise
+         *         whatever it opened is closed.
+         */
+        bool _joinPrefetch(const char *path, uint64_t timetag);
+
+        /**
+         * @brief Processes one chunk, and moves on to the next file when the current one ended.
+         */
+        void _pump();
+
+        /**
+         * @brief Dispatches the sink readiness to _pump(), or pumps from the loop's idle
+         * handler if the sink cannot be polled.
+         */
+        void _attachSink();
+
+        /**
+         * @brief Removes the sink from the loop. Must be called before the sink is closed.
+         */
+        void _detachSink();
+
+        /**
+         * @brief Closes the file after the processor stopped and plays the next queued one.
+         */
+        void _endOfFile();
+
+        eventLoop &m_loop;
+        signalProcessor &m_processor;
+        audioSink *m_sink;
+
+        audioFile m_file;
+        std::deque<std::string> m_queue;
+
+        // file being opened by prefetch()
+        std::thread m_prefetch;
+        char m_prefetchPath[signalProcessingDefaults::FILE_NAME_BUFFER_SIZE];
+        uint64_t m_prefetchTimetag;
+        int m_prefetchResult;
+        State m_state;
+
+        // sink descriptors registered with the loop while playing
+        int m_sinkFds[audioSinkDefaults::MAX_POLL_FDS];
+        int m_sinkFdCount;
+        bool m_attached;
+
+        std::function<void()> m_onIdle;
+        std::function<void(const char *path)> m_onLoad;
+    }; // class player
+}; // namespace b3
@@ -0,0 +1,57 @@
+#include "polyphaseDecimator.h"
+
+#include <cmath>
+#include <cstring>
+
+using namespace b3;
+using namespace polyphaseDecimatorDefaults;
+
+void polyphaseDecimator::configure(int factor, int phase)
+{
+    m_factor = factor < 1 ? 1 : (factor > MAX_FACTOR ? MAX_FACTOR : factor);
+    m_tapCount = m_factor * TAPS_PER_PHASE;
+    m_phase = phase % m_factor;
+    m_pos = 0;
+    memset(m_history, 0, sizeof(m_history));
+
+    // sinc at the cutoff, shaped by a Blackman window and normalized to unity gain
+    double cutoff = CUTOFF_RATIO * 0.5 / m_factor;
+    double center = (m_tapCount - 1) / 2.0;
+    double sum = 0;
+
+    for (int k = 0; k < m_tapCount; k++) {
+        double t = k - center;
+        double sinc = t == 0 ? 2 * cutoff : std::sin(2 * M_PI * cutoff * t) / (M_PI * t);
+        double window = m_tapCount == 1 ? 1 : 0.42 - 0.5 * std::cos(2 * M_PI * k / (m_tapCount - 1)) + 0.08 * std::cos(4 * M_PI * k / (m_tapCount - 1));
+        m_taps[k] = sinc * window;
+        sum += m_taps[k];
+    }
+    for (int k = 0; k < m_tapCount; k++)
+        m_taps[k] /= sum;
+}
+
+int polyphaseDecimator::process(const float *in, int count, float *out)
+{
+    if (m_factor == 1) {
+        memcpy(out, in, count * sizeof(float));
+        return count;
+    }
+
+    int written = 0;
+    for (int i = 0; i < count; i++) {
+        m_history[m_pos] = m_history[m_pos + m_tapCount] = in[i];
+        m_pos = m_pos + 1 == m_tapCount ? 0 : m_pos + 1;
+
+        if (++m_phase < m_factor)
+            continue;
+        m_phase = 0;
+
+        // the filter is symmetric, the window runs from the oldest sample
+        const float *window = &m_history[m_pos];
+        float acc = 0.0f;
+        for (int k = 0; k < m_tapCount; k++)
+            acc += m_taps[k] * window[k];
+        out[written++] = acc;
+    }
+    return written;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+
+namespace b3 {
+    namespace polyphaseDecimatorDefaults {
+        // largest supported decimation factor
+        constexpr int MAX_FACTOR = 16;
+
+        // filter taps per phase, i.e. multiplies per input sample
+        constexpr int TAPS_PER_PHASE = 8;
+
+        // anti-aliasing cutoff, as a fraction of the output Nyquist frequency
+        constexpr double CUTOFF_RATIO = 0.8;
+
+        constexpr int MAX_TAPS = MAX_FACTOR * TAPS_PER_PHASE;
+    };
+
+    /**
+     * @brief
+     * Decimates a stream by an integer factor through a windowed-sinc low-pass
+     * FIR. Only the kept outputs are computed (the polyphase form of the filter),
+     * so the cost is TAPS_PER_PHASE multiplies per input sample whatever the
+     * factor. A factor of 1 passes the samples through.
+     */
+    class polyphaseDecimator {
+    public:
+        polyphaseDecimator() { configure(1); }
+
+        /**
+         * @brief Designs the filter for a factor and clears the history.
+         *
+         * @param factor The decimation factor, 1 to MAX_FACTOR.
+         * @param phase The inputs already counted toward the first output, so
+         *              outputs stay aligned with a stream already running.
+         */
+        void configure(int factor, int phase = 0);
+
+        /**
+         * @brief Decimates a block of samples. The filter state carries over between blocks.
+         *
+         * @param in input samples
+         * @param count number of input samples
+         * @param out receives the decimated samples, at most count / factor + 1
+         * @return the number of samples written to out
+         */
+        int process(const float *in, int count, float *out);
+
+        inline int factor() const { return m_factor; }
+
+    private:
+        int m_factor;
+        int m_tapCount;
+        int m_phase;        // inputs since the last output
+        int m_pos;          // oldest sample of the history
+
+        float m_taps[polyphaseDecimatorDefaults::MAX_TAPS];
+
+        // the last m_tapCount inputs, stored twice so the window is always contiguous
+        float m_history[2 * polyphaseDecimatorDefaults::MAX_TAPS];
+    }; // class polyphaseDecimator
+};
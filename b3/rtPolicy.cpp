@@ -0,0 +1,106 @@
+#include "rtPolicy.h"
+
+extern "C" {
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+}
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include "logger.h"
+#include "timeManager.h"
+
+using namespace b3;
+
+int rtPolicy::lockMemory()
+{
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        int err = errno;
+        WARNING("Failed to lock memory (%s), playback may stall on page faults", strerror(err));
+        return err;
+    }
+
+    // keep freed memory in the arena instead of returning it, and never
+    // serve allocations from fresh mmaps, so the pre-faulted pages are reused
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+
+    char *arena = (char *)malloc(rtDefaults::HEAP_PREFAULT_BYTES);
+    if (arena) {
+        long pageSize = sysconf(_SC_PAGESIZE);
+        for (size_t i = 0; i < rtDefaults::HEAP_PREFAULT_BYTES; i += pageSize)
+            arena[i] = 0;
+        free(arena);
+    }
+
+    prefaultStack();
+    INFO("Memory locked, %zu kB heap pre-faulted", rtDefaults::HEAP_PREFAULT_BYTES / 1024);
+    return 0;
+}
+
+int rtPolicy::applyThread(const char *name, const rtThreadConfig &config)
+{
+    pthread_t self = pthread_self();
+    int ret = 0, err;
+
+    pthread_setname_np(self, name);
+
+    if (config.cpuCount > 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (int i = 0; i < config.cpuCount; i++)
+            if (config.cpus[i] >= 0 && config.cpus[i] < CPU_SETSIZE)
+                CPU_SET(config.cpus[i], &cpus);
+
+        if ((err = pthread_setaffinity_np(self, sizeof(cpus), &cpus)) != 0) {
+            WARNING("Failed to pin %s thread to its CPUs: %s", name, strerror(err));
+            ret = err;
+        }
+    }
+
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    int policy = SCHED_OTHER;
+
+    if (config.priority > 0) {
+        int minPriority = sched_get_priority_min(SCHED_FIFO);
+        int maxPriority = sched_get_priority_max(SCHED_FIFO);
+
+        policy = SCHED_FIFO;
+        param.sched_priority = config.priority < minPriority ? minPriority : (config.priority > maxPriority ? maxPriority : config.priority);
+    }
+
+    if ((err = pthread_setschedparam(self, policy, &param)) != 0) {
+        WARNING("Failed to run %s thread under SCHED_FIFO priority %d (%s), using SCHED_OTHER",
+                name, param.sched_priority, strerror(err));
+        ret = err;
+    } else if (policy == SCHED_FIFO) {
+        INFO("%s thread runs under SCHED_FIFO priority %d", name, param.sched_priority);
+    }
+
+    prefaultStack();
+    return ret;
+}
+
+void rtPolicy::prefaultStack()
+{
+    volatile char stack[rtDefaults::STACK_PREFAULT_BYTES];
+    long pageSize = sysconf(_SC_PAGESIZE);
+
+    for (size_t i = 0; i < sizeof(stack); i += pageSize)
+        stack[i] = 0;
+}
+
+uint64_t rtPolicy::sleepUntilUs(uint64_t deadlineUs)
+{
+    systemClock::sleepUntilUs(deadlineUs);
+
+    uint64_t now = timeManager::getUsSinceEpoch();
+    return now > deadlineUs ? now - deadlineUs : 0;
+}
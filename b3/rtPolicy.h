@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "b3Config.h"
+
+namespace b3 {
+    namespace rtDefaults {
+        // stack touched by prefaultStack() in each real-time thread
+        constexpr size_t STACK_PREFAULT_BYTES = 256 * 1024;
+
+        // heap arena faulted in and kept by lockMemory()
+        constexpr size_t HEAP_PREFAULT_BYTES = 8 * 1024 * 1024;
+    };
+
+    /**
+     * @brief
+     * Wake-up lateness of a thread sleeping until deadlines (see rtPolicy::sleepUntilUs()),
+     * i.e. the scheduling latency it sees.
+     */
+    struct wakeupStats {
+        uint64_t count = 0;
+        uint64_t totalUs = 0;
+        uint64_t maxUs = 0;
+
+        inline void add(uint64_t lateUs)
+        {
+            count++;
+            totalUs += lateUs;
+            if (lateUs > maxUs)
+                maxUs = lateUs;
+        }
+
+        inline uint64_t meanUs() const { return count ? totalUs / count : 0; }
+        inline void reset() { *this = wakeupStats(); }
+    };
+
+    namespace rtPolicy {
+
+        /**
+         * Locks the current and future pages of the process in memory and
+         * faults in a heap arena which the allocator keeps afterwards, so
+         * the real-time threads never wait for a page fault.
+         *
+         * @return 0 on success, an errno value if the process may not lock
+         *         memory (playback continues with pageable memory).
+         */
+        int lockMemory();
+
+        /**
+         * Applies a scheduling policy to the calling thread: SCHED_FIFO at the
+         * configured priority (SCHED_OTHER for 0) and the configured CPU set.
+         * Also faults in the thread's stack.
+         *
+         * @param name The thread name, shown by top/ps.
+         * @param config The policy of the thread.
+         * @return 0 if the whole policy was applied, an errno value otherwise
+         *         (the thread keeps running with whatever could be applied).
+         */
+        int applyThread(const char *name, const rtThreadConfig &config);
+
+        /**
+         * Touches rtDefaults::STACK_PREFAULT_BYTES of the calling thread's stack.
+         */
+        void prefaultStack();
+
+        /**
+         * Sleeps until an absolute deadline on the system clock (see systemClock.h).
+         *
+         * @param deadlineUs The deadline (us since epoch, see timeManager).
+         * @return how late the thread woke up (us), 0 if the deadline had already passed.
+         */
+        uint64_t sleepUntilUs(uint64_t deadlineUs);
+    };
+}; // namespace b3
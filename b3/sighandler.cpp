@@ -1,16 +1,29 @@
-
 #include <csignal>
 
+extern "C" {
+#include <pthread.h>
+}
+
 #include "logger.h"
 #include "sighandler.h"
 
 
-volatile int signalHandler::g_shouldExit = 0;
+std::atomic<int> signalHandler::g_shouldExit(0);
 
 void signalHandler::sigintHandler(int sig)
 {
-    if (sig == SIGINT) {
-        INFO("SIGINT received, shutting down..");
+    if (sig == SIGINT || sig == SIGTERM) {
+        INFO("%s received, shutting down..", sig == SIGINT ? "SIGINT" : "SIGTERM");
         g_shouldExit = 1;
     }
 }
+
+int signalHandler::blockSignals()
+{
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGUSR1);
+    return pthread_sigmask(SIG_BLOCK, &set, nullptr);
+}
@@ -1,11 +1,25 @@
 
 #pragma once
 
+#include <atomic>
 
 namespace signalHandler {
 
-    extern volatile int g_shouldExit;
+    extern std::atomic<int> g_shouldExit;
 
+    /**
+     * Handles a termination signal (SIGINT, SIGTERM). Signals are blocked in
+     * every thread and delivered to the event loop through a signalfd, so
+     * this runs in normal context on the main thread.
+     */
     void sigintHandler(int sig);
 
-};
\ No newline at end of file
+    /**
+     * Blocks the termination signals, and SIGUSR1 (see perfTrace), in the calling thread. Threads created
+     * afterwards inherit the mask, so call this before starting any.
+     *
+     * @return 0 on success, an errno value otherwise.
+     */
+    int blockSignals();
+
+};
@@ -1,10 +1,10 @@
 #include "signalProcessing.h"
 
 extern "C" {
-#include <sys/un.h>
 #include <unistd.h>
 }
 
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -13,6 +13,9 @@ extern "C" {
 #include "audioFile.h"
 #include "logger.h"
 #include "sighandler.h"
+#include "startupTrace.h"
+#include "perfTrace.h"
+#include "metrics.h"
 
 
 #define MIN(a,b) (((a) < (b)) ? (a) : (b))
@@ -20,6 +23,35 @@ extern "C" {
 
 using namespace b3;
 
+/**
+ * @brief Accumulates the squares of a band into RMS bins, carrying the partial bin over.
+ *
+ * @param in the band's samples
+ * @param count number of samples
+ * @param binSize samples per bin
+ * @param fill samples already in the partial bin, updated
+ * @param sum sum of the squares in the partial bin, updated
+ * @param out receives the RMS of every completed bin, may be null
+ * @param maxOut capacity of out
+ * @return the number of bins completed
+ */
+static int binEnvelope(const int16_t *in, int count, int binSize, int &fill, uint64_t &sum, int16_t *out, int maxOut)
+{
+    int bins = 0;
+    for (int i = 0; i < count; i++) {
+        sum += (int32_t)in[i] * in[i];
+        if (++fill < binSize)
+            continue;
+
+        if (out && bins < maxOut)
+            out[bins] = (int16_t)MIN(sqrt((double)sum / binSize), 32767.0);
+        bins++;
+        sum = 0;
+        fill = 0;
+    }
+    return bins;
+}
+
 signalProcessor::~signalProcessor()
 {}
 
@@ -27,28 +59,34 @@ signalProcessor::~signalProcessor()
 
 void signalProcessor::update(State state)
 {
+    // the previous snapshot is not referenced past this point
+    m_config = m_configs.refresh(m_configReader);
+
     if (m_activeState != state)
         setState(state);
 
     // update filters
-    setHPF(m_config.HPF_CUTOFF);
-    setLPF(m_config.LPF_CUTOFF);
+    setHPF(m_config->HPF_CUTOFF);
+    setLPF(m_config->LPF_CUTOFF);
 
     if (m_activeState == State::PLAYING && !m_stopCommand) {
 
         uint64_t dt = usToNextChunk();
-        usleep(MIN(dt, m_chunkSizeUs));
 
-        if (m_fillBuffer) {
+        // when event driven, the device only reports readiness once there is room for a chunk
+        if (!m_eventDriven)
+            systemClock::sleepUs(MIN(dt, m_chunkSizeUs));
+
+        if (m_fillBuffer && !m_eventDriven) {
             m_fillBuffer = false;
-            for (int i = 0; i < m_config.BUFFER_LENGTH_MS - 1; i++)
+            for (int i = 0; i < m_config->BUFFER_LENGTH_MS - 1; i++)
                 _processChunk();
         }
         _processChunk();
 
         if (dt == 0) {
-            m_underRunCounter = MIN(m_underRunCounter + 1, m_config.CHUNK_COUNT);
-            if (m_underRunCounter == m_config.BUFFER_LENGTH_MS) {
+            m_underRunCounter = MIN(m_underRunCounter + 1, m_config->CHUNK_COUNT);
+            if (m_underRunCounter == m_config->BUFFER_LENGTH_MS) {
                 m_fillBuffer = true;
                 DEBUG("Possible chunk underrun likely due to process timing: %d uS", m_tm.lastLap());
             }
@@ -79,7 +117,7 @@ void signalProcessor::setState(State to)
             ERROR("audioProcessor - No audio driver loaded");
             return;
         }
-        assert(m_alsaDriver);
+        assert(m_audioSink);
         if (!m_fileLoaded) {
             ERROR("audioProcessor - No audio file loaded");
             return;
@@ -88,8 +126,17 @@ void signalProcessor::setState(State to)
 
         m_chunkTimestamp = m_tm.getUsSinceEpoch();
         m_tm.start();
+        m_statusAudio.maxChunkUs = 0;
         // set flags
         m_stopCommand = 0;
+
+        // a paused sink still holds its queue, the decoder and filters carry on where they stopped
+        if (m_activeState == State::PAUSED) {
+            m_audioSink->setPaused(false);
+            GPIO::setPaused(false);
+            break;
+        }
+
         m_fillBuffer = true;
 #ifdef DEBUG_FILTER_DATA
         m_signalDebugFile = fopen("debugLpf.bin", "wb");
@@ -100,28 +147,108 @@ void signalProcessor::setState(State to)
 
 
     case State::STOPPED:
+        // the queued audio is never heard, neither are the frames held for it
+        GPIO::flush();
+        GPIO::setPaused(false);
         unLoadFile();
-        m_alsaDriver->closeDevice();
+        m_audioSink->closeDevice();
+        m_openedRate = 0;
         break;
     case State::PAUSED:
-        break; // no longer does anything
+        // freeze playout where it is; a file just loaded has nothing queued yet
+        if (m_activeState == State::PLAYING) {
+            m_audioSink->setPaused(true);
+            // a sink which can't hold its queue drops it, the frames for that audio go too
+            if (!m_audioSink->pauseKeepsQueue())
+                GPIO::flush();
+            GPIO::setPaused(true);
+        }
+        break;
 
     }
     INFO("SignalProcessor State Transition: %d\n", m_activeState, to);
     m_activeState = to;
+    _publishStatus();
+    _publishEvents(true);
 }
 
+void signalProcessor::_publishStatus()
+{
+    if (!m_status)
+        return;
+
+    m_statusAudio.updatedUs = m_tm.getUsSinceEpoch();
+    m_statusAudio.state = m_activeState;
+    m_statusAudio.positionUs = m_fileLoaded ? m_audioFile->positionUs() : 0;
+    m_statusAudio.sampleRate = m_fileLoaded ? m_audioFile->getSampleRate() : 0;
+    m_statusAudio.xruns = m_audioSink ? m_audioSink->xrunCount() : 0;
+    m_statusAudio.queueChunks = m_adaptiveLatency ? m_latency.targetChunks() : m_config->CHUNK_COUNT;
+    m_statusAudio.frameQueueDepth = GPIO::frameQueueDepth();
+    m_statusAudio.framesDropped = GPIO::droppedFrames();
+
+    m_status->publishAudio(m_statusAudio);
+}
 
-void signalProcessor::setAudioDriver(audioDriver *driver)
+void signalProcessor::_publishEvents(bool stateChanged)
 {
-    if (!driver) {
-        ERROR("audioProcessor - Null audio driver pointer");
+    if (!m_events || !m_events->active())
         return;
+
+    streamEvent ev = streamEvent();
+    ev.timeUs = m_tm.getUsSinceEpoch();
+    ev.flags = m_activeState;
+    ev.value[0] = m_fileLoaded ? m_audioFile->positionUs() / 1000 : 0;
+
+    if (stateChanged) {
+        ev.type = EVENT_STATE;
+        m_events->push(EVENT_SOURCE_AUDIO, ev);
     }
-    m_alsaDriver = driver;
+
+    ev.type = EVENT_POSITION;
+    ev.value[1] = m_fileLoaded ? m_audioFile->getSampleRate() : 0;
+    ev.value[2] = m_adaptiveLatency ? m_latency.targetChunks() : m_config->CHUNK_COUNT;
+    m_events->push(EVENT_SOURCE_AUDIO, ev);
+
+    uint64_t xruns = m_audioSink ? m_audioSink->xrunCount() : 0;
+    if (xruns != m_eventXruns) {
+        ev = streamEvent();
+        ev.timeUs = m_tm.getUsSinceEpoch();
+        ev.type = EVENT_XRUN;
+        ev.value[0] = (int32_t)xruns;
+        ev.value[1] = (int32_t)(xruns - m_eventXruns);
+        m_events->push(EVENT_SOURCE_AUDIO, ev);
+        m_eventXruns = xruns;
+    }
+}
+
+
+void signalProcessor::setAudioSink(audioSink *sink)
+{
+    if (!sink) {
+        ERROR("audioProcessor - Null audio sink pointer");
+        return;
+    }
+    m_audioSink = sink;
     m_driverLoaded = true;
 }
 
+int signalProcessor::openSink(int sampleRate, int channels)
+{
+    if (!m_driverLoaded) {
+        ERROR("audioProcessor - No audio driver loaded");
+        return -1;
+    }
+
+    int chunkSize = _openSink(sampleRate, channels);
+    if (chunkSize < 0)
+        return -1;
+
+    m_openedRate = sampleRate;
+    m_openedChannels = channels;
+    m_openedChunkSize = chunkSize;
+    return 0;
+}
+
 void signalProcessor::setFile(audioFile *F)
 {
     if (!F) {
@@ -132,40 +259,140 @@ void signalProcessor::setFile(audioFile *F)
         WARNING("File Already Loaded, Unloading previous audio file");
         unLoadFile();
     }
-    if (F->getSampleRate() != SPD::DEFAULT_SAMPLE_RATE)
-        ERROR("File sample rate error: expected %d but got %f", signalProcessingDefaults::DEFAULT_SAMPLE_RATE, F->getSampleRate());
-
-    // assert(F->getSampleRate() == SPD::DEFAULT_SAMPLE_RATE);
-
     m_audioFile = F;
     m_fileLoaded = true;
 
     _negotiateChunkSize();
 
-    // create filters
-    for (int fltrNdx = 0; fltrNdx < biQuadFilter::_filterTypeCount; fltrNdx++)
-        m_filters[fltrNdx] = new biQuadFilter(
-            m_audioFile->getSampleRate(),
-            m_filterSettings[fltrNdx],
-            Q,
-            GAIN,
-            (biQuadFilter::filterType)fltrNdx
-        );
+    // create filters at the negotiated rate, each fish keeps its own filter state
+    for (int fish = 0; fish < m_fishCount; fish++)
+        for (int fltrNdx = 0; fltrNdx < biQuadFilter::_filterTypeCount; fltrNdx++)
+            m_filters[fish][fltrNdx] = new biQuadFilter(
+                m_audioFile->getSampleRate(),
+                m_filterSettings[fltrNdx],
+                Q,
+                GAIN,
+                (biQuadFilter::filterType)fltrNdx
+            );
+
+    _configureDecimation(true);
 }
 
-void signalProcessor::_negotiateChunkSize()
+void signalProcessor::setLPF(float cutoff)
 {
-    // this is the desired chunk size based on the audio file's settings
-    m_chunkSize = m_audioFile->chunkSizeBytes(m_config.CHUNK_SIZE_MS);
-    // see if we can set the alsa drivers to the same settings
-    int chunkSizeFrames = m_chunkSize / m_audioFile->getChannels() / SPD::BYTES_PER_SAMPLE;
+    if (cutoff == m_filterSettings[biQuadFilter::LPF])
+        return;
+
+    m_filterSettings[biQuadFilter::LPF] = cutoff;
+    for (int fish = 0; fish < m_fishCount; fish++)
+        if (m_filters[fish][biQuadFilter::LPF])
+            m_filters[fish][biQuadFilter::LPF]->setCutoff(cutoff);
+
+    if (m_fileLoaded)
+        _configureDecimation(false);
+}
+
+void signalProcessor::_configureDecimation(bool reset)
+{
+    int rate = m_audioFile->getSampleRate();
+
+    // the longest bin which divides the rate and still gives ENVELOPE_RATE_HZ
+    if (reset) {
+        m_binSamples = 1;
+        for (int n = 2; n <= rate / SPD::ENVELOPE_RATE_HZ; n++)
+            if (rate % n == 0)
+                m_binSamples = n;
+
+        // the frame ring is sized for envelopes near ENVELOPE_RATE_HZ
+        if (rate / m_binSamples > 2 * SPD::ENVELOPE_RATE_HZ)
+            WARNING("No envelope bin divides %d Hz, envelopes at %d Hz may not fit a frame", rate, rate / m_binSamples);
+    }
+
+    // the factor divides the bin so decimated samples never straddle a bin boundary
+    float cutoff = m_filterSettings[biQuadFilter::LPF];
+    int maxFactor = polyphaseDecimatorDefaults::MAX_FACTOR;
+    if (cutoff > 0)
+        maxFactor = MIN(maxFactor, (int)(rate / (SPD::DECIMATION_MARGIN * cutoff)));
+
+    int factor = 1;
+    for (int m = 2; m <= maxFactor; m++)
+        if (m_binSamples % m == 0)
+            factor = m;
+
+    if (reset) {
+        memset(m_binFill, 0, sizeof(m_binFill));
+        memset(m_binSum, 0, sizeof(m_binSum));
+        for (int fish = 0; fish < m_fishCount; fish++)
+            m_decimators[fish].configure(factor);
+    } else if (factor != m_decimators[0].factor()) {
+        // the partial body bin restarts at the new rate, the mouth band is unaffected
+        m_binFill[biQuadFilter::LPF] = m_binFill[biQuadFilter::HPF] / factor;
+        for (int fish = 0; fish < m_fishCount; fish++) {
+            m_decimators[fish].configure(factor, m_binFill[biQuadFilter::HPF]);
+            m_binSum[fish][biQuadFilter::LPF] = 0;
+        }
+    } else {
+        return;
+    }
+
+    for (int fish = 0; fish < m_fishCount; fish++)
+        m_filters[fish][biQuadFilter::LPF]->setSampleRate((float)rate / factor);
+
+    DEBUG("Body band decimated by %d to %d Hz, envelopes at %d Hz", factor, rate / factor, rate / m_binSamples);
+}
+
+void signalProcessor::_routingWeights(int fish, int channels, float *weights) const
+{
+    const fishConfig &fc = m_config->FISH[fish];
+
+    // no route configured: plain mono downmix, as with a single fish
+    for (int c = 0; c < channels; c++) {
+        if (fc.routeCount == 0)
+            weights[c] = 1.0f / channels;
+        else
+            weights[c] = c < fc.routeCount ? fc.route[c] : 0.0f;
+    }
+}
+
+int signalProcessor::_openSink(int sampleRate, int channels)
+{
+    int chunkSizeFrames = sampleRate * m_config->CHUNK_SIZE_MS / 1000;
     DEBUG("Expected chunks size (frames/chunk) %d", chunkSizeFrames);
 
-    int audioDriverChunkSize = m_alsaDriver->updateAudioChannelData(
-        m_audioFile->getSampleRate(),
-        m_audioFile->getChannels(),
-        chunkSizeFrames
-    );
+    // with an adaptive queue the device buffer is opened at the largest depth, the queue is kept shorter than that;
+    // it never grows past what the GPIO frame ring can hold, or motor frames would be dropped
+    int periods = m_config->CHUNK_COUNT;
+    if (m_eventDriven && m_config->ADAPTIVE_LATENCY)
+        periods = MAX(periods, (int)(m_config->LATENCY_MAX_MS / m_config->CHUNK_SIZE_MS));
+    periods = MIN(periods, frameRingDefaults::MAX_QUEUED_FRAMES);
+
+    return m_audioSink->updateAudioChannelData(sampleRate, channels, chunkSizeFrames, periods);
+}
+
+void signalProcessor::_negotiateChunkSize()
+{
+    // ask the device for the file's native rate, so nothing needs to be resampled if it can run at it
+    int sourceRate = m_audioFile->getSourceSampleRate();
+    int audioDriverChunkSize;
+
+    // a sink opened ahead of the file is kept if the guess was right
+    if (m_openedRate == sourceRate && m_openedChannels == m_audioFile->getChannels()) {
+        DEBUG("Audio sink already open at %d Hz", sourceRate);
+        audioDriverChunkSize = m_openedChunkSize;
+    } else
+        audioDriverChunkSize = _openSink(sourceRate, m_audioFile->getChannels());
+    m_openedRate = 0;
+
+    // feed the rate the device settled on back to the decoder
+    int deviceRate = m_audioSink->getSampleRate();
+    if (deviceRate <= 0)
+        deviceRate = sourceRate;
+    if (deviceRate != sourceRate)
+        INFO("Audio device runs at %d Hz, resampling from %d Hz", deviceRate, sourceRate);
+    m_audioFile->setOutputFormat(deviceRate, m_config->RESAMPLER_PROFILE);
+
+    // this is the desired chunk size based on the negotiated settings
+    m_chunkSize = m_audioFile->chunkSizeBytes(m_config->CHUNK_SIZE_MS);
 
     if (m_chunkSize != audioDriverChunkSize) {
         WARNING("Processing chunks size of %d bytes does not match with audio driver which configured to %d bytes", m_chunkSize, audioDriverChunkSize);
@@ -177,20 +404,23 @@ void signalProcessor::_negotiateChunkSize()
         m_chunkSizeUs = m_chunkSize * 1e6 / m_audioFile->getSampleRate() / SPD::BYTES_PER_SAMPLE / m_audioFile->getChannels();
         DEBUG("Setting final uS chunk size to %llu", m_chunkSizeUs);
     }
-}
-
-void b3::signalProcessor::_setUpSocket()
-{
-    // m_socketFd = socket(AF_UNIX, SOCK_STREAM, 0);
-    // memset(&m_sockaddr, 0, sizeof(m_sockaddr));
-    // m_sockaddr.sun_family = AF_UNIX;
-    // strcpy(m_sockaddr.sun_path,"/tmp/b3.sock");
-    
-    // if (bind(m_socketFd, (struct sockaddr *)&m_sockaddr, sizeof(m_sockaddr)) == -1) {
-    //     ERROR("Failed to open socket %d!",m_socketFd);
-    //     return;
-    // }
 
+    m_adaptiveLatency = m_eventDriven && m_config->ADAPTIVE_LATENCY && m_chunkSizeUs > 0;
+    if (m_adaptiveLatency) {
+        int frameBytes = SPD::BYTES_PER_SAMPLE * m_audioFile->getChannels();
+        int maxChunks = MIN((int)(m_audioSink->bufferFrames() / (m_chunkSize / frameBytes)), frameRingDefaults::MAX_QUEUED_FRAMES);
+        if (m_config->LATENCY_MAX_MS * 1000 / m_chunkSizeUs > (uint64_t)frameRingDefaults::MAX_QUEUED_FRAMES)
+            WARNING("latency_max_ms %d capped at %d chunks, the most the motor frame ring holds", m_config->LATENCY_MAX_MS, frameRingDefaults::MAX_QUEUED_FRAMES);
+        m_latency.reset(
+            m_chunkSizeUs,
+            m_config->LATENCY_MIN_MS * 1000 / m_chunkSizeUs,
+            MIN(maxChunks, (int)(m_config->LATENCY_MAX_MS * 1000 / m_chunkSizeUs)),
+            m_config->CHUNK_COUNT,
+            m_audioSink->xrunCount()
+        );
+        m_audioSink->setFillTarget((uint64_t)m_latency.targetChunks() * (m_chunkSize / frameBytes));
+        INFO("Adaptive audio queue, starting at %d chunks", m_latency.targetChunks());
+    }
 }
 
 uint64_t signalProcessor::usToNextChunk()
@@ -204,55 +434,191 @@ uint64_t signalProcessor::usToNextChunk()
 
 int signalProcessor::_processChunk()
 {
+    PERF_SPAN("chunk");
+
     if (!m_fileLoaded) {
         ERROR("audioProcessor - No audio file loaded");
         return -1;
     }
     assert(m_audioFile != nullptr);
-    assert(m_filters[biQuadFilter::LPF] != nullptr);
-    assert(m_filters[biQuadFilter::HPF] != nullptr);
+    assert(m_filters[0][biQuadFilter::LPF] != nullptr);
+    assert(m_filters[0][biQuadFilter::HPF] != nullptr);
 
     int channels = m_audioFile->getChannels();
-    int sampleCount = m_chunkSize / SPD::BYTES_PER_SAMPLE / m_audioFile->getChannels();
-    int16_t pcm16Buff[sampleCount * channels];  // this has multiple channels
-    int16_t fltrSignal[biQuadFilter::_filterTypeCount][sampleCount];             // these are mono
-    // read PCM16 data from the audio file
-    int bytesRead = m_audioFile->readChunk((uint8_t *)pcm16Buff, m_chunkSize);
+    int frameBytes = SPD::BYTES_PER_SAMPLE * channels;
+    int sampleCount = m_chunkSize / frameBytes;
+    int16_t pcm16Buff[sampleCount * channels];  // this has multiple channels, only used without mmap access
+
+    // mix every fish's route in one pass over the interleaved samples, so the
+    // chunk is read once regardless of the number of fish
+    float weights[m_fishCount][channels];
+    float mix[m_fishCount][sampleCount];
+
+    for (int fish = 0; fish < m_fishCount; fish++)
+        _routingWeights(fish, channels, weights[fish]);
+
+    uint64_t startUs = m_tm.getUsSinceEpoch();
+
+    // the chunk starts playing after everything already queued, take the time before adding to the queue
+    uint64_t ptsUs = m_audioSink->nextPresentationUs();
+
+    // decode straight into the device ring when it is mapped, the ring may
+    // wrap so a chunk can take more than one region
+    int samplesRead = 0;
+    bool eof = m_chunkSize == 0;
+    uint64_t decodeUs = 0, mixUs = 0, writeUs = 0, stageUs = startUs, t;
+
+    while (samplesRead < sampleCount && !eof) {
+        uint8_t *area;
+        int frames;
+        {
+            PERF_SPAN("sink wait");
+            frames = m_audioSink->beginWrite(&area, sampleCount - samplesRead);
+        }
+        t = m_tm.getUsSinceEpoch();
+        writeUs += t - stageUs;
+        stageUs = t;
+        bool mapped = frames > 0;
+
+        if (!mapped) {
+            area = (uint8_t *)&pcm16Buff[samplesRead * channels];
+            frames = sampleCount - samplesRead;
+        }
 
-    if (signalHandler::g_shouldExit)
-        return 0;
+        // read PCM16 data from the audio file
+        int bytesRead = m_audioFile->readChunk(area, frames * frameBytes);
+        int framesRead = bytesRead > 0 ? bytesRead / frameBytes : 0;
+        t = m_tm.getUsSinceEpoch();
+        decodeUs += t - stageUs;
+        stageUs = t;
+
+        if (signalHandler::g_shouldExit) {
+            if (mapped)
+                m_audioSink->commitWrite(0);
+            return 0;
+        }
+
+        const int16_t *pcm = (const int16_t *)area;
+        for (int i = 0; i < framesRead; i++) {
+            const int16_t *in = &pcm[i * channels];
+            for (int fish = 0; fish < m_fishCount; fish++) {
+                float acc = 0.0f;
+                for (int c = 0; c < channels; c++)
+                    acc += weights[fish][c] * in[c];
+                mix[fish][samplesRead + i] = acc;
+            }
+        }
+        t = m_tm.getUsSinceEpoch();
+        mixUs += t - stageUs;
+        stageUs = t;
+
+        // write audio data to the audio driver
+        {
+            PERF_SPAN("sink write");
+            if (mapped)
+                m_audioSink->commitWrite(framesRead);
+            else
+                m_audioSink->writeAudioData(area, framesRead);
+        }
+        t = m_tm.getUsSinceEpoch();
+        writeUs += t - stageUs;
+        stageUs = t;
+
+        samplesRead += framesRead;
+        eof = framesRead < frames;
+    }
 
     // check for eof
-    if (m_chunkSize == 0 || bytesRead < m_chunkSize || bytesRead == AVERROR_EOF) {
+    if (eof) {
         INFO("EOF Detected");
         m_stopCommand = 1;
-        if (bytesRead <= 0)
+        if (samplesRead == 0)
             return 0;
     }
 
-    int samplesRead = bytesRead / SPD::BYTES_PER_SAMPLE / channels;
-
-    for (int i = 0; i < (samplesRead * channels) - 1; i += channels) {
-        // convert stereo to mono, apply filters
-        for (int fltrNdx = 0; fltrNdx < biQuadFilter::_filterTypeCount; fltrNdx++)
-            fltrSignal[fltrNdx][i / channels] = m_filters[fltrNdx]->update((float)convertPcm16BuffToMono(&pcm16Buff[i], channels));
+    // both bands reach the GPIO thread as RMS envelopes, binned straight into
+    // a frame slot; a partial bin carries over to the next chunk, so the frame
+    // starts that many samples before the chunk
+    int rate = m_audioFile->getSampleRate();
+    int factor = m_decimators[0].factor();
+    int carried = m_binFill[biQuadFilter::HPF];
+    int maxBins = (carried + samplesRead) / m_binSamples;
+    uint64_t framePtsUs = ptsUs ? ptsUs - (uint64_t)carried * 1000000 / rate : 0;
+
+    int16_t band[samplesRead];              // these are mono
+    float decimated[samplesRead / factor + 1];
+    bool frameAcquired = false;
+    int nBins = 0;
+
+    frameRing::frame gpioFrame;
+    if (GPIO::acquireFrame(gpioFrame) && maxBins <= gpioFrame.nSamples)
+        frameAcquired = true;
+
+    {
+        PERF_SPAN("filter");
+        int fill[biQuadFilter::_filterTypeCount];
+
+        for (int fish = 0; fish < m_fishCount; fish++) {
+            int16_t *mouth = frameAcquired ? gpioFrame.lane(gpio::laneIndex(fish, gpio::LANE_HPF)) : nullptr;
+            int16_t *body = frameAcquired ? gpioFrame.lane(gpio::laneIndex(fish, gpio::LANE_LPF)) : nullptr;
+
+            // the mouth band sits too high to decimate, filter it at the file rate
+            fill[biQuadFilter::HPF] = m_binFill[biQuadFilter::HPF];
+            m_filters[fish][biQuadFilter::HPF]->process(mix[fish], band, samplesRead);
+            nBins = binEnvelope(band, samplesRead, m_binSamples, fill[biQuadFilter::HPF],
+                                m_binSum[fish][biQuadFilter::HPF], mouth, maxBins);
+
+            // the body band is decimated first, its filter runs at the lower rate
+            fill[biQuadFilter::LPF] = m_binFill[biQuadFilter::LPF];
+            int n = m_decimators[fish].process(mix[fish], samplesRead, decimated);
+            m_filters[fish][biQuadFilter::LPF]->process(decimated, band, n);
+            binEnvelope(band, n, m_binSamples / factor, fill[biQuadFilter::LPF],
+                        m_binSum[fish][biQuadFilter::LPF], body, maxBins);
+        }
 
+        // every fish starts its bins at the same sample
+        memcpy(m_binFill, fill, sizeof(m_binFill));
     }
 
+    uint64_t filterUs = m_tm.getUsSinceEpoch() - stageUs;
+
     // GPIO API call
-#ifndef DISABLE_GPIO
-    GPIO::submitFrame(fltrSignal[biQuadFilter::LPF], fltrSignal[biQuadFilter::HPF], samplesRead);
-#endif
+    {
+        PERF_SPAN("submit");
+        // a chunk shorter than a bin leaves nothing to publish, the slot is reused
+        if (!frameAcquired)
+            GPIO::dropFrame();
+        else if (nBins > 0)
+            GPIO::publishFrame(nBins, rate / m_binSamples, framePtsUs);
+    }
     m_chunkTimestamp += m_chunkSizeUs;
+
+    // the first chunk written ends the start up trace
+    startupTrace::finish("first audible sample", ptsUs);
     // usleep(100000);
 
-    // write audio data to the audio driver
-    m_alsaDriver->writeAudioData((uint8_t *)pcm16Buff, samplesRead);
+    uint64_t chunkUs = m_tm.getUsSinceEpoch() - startUs;
+    if (m_adaptiveLatency && m_latency.update(chunkUs, m_audioSink->xrunCount()))
+        m_audioSink->setFillTarget((uint64_t)m_latency.targetChunks() * sampleCount);
+
+    metrics::record(METRIC_CHUNK, chunkUs);
+    metrics::record(METRIC_DECODE, decodeUs);
+    metrics::record(METRIC_SINK_WRITE, writeUs);
+
+    m_statusAudio.decodeUs = decodeUs;
+    m_statusAudio.mixUs = mixUs;
+    m_statusAudio.filterUs = filterUs;
+    m_statusAudio.writeUs = writeUs;
+    m_statusAudio.chunkUs = chunkUs;
+    m_statusAudio.maxChunkUs = MAX(m_statusAudio.maxChunkUs, (uint32_t)chunkUs);
+    _publishStatus();
+    _publishEvents(false);
+
     m_tm.lap();
 
 #ifdef DEBUG_FILTER_DATA
-    if (m_signalDebugFile)
-        fwrite(fltrSignal[biQuadFilter::LPF], sizeof(fltrSignal[0][0]), samplesRead, m_signalDebugFile);
+    if (m_signalDebugFile && frameAcquired)
+        fwrite(gpioFrame.lane(gpio::laneIndex(0, gpio::LANE_LPF)), sizeof(int16_t), nBins, m_signalDebugFile);
 #endif
 
     return 0;
@@ -1,10 +1,5 @@
 #pragma once
 
-extern "C"{
-#include <sys/socket.h>
-#include <sys/un.h>
-}
-
 #include <cassert>
 #include <cstring>
 #include <cstdio>
@@ -14,43 +9,64 @@ extern "C"{
 #include "logger.h"
 #include "state.h"
 #include "biQuadFilter.h"
-#include "audioDriver.h"
+#include "polyphaseDecimator.h"
+#include "audioSink.h"
 #include "b3Config.h"
+#include "configStore.h"
+#include "latencyController.h"
+#include "statusSegment.h"
+#include "eventStream.h"
 
 namespace b3 {
     namespace SPD = signalProcessingDefaults;
 
     class signalProcessor {
     public:
-        signalProcessor(b3Config &conf) :
+        /**
+         * @param configs The config snapshots, read once per update().
+         */
+        signalProcessor(configStore &configs) :
             m_fileLoaded(false),
             m_driverLoaded(false),
             m_fillBuffer(false),
             m_stopCommand(false),
+            m_eventDriven(false),
 
 #ifdef DEBUG_FILTER_DATA
             m_closeFile(false),
 #endif
-            m_config(conf),
+            m_configs(configs),
+            m_configReader(configs.addReader()),
+            m_config(configs.refresh(m_configReader)),
             m_activeState(State::STOPPED),
             m_audioFile(nullptr),
-            m_alsaDriver(nullptr),
+            m_audioSink(nullptr),
             m_underRunCounter(0),
             m_chunkTimestamp(timeManager::getUsSinceEpoch()),
             m_chunkSizeUs(0),
             m_chunkSize(0),
+            m_openedRate(0),
+            m_openedChannels(0),
+            m_openedChunkSize(0),
+            m_adaptiveLatency(false),
+            m_status(nullptr),
+            m_events(nullptr),
+            m_eventXruns(0),
+            m_fishCount(m_config->FISH_COUNT)
 #ifdef DEBUG_FILTER_DATA
-            m_signalDebugFile(nullptr),
+            , m_signalDebugFile(nullptr)
 #endif
-            m_socketFd(0)
         {
             memset(m_filters, 0, sizeof(m_filters));
-            m_filterSettings[biQuadFilter::HPF] = conf.HPF_CUTOFF;
-            m_filterSettings[biQuadFilter::LPF] = conf.LPF_CUTOFF;
+            memset(m_binFill, 0, sizeof(m_binFill));
+            memset(m_binSum, 0, sizeof(m_binSum));
+            m_binSamples = 1;
+            memset(&m_statusAudio, 0, sizeof(m_statusAudio));
+            m_filterSettings[biQuadFilter::HPF] = m_config->HPF_CUTOFF;
+            m_filterSettings[biQuadFilter::LPF] = m_config->LPF_CUTOFF;
 #ifdef DEBUG_FILTER_DATA
             m_closeFile = false;
 #endif
-            _setUpSocket();
         }
 
         ~signalProcessor();
@@ -60,6 +76,18 @@ namespace b3 {
          */
         void update(State state);
 
+        /**
+         * @brief
+         * Switches between pacing chunks internally (sleeping in update()) and being driven by an
+         * event loop, which calls update() once per device readiness event or timer tick.
+         */
+        inline void setEventDriven(bool eventDriven) { m_eventDriven = eventDriven; }
+
+        /**
+         * @return the playout duration of one chunk (us)
+         */
+        inline uint64_t chunkSizeUs() const { return m_chunkSizeUs; }
+
 
 
 
@@ -68,7 +96,8 @@ namespace b3 {
         inline State getState() const { return m_activeState; }
 
         /**
-         * @brief Sets processor state.
+         * @brief Sets processor state. Pausing while playing pauses the sink and the
+         * motors in place; playing again resumes them without touching the decoder.
          * @param to State to set processor to.
          */
         void setState(State to);
@@ -77,11 +106,35 @@ namespace b3 {
 
         /**
          * @brief
-         * Sets the audio driver for the audio processor. The audio processor does not own the driver.
+         * Sets the sink the audio is played to. The audio processor does not own the sink.
          *
-         * @param driver
+         * @param sink
          */
-        void setAudioDriver(audioDriver *driver);
+        void setAudioSink(audioSink *sink);
+
+        /**
+         * @brief
+         * Opens the sink before a file is set, so opening the device can overlap probing the
+         * file. setFile() keeps the sink open if the file turns out to have this format, and
+         * reopens it otherwise. May be called from another thread while nothing plays.
+         *
+         * @param sampleRate The expected sample rate of the file.
+         * @param channels The expected number of channels.
+         * @return 0 on success, -1 on failure.
+         */
+        int openSink(int sampleRate, int channels);
+
+        /**
+         * @brief
+         * Sets the segment the playback state is published to. May be null.
+         */
+        inline void setStatusSegment(statusSegment *status) { m_status = status; }
+
+        /**
+         * @brief
+         * Sets the stream position, state and underrun events are pushed to. May be null.
+         */
+        inline void setEventStream(eventStream *events) { m_events = events; }
 
         /**
          * @brief
@@ -103,8 +156,11 @@ namespace b3 {
         {
             m_fileLoaded = false;
             m_audioFile = nullptr;
-            for (int fltrNdx = 0; fltrNdx < biQuadFilter::_filterTypeCount; fltrNdx++)
-                delete m_filters[fltrNdx];
+            for (int fish = 0; fish < m_fishCount; fish++)
+                for (int fltrNdx = 0; fltrNdx < biQuadFilter::_filterTypeCount; fltrNdx++) {
+                    delete m_filters[fish][fltrNdx];
+                    m_filters[fish][fltrNdx] = nullptr;
+                }
         }
 
         uint64_t usToNextChunk();
@@ -117,22 +173,38 @@ namespace b3 {
         inline void setter(float cutoff)                                \
         {                                                               \
             m_filterSettings[accessor] = cutoff;                        \
-            if (m_filters[accessor]){                                    \
-                m_filters[accessor]->setCutoff(cutoff);                  \
-            }                                                           \
+            for (int fish = 0; fish < m_fishCount; fish++)              \
+                if (m_filters[fish][accessor])                          \
+                    m_filters[fish][accessor]->setCutoff(cutoff);       \
         }             
 
-        __setFilter(setLPF, biQuadFilter::LPF)
         __setFilter(setHPF, biQuadFilter::HPF)
 
+        /**
+         * @brief
+         * Sets the body band cutoff, and with it how far the band is decimated.
+         */
+        void setLPF(float cutoff);
+
+        /**
+         * @brief
+         * Picks the envelope bin size for the file's rate and the largest decimation of the
+         * body band its cutoff allows, then runs the body band filters at the decimated rate.
+         * @param reset true for a new file: clears the partial bins and the decimator history.
+         *              Otherwise the decimator is only redesigned if the factor changed, in
+         *              phase with the bins already running.
+         */
+        void _configureDecimation(bool reset);
 
-        inline int16_t convertPcm16BuffToMono(int16_t *inBuff, int16_t channels)
-        {
-            int sum = 0;
-            for (int i = 0; i < channels; i++)
-                sum += inBuff[i];
-            return sum / channels;
-        }
+
+        /**
+         * @brief
+         * Computes the weights used to mix the interleaved channels down to one fish's signal.
+         * @param fish The fish index
+         * @param channels The number of channels in the audio file
+         * @param weights Receives one weight per channel
+         */
+        void _routingWeights(int fish, int channels, float *weights) const;
 
         /**
          * @brief
@@ -143,7 +215,24 @@ namespace b3 {
 
         void _negotiateChunkSize();
 
-        void _setUpSocket();
+        /**
+         * @brief Opens the sink with the chunk size and count of the current config.
+         * @return the sink's chunk size (bytes), or a negative error code.
+         */
+        int _openSink(int sampleRate, int channels);
+
+        /**
+         * @brief
+         * Publishes the playback state and the timings of the last chunk to the status segment.
+         */
+        void _publishStatus();
+
+        /**
+         * @brief
+         * Pushes the position, and the underruns since the last call, to the event stream.
+         * @param stateChanged true to push a state event as well
+         */
+        void _publishEvents(bool stateChanged);
 
         // status fields
         bool m_fileLoaded;
@@ -152,29 +241,56 @@ namespace b3 {
         // flags
         bool m_fillBuffer;
         bool m_stopCommand;
+        bool m_eventDriven;
 #ifdef DEBUG_FILTER_DATA
         bool m_closeFile;
 #endif
 
-        b3Config &m_config;
+        configStore &m_configs;
+        int m_configReader;
+        const b3Config *m_config;   // snapshot taken at the start of update()
 
         State m_activeState;
  
         timeManager m_tm;
 
         audioFile *m_audioFile;
-        audioDriver *m_alsaDriver;
+        audioSink *m_audioSink;
 
         float m_filterSettings[biQuadFilter::_filterTypeCount];
-        biQuadFilter *m_filters[biQuadFilter::_filterTypeCount];
+        biQuadFilter *m_filters[configDefaults::MAX_FISH][biQuadFilter::_filterTypeCount];
+
+        // the body band runs at the file rate over the decimation factor; both bands reach
+        // the GPIO thread as RMS envelopes, one value per bin of m_binSamples input samples
+        polyphaseDecimator m_decimators[configDefaults::MAX_FISH];
+        int m_binSamples;
+        int m_binFill[biQuadFilter::_filterTypeCount];     // samples in the partial bin, at the band's rate
+        uint64_t m_binSum[configDefaults::MAX_FISH][biQuadFilter::_filterTypeCount];
         int m_underRunCounter;
 
         uint64_t m_chunkTimestamp;
         uint64_t m_chunkSizeUs;
         uint16_t m_chunkSize;
 
-        int m_socketFd;
-        struct sockaddr_un m_sockaddr;
+        // format the sink was opened at by openSink(), 0 if it was not
+        int m_openedRate;
+        int m_openedChannels;
+        int m_openedChunkSize;
+
+        // device queue depth, only adapted when event driven
+        latencyController m_latency;
+        bool m_adaptiveLatency;
+
+        // live status, stage timings are filled in by _processChunk()
+        statusSegment *m_status;
+        statusAudio m_statusAudio;
+
+        // subscription events
+        eventStream *m_events;
+        uint64_t m_eventXruns;      // underruns already reported
+
+        // number of fish with their own filter chain, fixed at startup
+        int m_fishCount;
 
 #ifdef DEBUG_FILTER_DATA
         FILE *m_signalDebugFile;
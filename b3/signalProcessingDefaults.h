@@ -18,6 +18,12 @@ namespace signalProcessingDefaults {
     constexpr float LPF_CUTOFF_DEFAULT = 5000; // most music won't have noise above 20kHz if well mastered
     constexpr float HPF_CUTOFF_DEFAULT = 5000;     // most music won't have noise below 20Hz if well mastered
 
+    // lowest rate the band envelopes are handed to the GPIO thread at (Hz)
+    constexpr int ENVELOPE_RATE_HZ = 1000;
+
+    // the body band is decimated while its cutoff stays below 1 / DECIMATION_MARGIN of the new rate
+    constexpr int DECIMATION_MARGIN = 4;
+
     // nice defaults for audio processing
     enum audioFormat {
         PCM_16 = 2,     // 16 bit PCM, 2 bytes per sample
@@ -44,5 +50,6 @@ namespace signalProcessingDefaults {
 
     constexpr uint8_t BYTES_PER_SAMPLE = __get_bytes_per_frame_per_channel();
     constexpr int DEFAULT_SAMPLE_RATE = 44100; // enforce sample rate
+    constexpr int DEFAULT_CHANNELS = 2;         // format the device is opened at before the file is probed
 
 }; // namespace signalProcessingDefaults
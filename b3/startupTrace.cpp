@@ -0,0 +1,123 @@
+#include "startupTrace.h"
+
+extern "C" {
+#include <time.h>
+#include <unistd.h>
+}
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+#include "logger.h"
+#include "timeManager.h"
+
+using namespace b3;
+using namespace startupTraceDefaults;
+using namespace std;
+
+namespace {
+    struct tracePhase {
+        const char *name;
+        atomic<uint64_t> beginUs;   // 0 until the phase is recorded
+        atomic<uint64_t> endUs;
+    };
+
+    tracePhase g_phases[MAX_PHASES];
+    atomic<int> g_phaseCount(0);
+    atomic<bool> g_finished(false);
+
+    uint64_t g_execUs;
+    uint64_t g_mainUs;
+
+    /**
+     * @return the monotonic time the process was started at (us since epoch), 0 if unknown
+     */
+    uint64_t processStartUs(uint64_t nowUs)
+    {
+        FILE *f = fopen("/proc/self/stat", "r");
+        if (!f)
+            return 0;
+
+        char stat[1024];
+        size_t len = fread(stat, 1, sizeof(stat) - 1, f);
+        fclose(f);
+        stat[len] = '\0';
+
+        // the command name may contain blanks, fields are counted after its closing parenthesis
+        char *field = strrchr(stat, ')');
+        unsigned long long startTicks;
+        if (!field || sscanf(field + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %llu", &startTicks) != 1)
+            return 0;
+
+        // the start time counts from boot, which CLOCK_BOOTTIME does as well
+        struct timespec boot;
+        long ticksPerSecond = sysconf(_SC_CLK_TCK);
+        if (ticksPerSecond <= 0 || clock_gettime(CLOCK_BOOTTIME, &boot) != 0)
+            return 0;
+
+        uint64_t bootUs = (uint64_t)boot.tv_sec * 1000000 + boot.tv_nsec / 1000;
+        uint64_t startedUs = startTicks * 1000000 / ticksPerSecond;
+        if (startedUs > bootUs || bootUs - startedUs > nowUs)
+            return 0;
+        return nowUs - (bootUs - startedUs);
+    }
+};
+
+void startupTrace::start()
+{
+    g_mainUs = timeManager::getUsSinceEpoch();
+    g_execUs = processStartUs(g_mainUs);
+}
+
+int startupTrace::begin(const char *name)
+{
+    if (g_finished.load(memory_order_relaxed))
+        return -1;
+
+    int phase = g_phaseCount.fetch_add(1, memory_order_relaxed);
+    if (phase >= MAX_PHASES)
+        return -1;
+
+    g_phases[phase].name = name;
+    g_phases[phase].beginUs.store(timeManager::getUsSinceEpoch(), memory_order_release);
+    return phase;
+}
+
+void startupTrace::end(int phase)
+{
+    if (phase < 0 || phase >= MAX_PHASES)
+        return;
+
+    g_phases[phase].endUs.store(timeManager::getUsSinceEpoch(), memory_order_release);
+}
+
+void startupTrace::finish(const char *milestone, uint64_t atUs)
+{
+    // called once per chunk, the flag is read before it is claimed
+    if (g_finished.load(memory_order_relaxed) || g_finished.exchange(true))
+        return;
+
+    uint64_t originUs = g_execUs ? g_execUs : g_mainUs;
+    int count = g_phaseCount.load();
+    if (count > MAX_PHASES)
+        count = MAX_PHASES;
+
+    INFO("Start up: %s %.1f ms after %s", milestone, (double)(atUs - originUs) / 1000, g_execUs ? "exec" : "main");
+    if (g_execUs)
+        DEBUG("--%-20s %7.1f ms  %7.1f ms", "exec to main", 0.0, (double)(g_mainUs - g_execUs) / 1000);
+
+    // phases still running at the milestone overlapped it
+    for (int i = 0; i < count; i++) {
+        const tracePhase &phase = g_phases[i];
+        uint64_t beginUs = phase.beginUs.load(memory_order_acquire);
+        uint64_t endUs = phase.endUs.load(memory_order_acquire);
+
+        if (!beginUs)
+            continue;
+        if (endUs)
+            DEBUG("--%-20s %7.1f ms  %7.1f ms", phase.name, (double)(beginUs - originUs) / 1000, (double)(endUs - beginUs) / 1000);
+        else
+            DEBUG("--%-20s %7.1f ms  running", phase.name, (double)(beginUs - originUs) / 1000);
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+
+namespace b3 {
+    namespace startupTraceDefaults {
+        // phases recorded, later ones are not traced
+        constexpr int MAX_PHASES = 16;
+    };
+
+    /**
+     * Times the start up, from exec to the first audible sample. Phases may
+     * run on any thread and overlap; the trace is reported once, by finish().
+     * Recording never blocks or allocates.
+     */
+    namespace startupTrace {
+
+        /**
+         * Starts the trace. Called first thing in main(); the time between
+         * exec and main() (loading the libraries) is taken from the kernel's
+         * process start time, which has a resolution of a scheduler tick.
+         */
+        void start();
+
+        /**
+         * Records the start of a phase. Thread safe.
+         *
+         * @param name The phase, a string literal.
+         * @return The phase id to pass to end(), -1 if the trace is full or reported.
+         */
+        int begin(const char *name);
+
+        /**
+         * Records the end of a phase. Thread safe.
+         *
+         * @param phase The id returned by begin(), -1 is ignored.
+         */
+        void end(int phase);
+
+        /**
+         * Reports every phase and the time of the milestone that ended the
+         * start up. Only the first call reports, later calls return at once.
+         *
+         * @param milestone What the start up reached, e.g. "first audible sample".
+         * @param atUs The time it was reached (us since epoch, see timeManager).
+         */
+        void finish(const char *milestone, uint64_t atUs);
+    };
+}; // namespace b3
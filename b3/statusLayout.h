@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Layout of the live status segment published by b3 in /dev/shm and read by
+ * b3stat and the web server (webServer/b3_status.py).
+ *
+ * The audio and motor sections are written by different threads, each under
+ * its own sequence lock: the writer makes the sequence odd, updates the
+ * section and makes it even again. A reader copies a section and retries if
+ * the sequence was odd or changed meanwhile. Readers never write to the
+ * segment, so they can poll it at any rate without affecting playback.
+ *
+ * All fields are naturally aligned and little endian, offsets are fixed.
+ */
+namespace b3 {
+    namespace statusDefaults {
+        constexpr const char *SHM_NAME = "/b3.status";
+        constexpr uint32_t MAGIC = 0x54533342;    // "B3ST"
+        constexpr uint32_t VERSION = 1;
+        constexpr int MAX_FISH = 4;
+    };
+
+    // statusMotors::fish[].flags
+    enum statusFishFlags : uint32_t {
+        STATUS_BODY_ACTIVE = 1 << 0,
+        STATUS_MOUTH_ACTIVE = 1 << 1,
+    };
+
+    struct statusAudio {
+        uint64_t updatedUs;     // us since epoch (CLOCK_MONOTONIC)
+        uint64_t positionUs;    // playback position in the file
+        uint64_t xruns;         // audio sink underruns
+        uint64_t framesDropped; // chunks the GPIO frame ring had no room for
+        uint32_t state;         // b3::State
+        uint32_t sampleRate;
+        uint32_t queueChunks;   // chunks kept queued in the audio sink
+        uint32_t frameQueueDepth;   // frames waiting for the GPIO thread
+
+        // time spent on the last chunk, per stage (us)
+        uint32_t decodeUs;
+        uint32_t mixUs;
+        uint32_t filterUs;
+        uint32_t writeUs;
+        uint32_t chunkUs;
+        uint32_t maxChunkUs;    // slowest chunk since the stream started
+    };
+
+    struct statusFish {
+        int32_t bodyEnvelope;
+        int32_t mouthEnvelope;
+        int32_t bodyThreshold;  // threshold in use (learned in auto threshold mode)
+        int32_t mouthThreshold;
+        uint16_t bodyDuty;
+        uint16_t mouthDuty;
+        uint32_t flags;         // statusFishFlags
+    };
+
+    struct statusMotors {
+        uint64_t updatedUs;
+        uint32_t wakeLateMaxUs; // worst GPIO thread wake-up latency of the current stats interval
+        uint32_t fishCount;
+        statusFish fish[statusDefaults::MAX_FISH];
+    };
+
+    struct statusLayout {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t size;          // sizeof(statusLayout)
+        uint32_t pid;
+        uint64_t startUs;
+        std::atomic<uint32_t> audioSeq;
+        std::atomic<uint32_t> motorSeq;
+        statusAudio audio;
+        statusMotors motors;
+    };
+
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "sequence counters are shared between processes");
+    static_assert(offsetof(statusLayout, audio) == 32, "status layout is fixed");
+    static_assert(offsetof(statusLayout, motors) == 104, "status layout is fixed");
+    static_assert(sizeof(statusFish) == 24 && sizeof(statusLayout) == 216, "status layout is fixed");
+
+    /**
+     * Writes a section under its sequence lock. Only one thread may write a section.
+     */
+    template <typename T>
+    inline void seqlockWrite(std::atomic<uint32_t> &seq, T &section, const T &value)
+    {
+        uint32_t s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy((void *)&section, &value, sizeof(T));
+        seq.store(s + 2, std::memory_order_release);
+    }
+
+    /**
+     * Copies a consistent snapshot of a section.
+     *
+     * @return false if the writer kept the section busy for maxTries attempts.
+     */
+    template <typename T>
+    inline bool seqlockRead(const std::atomic<uint32_t> &seq, const T &section, T &out, int maxTries = 1000)
+    {
+        for (int i = 0; i < maxTries; i++) {
+            uint32_t before = seq.load(std::memory_order_acquire);
+            if (before & 1)
+                continue;
+
+            memcpy(&out, (const void *)&section, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (seq.load(std::memory_order_relaxed) == before)
+                return true;
+        }
+        return false;
+    }
+}; // namespace b3
@@ -0,0 +1,73 @@
+#include "statusSegment.h"
+
+extern "C" {
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include "b3Config.h"
+#include "logger.h"
+#include "timeManager.h"
+
+using namespace b3;
+
+static_assert(statusDefaults::MAX_FISH >= configDefaults::MAX_FISH, "status segment must hold every fish");
+
+int statusSegment::create()
+{
+    if (m_layout)
+        return 0;
+
+    // world readable, readers map it read-only
+    m_fd = shm_open(statusDefaults::SHM_NAME, O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+    if (m_fd < 0) {
+        WARNING("Failed to create status segment %s: %s", statusDefaults::SHM_NAME, strerror(errno));
+        return -1;
+    }
+
+    if (ftruncate(m_fd, sizeof(statusLayout)) != 0) {
+        WARNING("Failed to size status segment: %s", strerror(errno));
+        destroy();
+        return -1;
+    }
+
+    void *mem = mmap(nullptr, sizeof(statusLayout), PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (mem == MAP_FAILED) {
+        WARNING("Failed to map status segment: %s", strerror(errno));
+        destroy();
+        return -1;
+    }
+
+    // the magic is written last, readers ignore the segment until it is set up
+    m_layout = new (mem) statusLayout();
+    m_layout->magic = 0;
+    m_layout->version = statusDefaults::VERSION;
+    m_layout->size = sizeof(statusLayout);
+    m_layout->pid = getpid();
+    m_layout->startUs = timeManager::getUsSinceEpoch();
+    std::atomic_thread_fence(std::memory_order_release);
+    m_layout->magic = statusDefaults::MAGIC;
+
+    DEBUG("Publishing status in /dev/shm%s", statusDefaults::SHM_NAME);
+    return 0;
+}
+
+void statusSegment::destroy()
+{
+    if (m_layout) {
+        munmap(m_layout, sizeof(statusLayout));
+        m_layout = nullptr;
+    }
+
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+        shm_unlink(statusDefaults::SHM_NAME);
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "statusLayout.h"
+
+namespace b3 {
+
+    /**
+     * @brief
+     * Publishes the live status segment (see statusLayout.h). Writes are a
+     * plain memory copy under a sequence lock: no syscalls and no blocking,
+     * so they are safe on the audio and GPIO threads.
+     *
+     * Without a segment (create() failed or was not called) every publish
+     * call does nothing.
+     */
+    class statusSegment {
+    public:
+        statusSegment() : m_layout(nullptr), m_fd(-1) {}
+        ~statusSegment() { destroy(); }
+
+        /**
+         * @brief Creates and maps the segment, replacing a stale one.
+         * @return 0 on success, -1 on failure.
+         */
+        int create();
+
+        /**
+         * @brief Unmaps and removes the segment.
+         */
+        void destroy();
+
+        /**
+         * @brief Publishes the audio section. Audio thread only.
+         */
+        inline void publishAudio(const statusAudio &audio)
+        {
+            if (m_layout)
+                seqlockWrite(m_layout->audioSeq, m_layout->audio, audio);
+        }
+
+        /**
+         * @brief Publishes the motor section. GPIO thread only.
+         */
+        inline void publishMotors(const statusMotors &motors)
+        {
+            if (m_layout)
+                seqlockWrite(m_layout->motorSeq, m_layout->motors, motors);
+        }
+
+    private:
+        statusLayout *m_layout;
+        int m_fd;
+    }; // class statusSegment
+}; // namespace b3
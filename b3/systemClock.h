@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+
+extern "C" {
+#include <time.h>
+}
+
+namespace b3 {
+
+    /**
+     * @brief
+     * CLOCK_MONOTONIC, the clock of production builds. Every call is inlined.
+     */
+    struct monotonicClock {
+        static constexpr bool isVirtual = false;
+
+        /**
+         * @return the current time (us)
+         */
+        static inline uint64_t nowUs()
+        {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+        }
+
+        /**
+         * @brief Sleeps until an absolute deadline (us).
+         */
+        static inline void sleepUntilUs(uint64_t deadlineUs)
+        {
+            struct timespec deadline;
+            deadline.tv_sec = deadlineUs / 1000000;
+            deadline.tv_nsec = (deadlineUs % 1000000) * 1000;
+
+            // absolute deadlines don't accumulate the time spent before the call
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR)
+                ;
+        }
+
+        static inline void sleepUs(uint64_t us) { sleepUntilUs(nowUs() + us); }
+    };
+
+    /**
+     * @brief
+     * A clock which runs at a chosen rate of CLOCK_MONOTONIC, or only moves when
+     * it is advanced, so timing behaviour can be simulated faster than real time.
+     * Sleeps wait for the virtual deadline: scaled down while the clock runs,
+     * until advance() or set() reaches it while it is stopped.
+     *
+     * It starts out following CLOCK_MONOTONIC at rate 1. Thread safe; time is
+     * kept under a mutex, which is why production builds use monotonicClock.
+     */
+    class virtualClock {
+    public:
+        static constexpr bool isVirtual = true;
+
+        static uint64_t nowUs();
+        static void sleepUntilUs(uint64_t deadlineUs);
+        static inline void sleepUs(uint64_t us) { sleepUntilUs(nowUs() + us); }
+
+        /**
+         * @brief Sets the rate of the clock against CLOCK_MONOTONIC, from now on.
+         * @param rate Virtual seconds per real second, 0 to stop the clock.
+         */
+        static void setRate(double rate);
+
+        /**
+         * @brief Moves the clock forward, waking the sleepers whose deadline passed.
+         */
+        static void advance(uint64_t us);
+
+        /**
+         * @brief Sets the current time (us), waking the sleepers whose deadline passed.
+         */
+        static void set(uint64_t us);
+    };
+
+    // the clock of timeManager and of every sleep on it, chosen at build time
+#ifdef VIRTUAL_CLOCK
+    typedef virtualClock systemClock;
+#else
+    typedef monotonicClock systemClock;
+#endif
+}; // namespace b3
@@ -0,0 +1,81 @@
+#include "thresholdIndex.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "logger.h"
+
+using namespace b3;
+
+int thresholdIndex::load()
+{
+    m_entries.clear();
+
+    FILE *f = fopen(m_path.c_str(), "r");
+    if (!f) {
+        if (errno == ENOENT)
+            return 0;
+        ERROR("Failed to open threshold index %s: %s", m_path.c_str(), strerror(errno));
+        return -1;
+    }
+
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        char song[256];
+        entry e;
+        if (sscanf(line, "%255[^\t]\t%d\t%d\t%d", song, &e.fish, &e.body, &e.mouth) != 4)
+            continue;
+        e.song = song;
+        m_entries.push_back(e);
+    }
+
+    fclose(f);
+    DEBUG("Loaded %zu learned thresholds from %s", m_entries.size(), m_path.c_str());
+    return 0;
+}
+
+int thresholdIndex::save() const
+{
+    FILE *f = fopen(m_path.c_str(), "w");
+    if (!f) {
+        ERROR("Failed to write threshold index %s: %s", m_path.c_str(), strerror(errno));
+        return -1;
+    }
+
+    for (const entry &e : m_entries)
+        fprintf(f, "%s\t%d\t%d\t%d\n", e.song.c_str(), e.fish, e.body, e.mouth);
+
+    fclose(f);
+    return 0;
+}
+
+bool thresholdIndex::lookup(const std::string &song, int fish, int &body, int &mouth) const
+{
+    for (const entry &e : m_entries) {
+        if (e.fish == fish && e.song == song) {
+            body = e.body;
+            mouth = e.mouth;
+            return true;
+        }
+    }
+    return false;
+}
+
+void thresholdIndex::store(const std::string &song, int fish, int body, int mouth)
+{
+    for (entry &e : m_entries) {
+        if (e.fish == fish && e.song == song) {
+            e.body = body;
+            e.mouth = mouth;
+            return;
+        }
+    }
+    m_entries.push_back(entry { song, fish, body, mouth });
+}
+
+std::string thresholdIndex::songKey(const char *path)
+{
+    const char *name = strrchr(path, '/');
+    return name ? name + 1 : path;
+}
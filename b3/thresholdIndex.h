@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace b3 {
+    namespace thresholdIndexDefaults {
+        constexpr const char *DEFAULT_PATH = "/home/billy/.config/b3.thresholds";
+    };
+
+    /**
+     * @brief
+     * Thresholds learned by the auto-threshold mode, indexed by song and fish.
+     * Stored as one tab separated line per entry: song, fish, body, mouth.
+     */
+    class thresholdIndex {
+    public:
+        thresholdIndex(const char *path = thresholdIndexDefaults::DEFAULT_PATH) : m_path(path) {}
+
+        /**
+         * @brief Reads the index file. A missing file is an empty index.
+         * @return 0 on success, -1 if the file exists but cannot be read.
+         */
+        int load();
+
+        /**
+         * @brief Writes the index file.
+         * @return 0 on success, -1 on failure.
+         */
+        int save() const;
+
+        /**
+         * @brief Looks up the thresholds learned for a fish on a song.
+         * @return true if an entry was found, body and mouth are left untouched otherwise.
+         */
+        bool lookup(const std::string &song, int fish, int &body, int &mouth) const;
+
+        /**
+         * @brief Adds or replaces the thresholds learned for a fish on a song.
+         */
+        void store(const std::string &song, int fish, int body, int mouth);
+
+        /**
+         * @return The index key of an audio file path (its file name).
+         */
+        static std::string songKey(const char *path);
+
+    private:
+        struct entry {
+            std::string song;
+            int fish;
+            int body;
+            int mouth;
+        };
+
+        std::string m_path;
+        std::vector<entry> m_entries;
+    }; // class thresholdIndex
+}; // namespace b3
@@ -6,6 +6,8 @@
 #include <stdint.h>
 #include <unistd.h>
 
+#include "systemClock.h"
+
 
 class timeManager {
 public:
@@ -14,7 +16,10 @@ public:
         m_lastLap(0)
     {}
 
-    static uint64_t getUsSinceEpoch();
+    /**
+     * @return the time of b3::systemClock (us), CLOCK_MONOTONIC unless built with VIRTUAL_CLOCK
+     */
+    static inline uint64_t getUsSinceEpoch() { return b3::systemClock::nowUs(); }
 
     inline uint64_t start() { m_startTime = timeManager::getUsSinceEpoch(); return m_startTime; }
     inline uint64_t elapsed() { return timeManager::getUsSinceEpoch() - m_startTime; }
@@ -0,0 +1,75 @@
+#include "systemClock.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+using namespace b3;
+using namespace std;
+
+namespace {
+    mutex g_mutex;
+    condition_variable g_changed;
+
+    // the clock reads baseUs at anchorUs of CLOCK_MONOTONIC and moves at rate from
+    // there, until it is first changed it reads the same as CLOCK_MONOTONIC
+    uint64_t g_baseUs = 0;
+    uint64_t g_anchorUs = 0;
+    double g_rate = 1.0;
+
+    // must hold g_mutex
+    uint64_t nowLocked()
+    {
+        if (g_rate == 0)
+            return g_baseUs;
+        return g_baseUs + (uint64_t)((monotonicClock::nowUs() - g_anchorUs) * g_rate);
+    }
+
+    // must hold g_mutex
+    void anchorLocked(uint64_t us)
+    {
+        g_baseUs = us;
+        g_anchorUs = monotonicClock::nowUs();
+        g_changed.notify_all();
+    }
+};
+
+uint64_t virtualClock::nowUs()
+{
+    lock_guard<mutex> lock(g_mutex);
+    return nowLocked();
+}
+
+void virtualClock::sleepUntilUs(uint64_t deadlineUs)
+{
+    unique_lock<mutex> lock(g_mutex);
+
+    for (uint64_t now = nowLocked(); now < deadlineUs; now = nowLocked()) {
+        if (g_rate == 0) {
+            g_changed.wait(lock);
+        } else {
+            // woken early if the rate or the time changes meanwhile
+            uint64_t realUs = (uint64_t)((deadlineUs - now) / g_rate) + 1;
+            g_changed.wait_for(lock, chrono::microseconds(realUs));
+        }
+    }
+}
+
+void virtualClock::setRate(double rate)
+{
+    lock_guard<mutex> lock(g_mutex);
+    anchorLocked(nowLocked());
+    g_rate = rate < 0 ? 0 : rate;
+}
+
+void virtualClock::advance(uint64_t us)
+{
+    lock_guard<mutex> lock(g_mutex);
+    anchorLocked(nowLocked() + us);
+}
+
+void virtualClock::set(uint64_t us)
+{
+    lock_guard<mutex> lock(g_mutex);
+    anchorLocked(us);
+}
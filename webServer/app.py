@@ -1,11 +1,13 @@
 from flask import Flask, jsonify, request, send_file
 import app_config as conf
 import playback_state
+import b3_status
 import json
 
 app = Flask(__name__, static_url_path='', static_folder='web/static', template_folder='web/templates')
 g_state = playback_state.PlaybackState()
 g_config = conf.config()
+g_status = b3_status.StatusReader()
 
 @app.route(conf.ACTION_ROUTE, methods=["POST"])
 def action():
@@ -56,6 +58,17 @@ def get_file_list():
         return jsonify({"status": str(e)})
 
 
+@app.route(conf.STATUS_ROUTE, methods=["GET"])
+def get_status():
+    try:
+        status = g_status.read()
+        if status is None:
+            return jsonify({"status": "not running"})
+        return jsonify({"status": "success", "live": status})
+    except Exception as e:
+        return jsonify({"status": str(e)})
+
+
 @app.route("/api/background",methods=["GET"])
 def get_image():
     return send_file("image.png")
\ No newline at end of file
@@ -9,6 +9,7 @@ This file contains the configuration for the server. This includes the routes fo
 ACTION_ROUTE = "/api/actions"
 CONFIG_ROUTE = "/api/config"
 FILE_ROUTE = "/api/audiofiles"
+STATUS_ROUTE = "/api/status"
 
 # config for the actions
 PLAY = "play_pause"
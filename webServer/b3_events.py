@@ -0,0 +1,79 @@
+import socket
+import struct
+
+"""
+Subscriber for the event stream b3 pushes over its control socket. The layout must match
+b3/eventStream.h.
+
+After the subscribe command the connection only carries batches: a header followed by
+header.count fixed-size events. b3 disconnects a subscriber which does not keep up, so read
+continuously or not at all.
+"""
+
+CONTROL_SOCKET = "/tmp/b3.sock"
+EVENT_MAGIC = 0x56453342
+EVENT_VERSION = 1
+
+BATCH_HEADER = struct.Struct("<IHH")
+EVENT = struct.Struct("<QHHI4i")
+
+EVENT_NAMES = {1: "position", 2: "state", 3: "xrun", 4: "envelope", 5: "dropped"}
+STATE_NAMES = ["stopped", "playing", "paused"]
+
+
+class EventSubscriber:
+    """
+    Connects to b3 and yields its events as dicts, one batch at a time.
+    """
+
+    def __init__(self, path: str = CONTROL_SOCKET, timeout: float = 5.0):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.settimeout(timeout)
+        self.sock.connect(path)
+        self.file = self.sock.makefile("rb")
+
+        self.sock.sendall(b"subscribe\n")
+        reply = self.file.readline().decode().split()
+        if not reply or reply[0] != "ok":
+            self.close()
+            raise ConnectionError("b3 refused the subscription")
+
+        fields = dict(f.split("=", 1) for f in reply[1:])
+        if int(fields.get("size", 0)) != EVENT.size:
+            self.close()
+            raise ConnectionError("b3 sends events of an unknown size")
+        self.rate = int(fields.get("rate", 0))
+
+    def _read(self, size: int) -> bytes:
+        data = self.file.read(size)
+        if len(data) != size:
+            raise ConnectionError("b3 closed the event stream")
+        return data
+
+    def batch(self) -> list:
+        """
+        Blocks for the next batch.
+        """
+        magic, version, count = BATCH_HEADER.unpack(self._read(BATCH_HEADER.size))
+        if magic != EVENT_MAGIC or version != EVENT_VERSION:
+            raise ConnectionError("unexpected event stream format")
+
+        events = []
+        data = self._read(count * EVENT.size)
+        for time_us, kind, index, flags, *value in EVENT.iter_unpack(data):
+            event = {"time_us": time_us, "type": EVENT_NAMES.get(kind, kind), "value": value}
+            if kind == 4:
+                event["fish"] = index
+                event["flags"] = flags
+            elif kind in (1, 2):
+                event["state"] = STATE_NAMES[flags] if flags < len(STATE_NAMES) else flags
+            events.append(event)
+        return events
+
+    def __iter__(self):
+        while True:
+            yield from self.batch()
+
+    def close(self):
+        self.file.close()
+        self.sock.close()
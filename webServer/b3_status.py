@@ -0,0 +1,128 @@
+import mmap
+import os
+import struct
+
+"""
+Reader for the live status segment b3 publishes in /dev/shm. The layout must match b3/statusLayout.h.
+
+Each section is guarded by a sequence counter which is odd while b3 updates it; a read is retried
+until the counter is even and unchanged around the copy. Reading never affects playback.
+"""
+
+STATUS_PATH = "/dev/shm/b3.status"
+STATUS_MAGIC = 0x54533342
+STATUS_VERSION = 1
+STATUS_MAX_FISH = 4
+
+STATE_NAMES = ["stopped", "playing", "paused"]
+
+HEADER = struct.Struct("<IIIIQII")
+AUDIO = struct.Struct("<QQQQIIIIIIIIII")
+MOTORS = struct.Struct("<QII")
+FISH = struct.Struct("<iiiiHHI")
+
+AUDIO_SEQ_OFFSET = 24
+MOTOR_SEQ_OFFSET = 28
+AUDIO_OFFSET = 32
+MOTORS_OFFSET = AUDIO_OFFSET + AUDIO.size
+STATUS_SIZE = MOTORS_OFFSET + MOTORS.size + STATUS_MAX_FISH * FISH.size
+
+BODY_ACTIVE = 1
+MOUTH_ACTIVE = 2
+
+MAX_TRIES = 1000
+
+
+class StatusReader:
+    """
+    Maps the status segment once and reads consistent snapshots of it. The mapping is reopened
+    whenever b3 restarts, since each run creates a new segment.
+    """
+
+    def __init__(self, path: str = STATUS_PATH):
+        self.path = path
+        self.map = None
+        self.inode = None
+
+    def _open(self):
+        try:
+            st = os.stat(self.path)
+        except FileNotFoundError:
+            self.close()
+            return False
+
+        if self.map is not None and st.st_ino == self.inode:
+            return True
+
+        self.close()
+        with open(self.path, "rb") as f:
+            self.map = mmap.mmap(f.fileno(), STATUS_SIZE, access=mmap.ACCESS_READ)
+        self.inode = st.st_ino
+
+        magic, version, size, _, _, _, _ = HEADER.unpack_from(self.map, 0)
+        if magic != STATUS_MAGIC or version != STATUS_VERSION or size != STATUS_SIZE:
+            self.close()
+            return False
+        return True
+
+    def close(self):
+        if self.map is not None:
+            self.map.close()
+        self.map = None
+        self.inode = None
+
+    def _read_section(self, seq_offset: int, offset: int, size: int):
+        for _ in range(MAX_TRIES):
+            before = struct.unpack_from("<I", self.map, seq_offset)[0]
+            if before & 1:
+                continue
+            data = self.map[offset:offset + size]
+            if struct.unpack_from("<I", self.map, seq_offset)[0] == before:
+                return data
+        return None
+
+    def read(self):
+        """
+        Returns the current status as a dict, or None if b3 is not running.
+        """
+        if not self._open():
+            return None
+
+        audio = self._read_section(AUDIO_SEQ_OFFSET, AUDIO_OFFSET, AUDIO.size)
+        motors = self._read_section(MOTOR_SEQ_OFFSET, MOTORS_OFFSET, STATUS_SIZE - MOTORS_OFFSET)
+        if audio is None or motors is None:
+            return None
+
+        (updated_us, position_us, xruns, frames_dropped, state, sample_rate, queue_chunks, frame_queue_depth,
+         decode_us, mix_us, filter_us, write_us, chunk_us, max_chunk_us) = AUDIO.unpack(audio)
+        motors_updated_us, wake_late_max_us, fish_count = MOTORS.unpack_from(motors, 0)
+
+        fish = []
+        for i in range(min(fish_count, STATUS_MAX_FISH)):
+            body_env, mouth_env, body_thr, mouth_thr, body_duty, mouth_duty, flags = FISH.unpack_from(motors, MOTORS.size + i * FISH.size)
+            fish.append({
+                "body": {"envelope": body_env, "threshold": body_thr, "duty": body_duty, "active": bool(flags & BODY_ACTIVE)},
+                "mouth": {"envelope": mouth_env, "threshold": mouth_thr, "duty": mouth_duty, "active": bool(flags & MOUTH_ACTIVE)},
+            })
+
+        return {
+            "state": STATE_NAMES[state] if state < len(STATE_NAMES) else "unknown",
+            "position_s": position_us / 1e6,
+            "sample_rate": sample_rate,
+            "xruns": xruns,
+            "frames_dropped": frames_dropped,
+            "queue_chunks": queue_chunks,
+            "frame_queue_depth": frame_queue_depth,
+            "timing_us": {
+                "decode": decode_us,
+                "mix": mix_us,
+                "filter": filter_us,
+                "write": write_us,
+                "chunk": chunk_us,
+                "max_chunk": max_chunk_us,
+            },
+            "audio_updated_us": updated_us,
+            "motors_updated_us": motors_updated_us,
+            "wake_late_max_us": wake_late_max_us,
+            "fish": fish,
+        }
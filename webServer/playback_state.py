@@ -1,6 +1,6 @@
 import os
+import socket
 import subprocess
-import signal
 import time
 import glob
 from app_config import *
@@ -12,6 +12,9 @@ class playBackConfig:
     CONFIG_FILE = os.path.join(CONFIG_PATH_FROM_ROOT, DEFAULT_CONFIG_FILE_NAME)
     AUDIO_FILE_PATH = os.path.join("/","opt","b3","audio")
     EXEC_FILE = os.path.join("/", "home","billy","big-billy-bass","build", "b3", "b3")
+    CONTROL_SOCKET = "/tmp/b3.sock"
+    START_TIMEOUT_S = 5
+    COMMAND_TIMEOUT_S = 5
 
 
 class PlaybackState:
@@ -19,9 +22,13 @@ class PlaybackState:
     The PlaybackState class is responsible for managing the state of the playback process.
     It can transition between the states of PLAY, PAUSE, and STOP.
 
+    b3 runs as a daemon which is started once and controlled over its Unix socket, one command per
+    line, so a play or pause does not pay for the process start up.
     """
 
     process: subprocess.Popen = None
+    sock: socket.socket = None
+    reader = None
     activeFile: str = None
     state: str = None
     conf: config = None
@@ -43,61 +50,96 @@ class PlaybackState:
 
     def to_pause_or_play(self, a: apiAction):
         if self.state == PLAY:
-            # transition from play to pause
-            self.stop_process()
+            # transition from play to pause, the daemon keeps the position
+            self.command("pause")
             self.state = PAUSE
             print("pausing")
-            
-        elif self.state == STOP or self.state == PAUSE:
-            # transition from pause or stop to play.
-            # If paused, the seek time is already set by the return code of the process
-            args = a[ARGS]
-            self.activeFile = args
-
-            # stop the current process if it exists
-            if self.process:
-                self.stop_process()
 
-            # start the new process
-            self.start_process(a[ARGS])
+        elif self.state == STOP or self.state == PAUSE:
+            # transition from pause or stop to play. A paused file is resumed where it stopped
+            if self.state == PAUSE and a[ARGS] == self.activeFile:
+                self.command("play")
+            else:
+                print(f"File Name to load: {a[ARGS]} from {self.state}")
+                self.command(f"play {a[ARGS]}")
+            self.activeFile = a[ARGS]
             self.state = PLAY
             print("playing")
 
     def to_stop(self, a: apiAction):
-        if self.state == PLAY:
-            self.stop_process()
-            self.state = STOP
-        elif self.state == PAUSE:
-            self.conf[SEEK_TIME] = 0
-        elif self.state == STOP:
-            pass
-        self.activeFile = "";
-        self.state = STOP 
-        self.conf.update_config_file(playBackConfig.CONFIG_FILE)
+        if self.state != STOP:
+            self.command("stop")
+        self.activeFile = ""
+        self.state = STOP
         print("stopping")
-        
 
-    def start_process(self, file):
-        print(f"File Name to load: {file} from {self.state}");
-        seek = str(self.conf[SEEK_TIME]) if self.state == PAUSE else "0";
+    def command(self, line: str) -> str:
+        """
+        Sends one command to the daemon, starting it if it is not running, and returns the reply.
+        Raises ValueError if the daemon rejected the command.
+        """
+        for attempt in range(2):
+            try:
+                if self.sock is None:
+                    self.connect()
+                self.sock.sendall((line + "\n").encode())
+                reply = self.reader.readline().strip()
+                if not reply:
+                    raise ConnectionError("daemon closed the connection")
+                break
+            except OSError:
+                self.disconnect()
+                if attempt == 1:
+                    raise
+        if reply.startswith("err"):
+            raise ValueError(reply[4:])
+        return reply[3:]
+
+    def connect(self):
+        if not os.path.exists(playBackConfig.CONTROL_SOCKET):
+            self.start_process()
+
+        deadline = time.monotonic() + playBackConfig.START_TIMEOUT_S
+        while True:
+            try:
+                self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+                self.sock.settimeout(playBackConfig.COMMAND_TIMEOUT_S)
+                self.sock.connect(playBackConfig.CONTROL_SOCKET)
+                self.reader = self.sock.makefile("r")
+                return
+            except OSError:
+                self.disconnect()
+                if time.monotonic() > deadline:
+                    raise
+                # a stale socket, or the daemon is still starting
+                if self.process is None or self.process.poll() is not None:
+                    self.start_process()
+                time.sleep(0.05)
+
+    def disconnect(self):
+        if self.sock is not None:
+            self.sock.close()
+        self.sock = None
+
+    def start_process(self):
+        print("Starting b3 daemon")
         self.process = subprocess.Popen(
-            [playBackConfig.EXEC_FILE, "-f", file, "-seek", seek, "-v"]
+            [playBackConfig.EXEC_FILE, "-daemon", "-v"]
         )
-    
 
     def stop_process(self):
-        self.process.send_signal(signal.SIGINT)
-        
-            
         try:
-            self.process.wait(timeout=5)
-        except subprocess.TimeoutExpired:
-            self.process.kill()
-            self.process.wait()
-        # if self.process.returncode != 0:
-        #     raise ValueError(
-        #         f"Process terminated with signal {self.process.returncode}"
-        #     )
+            self.command("quit")
+        except (OSError, ValueError):
+            pass
+        self.disconnect()
+
+        if self.process is not None:
+            try:
+                self.process.wait(timeout=5)
+            except subprocess.TimeoutExpired:
+                self.process.kill()
+                self.process.wait()
         self.process = None
         # update config file
         self.conf.read_config_file(playBackConfig.CONFIG_FILE)
@@ -111,6 +153,7 @@ class PlaybackState:
         return self.conf.to_dict()
         
     def kill(self):
+        self.disconnect()
         try:
             self.process.kill()
         except:
@@ -125,10 +168,16 @@ class PlaybackState:
         return self.activeFile
 
     def check_state(self):
-        
-        if self.process is not None and self.process.poll() is not None:
-            a = apiAction(STOP, "")
-            self.perform_action(a);
+        # the daemon stops by itself at the end of the file
+        if self.state == STOP:
+            return
+        try:
+            if self.command("status").startswith("state=stopped"):
+                self.state = STOP
+                self.activeFile = ""
+        except (OSError, ValueError):
+            self.state = STOP
+            self.activeFile = ""
 
 
     def download_yt(self,url):